@@ -0,0 +1,40 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Pin and peripheral assignment of sensor driver instances.
+// Drivers are compiled with these tables, the API takes the instance
+// number (index into the table) as handle. With one instance per driver
+// the index is folded away by the compiler and the code is the same as
+// with fixed pins; more instances add only table rows and state.
+
+#include <avr/io.h>
+
+// DHT11: { PORTx, pin, PCMSKx, bit in PCMSKx, PCIEx }
+// Timer1 compare A is shared, so instances are measured one after another.
+#define DHT11_INSTANCES 1
+#define DHT11_CFG_TABLE {                                  \
+    { &PORTD, PD2, &PCMSK2, 2, PCIE2 }, /* PD2 = PCINT18 */ \
+}
+// pin change groups used by DHT11 instances, the driver owns these vectors
+#define DHT11_USE_PCINT0 0
+#define DHT11_USE_PCINT1 0
+#define DHT11_USE_PCINT2 1
+
+// SDS018: USART number of each instance (ATmega2560 has USART0..3)
+#define SDS018_INSTANCES 1
+#define SDS018_USART_0   0
+// #define SDS018_USART_1 1 // second sensor on ATmega2560
+
+// MQ135: ADC channel of the sensor
+#define MQ135_ADC_CHANNEL 1 // A1
+
+// Buttons: active low to GND with internal pull-up, all in one pin change group.
+// PCINT1 is free while DHT11_USE_PCINT1 is 0, A1 (PC1) stays an ADC input.
+#define BUTTONS_PORT   PORTC
+#define BUTTONS_PCMSK  PCMSK1
+#define BUTTONS_PCIE   PCIE1
+#define BUTTONS_VECT   PCINT1_vect
+#define BUTTONS_COUNT  3
+#define BUTTONS_CFG_TABLE { PC2, PC3, PC0 } // A2 = next, A3 = previous, A0 = hold
+
+#endif
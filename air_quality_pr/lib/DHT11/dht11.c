@@ -1,128 +1,268 @@
 #include "dht11.h"
+#include "board.h" // DHT11_CFG_TABLE
 #include <avr/io.h> //AVR registers (PORT, DDR, PIN)
-#include <util/delay.h> //delay functions used for sensor timing
+#include <avr/interrupt.h> //pin change and timer interrupts
 
-#define DHT11_PORT PORTD // output register for the data pin
-#define DHT11_DDR  DDRD // controls pin direction
-#define DHT11_PINR PIND // used to read pin state
-#define DHT11_BIT  PD2 //dht11 is connected to PD2 in the project
+#ifndef F_CPU
+# define F_CPU 16000000UL
+#endif
 
-#define DHT11_MASK (1 << DHT11_BIT) //bitmask for the dht11 pin
+// pins of all instances, see board.h
+static const dht11_cfg_t cfg[DHT11_INSTANCES] = DHT11_CFG_TABLE;
 
+// with one instance the index is constant, so pin access compiles to single instructions
+#define INST(dev) ((DHT11_INSTANCES > 1) ? (dev) : 0)
 
+#define DHT11_DDR(c)  (*((c)->port - 1)) // controls pin direction
+#define DHT11_PINR(c) (*((c)->port - 2)) // used to read pin state
+#define DHT11_MASK(c) (1 << (c)->bit) //bitmask for the dht11 pin
 
-static void dht11_set_output(void)
+#define DHT11_TICKS_PER_US (F_CPU / 8 / 1000000UL) // Timer1 prescaler 8
+
+//state of background measurement, shared by all instances because Timer1 compare A is one
+#define DHT11_ST_IDLE  0 // nothing runs
+#define DHT11_ST_START 1 // host start pulse
+#define DHT11_ST_DATA  2 // receiving response
+
+//result of each instance
+typedef struct {
+    uint8_t status; // DHT11_BUSY while measured, then result until dht11_poll(), then DHT11_IDLE
+    uint8_t hum;    // last valid humidity
+    uint8_t temp;   // last valid temperature
+} dht11_inst_t;
+
+static volatile uint8_t state = DHT11_ST_IDLE;
+static volatile uint8_t active; // instance measured now
+static volatile dht11_inst_t inst[DHT11_INSTANCES];
+static dht11_decoder_t decoder; // used only in ISRs while measurement runs
+
+
+static void dht11_set_output(const dht11_cfg_t *c)
 {
-    DHT11_DDR |= DHT11_MASK; //switch pin to output mode
+    DHT11_DDR(c) |= DHT11_MASK(c); //switch pin to output mode
 }
 
-static void dht11_set_input(void)
+static void dht11_set_input(const dht11_cfg_t *c)
 {
-    DHT11_DDR &= ~DHT11_MASK;// switch pin to input mode
+    DHT11_DDR(c) &= ~DHT11_MASK(c);// switch pin to input mode
 }
 
-static void dht11_drive_low(void)// pull the data pin low
+static void dht11_drive_low(const dht11_cfg_t *c)// pull the data pin low
 {
-    DHT11_PORT &= ~DHT11_MASK;
+    *c->port &= ~DHT11_MASK(c);
 }
 
-static void dht11_drive_high(void)// set the DHT11 data pin HIGH
+static void dht11_drive_high(const dht11_cfg_t *c)// set the DHT11 data pin HIGH
 {
-    DHT11_PORT |= DHT11_MASK;
+    *c->port |= DHT11_MASK(c);
 }
 
-static uint8_t dht11_read_pin(void)// read the current logic level on the dht11 data pin, 1 means HIGH, 0 means LOW
+static uint8_t dht11_read_pin(const dht11_cfg_t *c)// read the current logic level on the dht11 data pin, 1 means HIGH, 0 means LOW
 {
-    return (DHT11_PINR & DHT11_MASK) ? 1 : 0;
+    return (DHT11_PINR(c) & DHT11_MASK(c)) ? 1 : 0;
 }
 
-//wait until the pin becomes the expected logic lvl. Returns 0 if it happened in time, 1 if it timed out
-static uint8_t dht11_wait_level(uint8_t level)
+// finish measurement from ISR, stop edge and timeout interrupts
+static void dht11_finish(uint8_t status)
 {
-    for (uint16_t i = 0; i < 1000; i++)
+    uint8_t dev = INST(active);
+
+    *cfg[dev].pcmsk &= ~(1 << cfg[dev].pcmsk_bit);
+    TIMSK1 &= ~(1 << OCIE1A);
+    if (status == DHT11_OK)
     {
-        if (dht11_read_pin() == level)
-            return 0; // level reached
-        _delay_us(1); // waiting before checking again
+        inst[dev].hum = decoder.data[0];
+        inst[dev].temp = decoder.data[2];
     }
-    return 1; //timeout
+    inst[dev].status = status;
+    state = DHT11_ST_IDLE;
 }
 
 
 void dht11_init(void) //initialization dht11 function
 {
-    dht11_set_input();//set pin as input
-    dht11_drive_high(); // idle level for DHT11 is HIGH     
+    for (uint8_t i = 0; i < DHT11_INSTANCES; i++)
+    {
+        dht11_set_input(&cfg[i]);//set pin as input
+        dht11_drive_high(&cfg[i]); // idle level for DHT11 is HIGH     
+        inst[i].status = DHT11_IDLE;
+        PCICR |= (1 << cfg[i].pcie); // pin change group is enabled, the pin itself only during measurement
+    }
+
+    // Timer1 in normal mode, free running with prescaler 8, used only for timestamps and compare A
+    TCCR1A = 0;
+    TCCR1B = (1 << CS11);
 }
 
 
-/**
- * Read one measurement frame from DHT11
- *
- * @param temperature  Pointer where integer temperature in 0С will be stored
- *                     (can be NULL if temperature is not needed)
- * @param humidity     Pointer where integer relative humidity in % will be stored
- *                     (can be NULL if humidity is not needed)
- *
- * @return DHT11_OK on success,
- *         DHT11_ERR_TIMEOUT if sensor did not respond in time,
- *         DHT11_ERR_CRC if checksum from sensor is invalid.
- */
-uint8_t dht11_read(int16_t *temperature, int16_t *humidity)
+uint8_t dht11_start(uint8_t dev)
+{
+    if (state != DHT11_ST_IDLE)
+        return DHT11_BUSY;
+
+    dev = INST(dev);
+    active = dev;
+    inst[dev].status = DHT11_BUSY;
+    state = DHT11_ST_START;
+
+    // start signal, pull pin low for 18 ms, end of the pulse is timed by compare match
+    dht11_set_output(&cfg[dev]);
+    dht11_drive_low(&cfg[dev]);
+
+    OCR1A = TCNT1 + (uint16_t)(DHT11_START_US * DHT11_TICKS_PER_US);
+    TIFR1 = (1 << OCF1A); // clear old compare flag
+    TIMSK1 |= (1 << OCIE1A);
+
+    return DHT11_OK;
+}
+
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (state != DHT11_ST_START) // response did not finish in time
+    {
+        dht11_finish(DHT11_ERR_TIMEOUT);
+        return;
+    }
+
+    const dht11_cfg_t *c = &cfg[INST(active)];
+
+    //release line and wait for sensor response edges
+    dht11_set_input(c);
+    dht11_drive_high(c);
+    dht11_decoder_reset(&decoder);
+
+    state = DHT11_ST_DATA;
+    OCR1A = TCNT1 + (uint16_t)(DHT11_TIMEOUT_US * DHT11_TICKS_PER_US);
+    PCIFR = (1 << c->pcie); // ignore edge caused by releasing the line, PCIFx has the same bit as PCIEx
+    *c->pcmsk |= (1 << c->pcmsk_bit);
+}
+
+
+// common part of pin change ISRs, only the measured instance has its pin enabled
+static void dht11_edge(uint16_t now)
+{
+    if (state != DHT11_ST_DATA)
+        return;
+
+    uint8_t status = dht11_decode_edge(&decoder, dht11_read_pin(&cfg[INST(active)]), now, DHT11_TICKS_PER_US);
+    if (status != DHT11_BUSY)
+        dht11_finish(status);
+}
+
+// timestamp first, so ISR latency does not change pulse width much
+#if DHT11_USE_PCINT0
+ISR(PCINT0_vect)
 {
-    uint8_t data[5] = {0};// buffer for 5 bytes from sensor
+    dht11_edge(TCNT1);
+}
+#endif
 
-    // start signal, pull pin low for 18 ms
-    dht11_set_output();
-    dht11_drive_low();
-    _delay_ms(18);           
+#if DHT11_USE_PCINT1
+ISR(PCINT1_vect)
+{
+    dht11_edge(TCNT1);
+}
+#endif
 
-    //release line and wait for sensor respounse
-    dht11_drive_high();
-    _delay_us(30);          
-    dht11_set_input();       
+#if DHT11_USE_PCINT2
+ISR(PCINT2_vect)
+{
+    dht11_edge(TCNT1);
+}
+#endif
 
-    // sensor should be low then high then low
-    if (dht11_wait_level(0)) return DHT11_ERR_TIMEOUT;
-    if (dht11_wait_level(1)) return DHT11_ERR_TIMEOUT;
-    if (dht11_wait_level(0)) return DHT11_ERR_TIMEOUT;
 
-    for (uint8_t byte = 0; byte < 5; byte++) // 5 data bytes reading
+void dht11_decoder_reset(dht11_decoder_t *d)
+{
+    d->level = 1; // released line is pulled up
+    d->falls = 0;
+    for (uint8_t i = 0; i < 5; i++)
+        d->data[i] = 0;
+}
+
+uint8_t dht11_decode_edge(dht11_decoder_t *d, uint8_t level, uint16_t ticks, uint8_t ticks_per_us)
+{
+    if (level == d->level) // no edge on our pin (other pin of the same port changed)
+        return DHT11_BUSY;
+    d->level = level;
+
+    if (level) // rising edge, start of HIGH pulse
     {
-        uint8_t value = 0;
-
-        for (uint8_t bit = 0; bit < 8; bit++)
-        {
-            
-            if (dht11_wait_level(1)) return DHT11_ERR_TIMEOUT; //waiting for high pulse(bit start)
-
-            uint16_t width = 0;// measure high pulse width
-            while (dht11_read_pin())
-            {
-                _delay_us(1);
-                width++;
-                if (width > 1000)//protection 
-                    return DHT11_ERR_TIMEOUT;
-            }
-
-            if (width > 40) // more then 40 us means bit = 1, else bit = 0
-                value |= (1 << (7 - bit)); 
-        }
-
-        data[byte] = value;
+        d->t_rise = ticks;
+        return DHT11_BUSY;
     }
-    
+
+    // sensor response is LOW 80 us, HIGH 80 us, so first two falling edges carry no data
+    if (++d->falls <= 2)
+        return DHT11_BUSY;
+
+    uint8_t bit = d->falls - 3; // 0..39
+    uint16_t width = ticks - d->t_rise; // 16-bit difference is correct also after timer overflow
+
+    d->data[bit >> 3] <<= 1;
+    if (width > (uint16_t)DHT11_BIT1_US * ticks_per_us) // long HIGH pulse is bit 1
+        d->data[bit >> 3] |= 1;
+
+    if (bit < 39)
+        return DHT11_BUSY;
+
     // verify checksum
-    uint8_t sum = data[0] + data[1] + data[2] + data[3]; 
-    if (sum != data[4])
+    uint8_t sum = d->data[0] + d->data[1] + d->data[2] + d->data[3]; 
+    if (sum != d->data[4])
         return DHT11_ERR_CRC;
 
+    return DHT11_OK;
+}
+
+
+uint8_t dht11_poll(uint8_t dev, int16_t *temperature, int16_t *humidity)
+{
+    dev = INST(dev);
+
+    uint8_t result = inst[dev].status; // ISR writes it only while BUSY
+    if (result == DHT11_BUSY || result == DHT11_IDLE)
+        return result;
+
+    // result is returned only once
+    inst[dev].status = DHT11_IDLE;
+
+    if (result != DHT11_OK)
+        return result;
+
     // output values of temp and hum
     if (humidity)
-        *humidity = (int16_t)data[0];
+        *humidity = (int16_t)inst[dev].hum;
 
     if (temperature)
-        *temperature = (int16_t)data[2];
+        *temperature = (int16_t)inst[dev].temp;
 
     return DHT11_OK;
 }
+
+
+/**
+ * Read one measurement frame from DHT11
+ *
+ * @param dev          Instance, index into DHT11_CFG_TABLE
+ * @param temperature  Pointer where integer temperature in 0С will be stored
+ *                     (can be NULL if temperature is not needed)
+ * @param humidity     Pointer where integer relative humidity in % will be stored
+ *                     (can be NULL if humidity is not needed)
+ *
+ * @return DHT11_OK on success,
+ *         DHT11_ERR_TIMEOUT if sensor did not respond in time,
+ *         DHT11_ERR_CRC if checksum from sensor is invalid.
+ */
+uint8_t dht11_read(uint8_t dev, int16_t *temperature, int16_t *humidity)
+{
+    uint8_t status;
+
+    while (dht11_start(dev) == DHT11_BUSY); // wait for running measurement
+
+    do {
+        status = dht11_poll(dev, temperature, humidity);
+    } while (status == DHT11_BUSY); // finished by compare match timeout at the latest
+
+    return status;
+}
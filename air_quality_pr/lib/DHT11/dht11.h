@@ -7,15 +7,79 @@
 #define DHT11_OK          0
 #define DHT11_ERR_TIMEOUT 1
 #define DHT11_ERR_CRC     2
+#define DHT11_BUSY        3 // measurement is running
+#define DHT11_IDLE        4 // no measurement started or result was already returned
+
+#define DHT11_START_US    18000 // host start pulse, sensor needs at least 18 ms LOW
+#define DHT11_TIMEOUT_US  10000 // whole response takes about 5 ms, longer means missing edges
+#define DHT11_BIT1_US     48    // HIGH pulse longer than this is bit 1 (0: 26-28 us, 1: 70 us)
+
+/**
+ * @brief Pins of one DHT11 instance, rows of DHT11_CFG_TABLE in board.h
+ */
+typedef struct {
+    volatile uint8_t *port;  // PORTx of data pin, DDRx and PINx are the registers below it
+    uint8_t bit;             // pin number in the port
+    volatile uint8_t *pcmsk; // PCMSKx of the pin change group
+    uint8_t pcmsk_bit;       // bit of the pin in PCMSKx
+    uint8_t pcie;            // PCIEx bit of the group in PCICR
+} dht11_cfg_t;
+
+/**
+ * @brief Edge decoder state
+ *
+ * Converts timestamps of edges on the data line into 5 data bytes.
+ * Does not touch any hardware, so sensor responses can be injected
+ * from a simulator.
+ */
+typedef struct {
+    uint8_t  level;   // line level after the last edge
+    uint8_t  falls;   // number of falling edges since start
+    uint16_t t_rise;  // timestamp of last rising edge in timer ticks
+    uint8_t  data[5]; // hum int, hum dec, temp int, temp dec, checksum
+} dht11_decoder_t;
 
 /**
- * Initialize DHT11 input pin
+ * Initialize input pins of all DHT11 instances and Timer/Counter1 used for timing
+ *
+ * Timer1 runs free with prescaler 8 (0.5 us per tick at 16 MHz).
  */
 void    dht11_init(void);
 
+/**
+ * @brief Start one measurement in background
+ *
+ * The 18 ms start pulse is timed by Timer1 compare match and
+ * the 40 data bits are decoded in pin change interrupt from
+ * Timer1 timestamps, so the function returns immediately.
+ * Global interrupts must be enabled.
+ *
+ * @param dev  Instance, index into DHT11_CFG_TABLE
+ *
+ * @return DHT11_OK if measurement was started,
+ *         DHT11_BUSY if measurement of any instance is still running.
+ */
+uint8_t dht11_start(uint8_t dev);
+
+/**
+ * @brief Get result of measurement started by dht11_start()
+ *
+ * @param dev          Instance, index into DHT11_CFG_TABLE
+ * @param temperature  Pointer to store temperature in 0C. Can be NULL
+ * @param humidity     Pointer to store humidity. Can be NULL
+ *
+ * @return DHT11_BUSY while measurement runs,
+ *         DHT11_OK, DHT11_ERR_TIMEOUT or DHT11_ERR_CRC once when it is finished,
+ *         DHT11_IDLE afterwards until next dht11_start().
+ */
+uint8_t dht11_poll(uint8_t dev, int16_t *temperature, int16_t *humidity);
+
 /**
  * Read temperature and humidity from DHT11.
  *
+ * Blocking version: starts measurement and waits about 23 ms for the result.
+ *
+ * @param dev          Instance, index into DHT11_CFG_TABLE
  * @param temperature  Pointer to store temperature in 0C. Can be NULL
  * @param humidity     Pointer to store humidity. Can be NULL
  *
@@ -23,6 +87,23 @@ void    dht11_init(void);
  *         DHT11_ERR_TIMEOUT on timeout,
  *         DHT11_ERR_CRC on checksum error.
  */
-uint8_t dht11_read(int16_t *temperature, int16_t *humidity);
+uint8_t dht11_read(uint8_t dev, int16_t *temperature, int16_t *humidity);
+
+/**
+ * @brief Prepare decoder for new response, line is released (HIGH)
+ */
+void dht11_decoder_reset(dht11_decoder_t *d);
+
+/**
+ * @brief Feed one edge of the data line into decoder
+ *
+ * @param d      Decoder instance
+ * @param level  Line level after the edge, 0 or 1
+ * @param ticks  Timestamp of the edge in timer ticks (wraps at 16 bits)
+ * @param ticks_per_us Timer ticks per microsecond
+ *
+ * @return DHT11_BUSY until all 40 bits are received, then DHT11_OK or DHT11_ERR_CRC
+ */
+uint8_t dht11_decode_edge(dht11_decoder_t *d, uint8_t level, uint16_t ticks, uint8_t ticks_per_us);
 
 #endif
@@ -1,26 +1,261 @@
 #include "mq135.h"
-#include <avr/io.h>
+#include "adc.h"
+#include "board.h" // MQ135_ADC_CHANNEL
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+
+#define MQ135_RATIO_MIN   128 // first point of ppm_table, Rs/R0 = 0.125 in Q10
+#define MQ135_RATIO_SHIFT 4   // ppm_table step is 16 = 1/64 in Q10
+#define MQ135_CORR_T_MIN  (-10) // first point of corr_table in 0C
+#define MQ135_CORR_T_STEP 5     // corr_table step in 0C
+#define MQ135_CORR_H_REF  33    // humidity of corr_table in %
+
+#define MQ135_CLEAN_R0_Q10 1598 // R0 = Rs(clean air) / 0.6407, ratio of 400 ppm on the CO2 curve
+#define MQ135_UP_SHIFT     6    // baseline follows cleaner air with time constant 64 s
+#define MQ135_DOWN_SHIFT   16   // and drifts down with time constant 65536 s (18 h)
+#define MQ135_EE_MAGIC     0x35 // marks valid checkpoint
+#define MQ135_CONF_MS      3600000UL // one confidence step per hour of tracking
+
+// Tables generated by mq135_table.py, see the script for the formulas.
+// ppm for Rs/R0 = 0.125 + i/64
+static const uint16_t ppm_table[MQ135_PPM_POINTS] PROGMEM = {
+    36931, 26653, 19909, 15291, 12017,  9628,  7842,  6478,
+     5418,  4581,  3910,  3366,  2921,  2552,  2243,  1983,
+     1763,  1574,  1412,  1272,  1150,  1044,   950,   868,
+      795,   730,   672,   620,   574,   532,   494,   460,
+      428,   400,   374,   351,   329,   309,   291,   274,
+      259,   244,   231,   219,   207,   197,   187,   177,
+      169,   161,   153,   146,   139,   133,   127,   122,
+      117,   112,   107,   103,    99,    95,    91,    87,
+       84,    81,    78,    75,    72,    70,    67,    65,
+       63,    61,    59,    57,    55,    53,    51,    50,
+       48,    47,    45,    44,    43,    41,    40,    39,
+       38,    37,    36,    35,    34,    33,    32,    31,
+       30,    30,    29,    28,    27,    27,    26,    25,
+       25,    24,    24,    23,    22,    22,    21,    21,
+       20,    20,    20,    19,    19,    18,    18,    17,
+       17,
+};
+
+// Rs(t, 33 %RH) / Rs(20 0C, 33 %RH) in Q10 for t = -10 + 5*i 0C
+static const uint16_t corr_table[MQ135_CORR_POINTS] PROGMEM = {
+     1757,  1590,  1441,  1309,  1196,  1101,  1024,
+      965,   924,   901,   896,   910,   941,
+};
+
+static uint8_t mq135_slot = ADC_NO_SLOT; // slot of MQ135 channel in ADC scan list
+static uint16_t r0_q8 = MQ135_R0_DEFAULT;  // clean air Rs/RL
+static int16_t env_temp = 20; // latest temperature from DHT11
+static int16_t env_hum = MQ135_CORR_H_REF; // latest humidity from DHT11
+
+// baseline checkpoint in EEPROM
+typedef struct {
+    uint8_t  magic;
+    uint16_t r0;         // R0/RL in Q8
+    uint8_t  confidence; // hours of tracking
+    uint8_t  check;      // sum of previous bytes, inverted
+} mq135_ckpt_t;
+
+static mq135_ckpt_t EEMEM ee_ckpt;
+
+// baseline tracker state
+static uint32_t baseline;    // compensated clean air Rs/RL in Q16, 0 = not started
+static uint8_t  confidence;  // hours of tracking, restored from EEPROM
+static uint8_t  saved_conf;  // confidence of last checkpoint
+static uint16_t saved_r0;    // R0 of last checkpoint
+static uint32_t start_ms;    // time of mq135_baseline_init()
+static uint32_t conf_ms;     // time of last confidence step
+static uint32_t ckpt_ms;     // time of last checkpoint
 
 void mq135_init(void)
 {
-    ADMUX = (1 << REFS0);//use AVcc (5V) as ADC reference voltage
-
-    ADCSRA = (1 << ADEN) |
-             (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0); //enable ADC and set prescaler to 128 for stable readings(16MHz/128=125kHz)
+    adc_init(); // AVcc reference, prescaler 128, conversions in ADC interrupt
+    mq135_slot = adc_add_channel(MQ135_ADC_CHANNEL);
 }
 
 uint16_t mq135_read_raw(void)
 {
-    ADMUX = (ADMUX & 0xF0) | MQ135_ADC_CHANNEL;// select ADC channel for the mq135
-    ADCSRA |= (1 << ADSC); //start ADC conversion
-    while (ADCSRA & (1 << ADSC)); // waiting until conversion is finished
-    return ADC; // raw ADC value from 0 up to 1023
+    return adc_get(mq135_slot) >> ADC_OVERSAMPLE_BITS; // raw ADC value from 0 up to 1023
+}
+
+uint16_t mq135_read_oversampled(void)
+{
+    return adc_get(mq135_slot); // 0 up to ADC_RESULT_MAX
+}
+
+void mq135_set_env(int16_t temperature, int16_t humidity)
+{
+    env_temp = temperature;
+    env_hum  = humidity;
+}
+
+void mq135_set_r0(uint16_t r0)
+{
+    if (r0 != 0)
+        r0_q8 = r0;
+}
+
+uint16_t mq135_get_r0(void)
+{
+    return r0_q8;
+}
+
+uint16_t mq135_rs_q8(uint16_t adc)
+{
+    if (adc == 0)
+        adc = 1; // open sensor, avoid division by zero
+    if (adc > ADC_RESULT_MAX)
+        adc = ADC_RESULT_MAX;
+
+    // sensor is high side, load resistor low side: U/Vcc = RL / (Rs + RL)
+    uint32_t rs = ((uint32_t)(ADC_RESULT_MAX - adc) << 8) / adc;
+    return rs > 0xFFFF ? 0xFFFF : (uint16_t)rs;
+}
+
+// temperature and humidity correction factor in Q10, interpolated from corr_table
+static uint16_t mq135_corr_q10(void)
+{
+    int16_t t = env_temp - MQ135_CORR_T_MIN;
+
+    if (t < 0)
+        t = 0;
+    if (t > (MQ135_CORR_POINTS - 1) * MQ135_CORR_T_STEP)
+        t = (MQ135_CORR_POINTS - 1) * MQ135_CORR_T_STEP;
+
+    uint8_t i    = (uint8_t)t / MQ135_CORR_T_STEP;
+    uint8_t frac = (uint8_t)t % MQ135_CORR_T_STEP;
+    int16_t c = pgm_read_word(&corr_table[i]);
+
+    if (frac)
+        c += ((int16_t)pgm_read_word(&corr_table[i + 1]) - c) * frac / MQ135_CORR_T_STEP;
+
+    // humidity term 1.8585 per %RH in Q10 (see mq135_table.py), approximated by 119/64
+    c -= (env_hum - MQ135_CORR_H_REF) * 119 / 64;
+
+    return c < 256 ? 256 : (uint16_t)c;
+}
+
+// Rs/RL in Q8 at current temperature/humidity back to 20 0C / 33 %RH
+static uint32_t mq135_rs_comp_q8(uint16_t adc)
+{
+    return ((uint32_t)mq135_rs_q8(adc) << 10) / mq135_corr_q10();
+}
+
+uint16_t mq135_ratio_q10(uint16_t adc)
+{
+    // Rs/R0 in Q10: (Rs/RL in Q8 << 10) / (R0/RL in Q8)
+    uint32_t ratio = (mq135_rs_comp_q8(adc) << 10) / r0_q8;
+
+    return ratio > 0xFFFF ? 0xFFFF : (uint16_t)ratio;
+}
+
+uint16_t mq135_ppm_from_ratio(uint16_t ratio)
+{
+    if (ratio <= MQ135_RATIO_MIN)
+        return pgm_read_word(&ppm_table[0]);
+
+    uint16_t i = (ratio - MQ135_RATIO_MIN) >> MQ135_RATIO_SHIFT;
+    if (i >= MQ135_PPM_POINTS - 1)
+        return pgm_read_word(&ppm_table[MQ135_PPM_POINTS - 1]);
+
+    // linear interpolation, table is decreasing
+    uint8_t  frac = ratio & ((1 << MQ135_RATIO_SHIFT) - 1);
+    uint16_t p0 = pgm_read_word(&ppm_table[i]);
+    uint16_t p1 = pgm_read_word(&ppm_table[i + 1]);
+
+    return p0 - (uint16_t)(((uint32_t)(p0 - p1) * frac) >> MQ135_RATIO_SHIFT);
+}
+
+uint16_t mq135_get_ppm(uint16_t adc)
+{
+    return mq135_ppm_from_ratio(mq135_ratio_q10(adc));
+}
+
+static uint8_t mq135_ckpt_check(const mq135_ckpt_t *c)
+{
+    return ~(uint8_t)(c->magic + (uint8_t)c->r0 + (uint8_t)(c->r0 >> 8) + c->confidence);
+}
+
+static void mq135_ckpt_save(void)
+{
+    mq135_ckpt_t c;
+
+    c.magic = MQ135_EE_MAGIC;
+    c.r0 = r0_q8;
+    c.confidence = confidence;
+    c.check = mq135_ckpt_check(&c);
+    eeprom_update_block(&c, &ee_ckpt, sizeof(c)); // only changed bytes are written
+
+    saved_r0 = r0_q8;
+    saved_conf = confidence;
+}
+
+void mq135_baseline_init(uint32_t now_ms)
+{
+    mq135_ckpt_t c;
+
+    eeprom_read_block(&c, &ee_ckpt, sizeof(c));
+    if (c.magic == MQ135_EE_MAGIC && c.check == mq135_ckpt_check(&c) && c.r0 != 0)
+    {
+        // warm restart, continue from last checkpoint
+        r0_q8 = c.r0;
+        confidence = c.confidence;
+        baseline = (((uint32_t)c.r0 << 10) / MQ135_CLEAN_R0_Q10) << 8; // Q8 R0 -> Q16 Rs
+    }
+    else
+    {
+        confidence = 0;
+        baseline = 0;
+    }
+    saved_r0 = r0_q8;
+    saved_conf = confidence;
+
+    start_ms = now_ms;
+    conf_ms = now_ms;
+    ckpt_ms = now_ms;
+}
+
+void mq135_baseline_update(uint16_t adc, uint32_t now_ms)
+{
+    if (now_ms - start_ms < MQ135_WARMUP_MS) // heater is not stable yet
+        return;
+
+    if (adc == 0) // no ADC result yet or sensor disconnected
+        return;
+
+    uint32_t rs = mq135_rs_comp_q8(adc) << 8; // Q16
+
+    if (baseline == 0)
+        baseline = rs; // first sample after cold start
+    else if (rs > baseline)
+        baseline += (rs - baseline) >> MQ135_UP_SHIFT; // cleaner air than baseline
+    else
+        baseline -= (baseline - rs) >> MQ135_DOWN_SHIFT; // slow drift down
+
+    uint32_t r0 = ((baseline >> 8) * MQ135_CLEAN_R0_Q10) >> 10;
+    if (r0 > 0xFFFF)
+        r0 = 0xFFFF;
+    if (r0 != 0)
+        r0_q8 = (uint16_t)r0;
+
+    if (now_ms - conf_ms >= MQ135_CONF_MS)
+    {
+        conf_ms += MQ135_CONF_MS;
+        if (confidence < 0xFF)
+            confidence++;
+    }
+
+    // checkpoint at most once per interval and only if something changed noticeably
+    if (now_ms - ckpt_ms >= MQ135_CKPT_MS)
+    {
+        ckpt_ms = now_ms;
+        uint16_t diff = r0_q8 > saved_r0 ? r0_q8 - saved_r0 : saved_r0 - r0_q8;
+        if (diff > (saved_r0 >> 6) || confidence != saved_conf)
+            mq135_ckpt_save();
+    }
 }
 
-const char* mq135_get_quality(uint16_t raw)
+uint8_t mq135_get_confidence(void)
 {
-    // classification based on raw ADC value. Lower value means that air is cleaner
-    if (raw < 200) return "GOOD";
-    if (raw < 400) return "NORMAL";
-    return "BAD";
+    return confidence;
 }
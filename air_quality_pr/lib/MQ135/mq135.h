@@ -4,13 +4,19 @@
 #include <stdint.h>
 
 
-#define MQ135_ADC_CHANNEL 1 // ADC channel A1
+#define MQ135_R0_DEFAULT  1644 // clean air Rs/RL in Q8 (6.42), raw ADC 200 at 400 ppm
+#define MQ135_PPM_POINTS  121  // points of Rs/R0 -> ppm table
+#define MQ135_CORR_POINTS 13   // points of temperature correction table
+
+#define MQ135_WARMUP_MS       180000UL  // heater warm-up after power on, baseline is not tracked
+#define MQ135_CKPT_MS         3600000UL // at most one EEPROM checkpoint per hour
 
 /**
  * @brief initialize ADC module for MQ135 sensor
  *
- * Sets the ADC reference and prescaler. Must be called once
- * before reading the sensor.
+ * Initializes ADC scan engine and adds the MQ135 channel to the
+ * scan list. Must be called once before reading the sensor,
+ * global interrupts must be enabled for conversions to run.
  *
  * @return void
  */
@@ -19,23 +25,114 @@ void mq135_init(void);
 /**
  * @brief Read raw analog value from MQ135
  *
- * Starts an ADC conversion on channel A1 and waits
- * until the conversion is complete.
+ * Returns the latest averaged result of channel A1 from the ADC
+ * scan engine, does not wait for conversion.
  *
  * @return uint16_t  Raw ADC value in the range 0–1023
  */
 uint16_t mq135_read_raw(void);
 
 /**
- * @brief Convert raw mq135 value to quality label
+ * @brief Read oversampled analog value from MQ135
+ *
+ * Same as mq135_read_raw() with ADC_OVERSAMPLE_BITS extra bits.
+ *
+ * @return uint16_t  ADC value in the range 0–ADC_RESULT_MAX
+ */
+uint16_t mq135_read_oversampled(void);
+
+/**
+ * @brief Set temperature and humidity used for compensation
+ *
+ * @param temperature  Latest temperature from DHT11 in 0C
+ * @param humidity     Latest humidity from DHT11 in %
+ */
+void mq135_set_env(int16_t temperature, int16_t humidity);
+
+/**
+ * @brief Set clean air baseline
+ *
+ * @param r0  Sensor resistance in clean air divided by load resistance, Q8.
+ *            0 is ignored.
+ */
+void mq135_set_r0(uint16_t r0);
+
+/**
+ * @brief Get clean air baseline, Rs/RL in Q8
+ */
+uint16_t mq135_get_r0(void);
+
+/**
+ * @brief Sensor resistance from ADC value
+ *
+ * @param adc  Value from mq135_read_oversampled()
+ *
+ * @return Rs/RL in Q8, saturated at 0xFFFF
+ */
+uint16_t mq135_rs_q8(uint16_t adc);
+
+/**
+ * @brief Compensated resistance ratio
+ *
+ * @param adc  Value from mq135_read_oversampled()
+ *
+ * @return Rs/R0 in Q10 corrected to 20 0C / 33 %RH with the values
+ *         from mq135_set_env(), saturated at 0xFFFF
+ */
+uint16_t mq135_ratio_q10(uint16_t adc);
+
+/**
+ * @brief Convert Rs/R0 to CO2 equivalent ppm
+ *
+ * @param ratio  Rs/R0 in Q10
+ *
+ * @return ppm, linear interpolation of PROGMEM table, saturated
+ *         outside Rs/R0 range 0.125 - 2.0
+ *
+ * Integer only: no pow()/log(), table lookup and one 32-bit multiply.
+ */
+uint16_t mq135_ppm_from_ratio(uint16_t ratio);
+
+/**
+ * @brief CO2 equivalent ppm from ADC value
  *
- * @param raw  Raw ADC reading from mq135_read_raw().
+ * @param adc  Value from mq135_read_oversampled()
  *
- * @return const char*  
- *         GOOD   – low contamination  
- *         NORMAL – medium level  
- *         BAD   – high contamination
+ * @return ppm, same as mq135_ppm_from_ratio(mq135_ratio_q10(adc))
+ */
+uint16_t mq135_get_ppm(uint16_t adc);
+
+/**
+ * @brief Restore baseline from EEPROM checkpoint
+ *
+ * @param now_ms  Current time in ms, start of heater warm-up
+ *
+ * If a valid checkpoint exists, R0 and its confidence are restored,
+ * so readings are calibrated right after warm-up instead of after
+ * 24 h of burn-in.
+ */
+void mq135_baseline_init(uint32_t now_ms);
+
+/**
+ * @brief Track clean air baseline, call once per second
+ *
+ * @param adc     Value from mq135_read_oversampled()
+ * @param now_ms  Current time in ms
+ *
+ * O(1) per call, one tracker step per call after warm-up. The time
+ * constants below assume the caller runs it once per second.
+ * Baseline is the compensated sensor resistance in clean air: it
+ * follows higher Rs (cleaner air) within about a minute and drifts
+ * down with 18 h time constant. R0 is set from the baseline assuming
+ * clean air is 400 ppm. R0 and confidence are written to EEPROM at
+ * most once per MQ135_CKPT_MS and only when R0 changed by more than
+ * 1/64 or confidence increased, so about 9000 writes per year at most.
+ */
+void mq135_baseline_update(uint16_t adc, uint32_t now_ms);
+
+/**
+ * @brief Confidence of baseline, hours of tracking (saturated at 255)
  */
-const char* mq135_get_quality(uint16_t raw);
+uint8_t mq135_get_confidence(void);
 
 #endif
@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""Generate PROGMEM tables used by mq135.c.
+
+ppm table:   ppm = PARA * ratio^PARB for ratio = Rs/R0 from 0.125 to 2.0, step 1/64
+corr table:  Rs(t, 33 %RH) / Rs(20 C, 33 %RH) in Q10 with
+             Rs(t, h) ~ CORA*t^2 - CORB*t + CORC - CORD*(h - 33),
+             temperature from -10 to 50 C, step 5 C
+
+Usage: python3 mq135_table.py > tables.txt, then paste into mq135.c
+"""
+
+PARA = 116.6020682   # CO2 curve of MQ135 datasheet
+PARB = -2.769034857
+CORA = 0.00035       # temperature/humidity dependency
+CORB = 0.02718
+CORC = 1.39538
+CORD = 0.0018
+
+RATIO_MIN_Q10 = 128  # 0.125
+RATIO_STEP_Q10 = 16  # 1/64
+RATIO_POINTS = 121   # up to 2.0
+
+def rows(values, per_row=8):
+    for i in range(0, len(values), per_row):
+        yield '    ' + ', '.join('%5d' % v for v in values[i:i + per_row]) + ','
+
+ppm = []
+for i in range(RATIO_POINTS):
+    ratio = (RATIO_MIN_Q10 + i * RATIO_STEP_Q10) / 1024.0
+    ppm.append(min(65535, int(round(PARA * ratio ** PARB))))
+
+def rs_t(t):
+    return CORA * t * t - CORB * t + CORC
+
+corr = []
+for t in range(-10, 55, 5):
+    corr.append(int(round(rs_t(t) / rs_t(20) * 1024)))
+
+print('static const uint16_t ppm_table[MQ135_PPM_POINTS] PROGMEM = {')
+print('\n'.join(rows(ppm)))
+print('};')
+print()
+print('static const uint16_t corr_table[MQ135_CORR_POINTS] PROGMEM = {')
+print('\n'.join(rows(corr, 7)))
+print('};')
+print()
+print('// humidity term per %%RH in Q10: %.4f' % (CORD / rs_t(20) * 1024))
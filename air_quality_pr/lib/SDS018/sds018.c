@@ -1,5 +1,8 @@
 #include "sds018.h"
+#include "board.h" // SDS018_INSTANCES, SDS018_USART_n
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #ifndef F_CPU
 # define F_CPU 16000000UL 
@@ -7,63 +10,504 @@
 
 #define SDS_BAUD 9600 //sensor UART baud rate
 
+#define SDS_HEAD    0xAA // first byte of every frame
+#define SDS_CMD_PM  0xC0 // command byte of data frame
+#define SDS_CMD_REPLY 0xC5 // command byte of reply to a command
+#define SDS_CMD_TX  0xB4 // command byte of frames sent to sensor
+#define SDS_TAIL    0xAB // last byte of every frame
+
+#define SDS_RX_MASK (SDS018_RX_BUFFER_SIZE - 1)
+#define SDS_TX_MASK (SDS018_TX_BUFFER_SIZE - 1)
+
+#if (SDS018_RX_BUFFER_SIZE & SDS_RX_MASK) != 0 || (SDS018_TX_BUFFER_SIZE & SDS_TX_MASK) != 0
+# error "SDS018_RX_BUFFER_SIZE and SDS018_TX_BUFFER_SIZE must be power of two"
+#endif
+
+#define SDS_FRAME_PERIOD_MS 1000 // sensor sends one frame per second while working
+
+// USART registers of one instance, all USARTs have the same layout from UCSRnA on
+#define SDS_UCSRA(u) ((u)[0])
+#define SDS_UCSRB(u) ((u)[1])
+#define SDS_UCSRC(u) ((u)[2])
+#define SDS_UBRRL(u) ((u)[4])
+#define SDS_UBRRH(u) ((u)[5])
+#define SDS_UDR(u)   ((u)[6])
+
+#define SDS_CAT(a, n, b)  SDS_CAT2(a, n, b)
+#define SDS_CAT2(a, n, b) a##n##b
+
+#ifdef USART_RX_vect // devices with one USART have vectors without number
+# define USART0_RX_vect   USART_RX_vect
+# define USART0_UDRE_vect USART_UDRE_vect
+#endif
+
+// state of one sensor
+typedef struct {
+    // ring buffer filled by USART RX ISR, head is written only by ISR, tail only by main code
+    volatile uint8_t rx_buf[SDS018_RX_BUFFER_SIZE];
+    volatile uint8_t rx_head;
+    volatile uint8_t rx_tail;
+    volatile uint16_t rx_overruns; // updated from ISR
+
+    // ring buffer emptied by USART data register empty ISR, head is written only by main code, tail only by ISR
+    volatile uint8_t tx_buf[SDS018_TX_BUFFER_SIZE];
+    volatile uint8_t tx_head;
+    volatile uint8_t tx_tail;
+
+    sds018_parser_t parser;
+    sds018_stats_t stats;
+    uint8_t frame_pending; // valid frame received, but not yet returned by sds018_read()
+
+    // sampler state
+    const sds018_policy_t *policy;
+    uint8_t  sampler_state;
+    uint32_t state_start_ms;  // time of last state change
+    uint32_t interval_ms;     // current sleep interval, adapted to PM trend
+    uint32_t sum25;           // sum of PM2.5*10 of frames in current burst
+    uint32_t sum10;           // sum of PM10*10 of frames in current burst
+    uint8_t  sum_count;       // frames in current burst
+    uint16_t last25;          // last averaged PM2.5*10, used for trend
+    uint8_t  have_last;       // last25 is valid
+} sds_dev_t;
+
+static sds_dev_t devs[SDS018_INSTANCES];
+
+// first USART register of each instance, see board.h
+static volatile uint8_t *const usart[SDS018_INSTANCES] = {
+    &SDS_CAT(UCSR, SDS018_USART_0, A),
+#if SDS018_INSTANCES > 1
+    &SDS_CAT(UCSR, SDS018_USART_1, A),
+#endif
+#if SDS018_INSTANCES > 2
+    &SDS_CAT(UCSR, SDS018_USART_2, A),
+#endif
+#if SDS018_INSTANCES > 3
+    &SDS_CAT(UCSR, SDS018_USART_3, A),
+#endif
+};
+
+// with one instance the index is constant, so register access compiles to direct addresses
+#define INST(dev) ((SDS018_INSTANCES > 1) ? (dev) : 0)
+
 void sds018_init(void)
 {
+    for (uint8_t i = 0; i < SDS018_INSTANCES; i++)
+    {
+        volatile uint8_t *u = usart[i];
+        sds_dev_t *d = &devs[i];
+
+        SDS_UCSRA(u) = 0x00;// normal operation
+        SDS_UCSRB(u) = (1 << RXEN0) | (1 << RXCIE0) | (1 << TXEN0); // enable UART RX, RX complete interrupt and TX
+        SDS_UCSRC(u) = (1 << UCSZ01) | (1 << UCSZ00); // 8bit data, 1 stop, no parity   
 
-    UCSR0A = 0x00;// normal operation
-    UCSR0B = (1 << RXEN0); // enable UART RX                   
-    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); // 8bit data, 1 stop, no parity   
+        uint16_t ubrr = (F_CPU / (16UL * SDS_BAUD)) - 1;//calculate UART baud rate setting
+        SDS_UBRRH(u) = (uint8_t)(ubrr >> 8); // writing high byte
+        SDS_UBRRL(u) = (uint8_t)(ubrr & 0xFF);// write low byte
 
-    uint16_t ubrr = (F_CPU / (16UL * SDS_BAUD)) - 1;//calculate UART baud rate setting
-    UBRR0H = (uint8_t)(ubrr >> 8); // writing high byte
-    UBRR0L = (uint8_t)(ubrr & 0xFF);// write low byte
+        d->rx_head = 0;
+        d->rx_tail = 0;
+        d->tx_head = 0;
+        d->tx_tail = 0;
+        d->sampler_state = SDS018_STATE_SLEEP;
+        sds018_parser_reset(&d->parser);
+    }
 }
 
-static uint8_t uart_rx(void)
+// store received byte, inlined into the ISR so it does not save all registers for a call
+static inline void sds018_rx_store(sds_dev_t *d, uint8_t b)
 {
-    while (!(UCSR0A & (1 << RXC0)));//waiting for incoming byte
-    return UDR0;// read received byte
+    uint8_t next = (d->rx_head + 1) & SDS_RX_MASK;
+
+    if (next == d->rx_tail) // buffer full, drop the byte
+    {
+        d->rx_overruns++;
+        return;
+    }
+    d->rx_buf[d->rx_head] = b;
+    d->rx_head = next;
 }
 
-uint8_t sds018_read(uint16_t *pm25_10, uint16_t *pm10_10)
+// take next byte to send, 1 when buffer is empty
+static inline uint8_t sds018_tx_take(sds_dev_t *d, uint8_t *b)
 {
-    uint8_t b;
-    
-    // wait until start byte 0xAA appears
-    do {
-        b = uart_rx();
-    } while (b != 0xAA);
-
-    uint8_t type = uart_rx(); //next byte must be 0xC0 that is data frame
-    if (type != 0xC0)
+    uint8_t tail = d->tx_tail;
+
+    if (tail == d->tx_head)
         return 1;
+    *b = d->tx_buf[tail];
+    d->tx_tail = (tail + 1) & SDS_TX_MASK;
+    return 0;
+}
+
+void sds018_rx_byte(uint8_t dev, uint8_t b)
+{
+    sds018_rx_store(&devs[INST(dev)], b);
+}
+
+uint8_t sds018_tx_byte(uint8_t dev, uint8_t *b)
+{
+    return sds018_tx_take(&devs[INST(dev)], b);
+}
+
+// common part of RX ISRs, inlined with constant instance
+static inline void sds018_rx_isr(uint8_t i)
+{
+    volatile uint8_t *u = usart[i];
+    sds_dev_t *d = &devs[i];
+    uint8_t status = SDS_UCSRA(u); // status flags must be read before UDRn
+    uint8_t b = SDS_UDR(u);
+
+    if (status & (1 << DOR0)) // hardware lost at least one byte before this one
+        d->rx_overruns++;
+
+    sds018_rx_store(d, b);
+}
+
+// common part of UDRE ISRs
+static inline void sds018_udre_isr(uint8_t i)
+{
+    uint8_t b;
+
+    if (sds018_tx_take(&devs[i], &b)) // nothing more to send
+    {
+        SDS_UCSRB(usart[i]) &= ~(1 << UDRIE0);
+        return;
+    }
+    SDS_UDR(usart[i]) = b;
+}
+
+// interrupt vectors of instance i on USART n
+#define SDS_ISRS(i, n)                                                \
+    ISR(SDS_CAT(USART, n, _RX_vect))   { sds018_rx_isr(i); }          \
+    ISR(SDS_CAT(USART, n, _UDRE_vect)) { sds018_udre_isr(i); }
 
-    //reading PMvalues from low byte first
-    uint8_t pm25_low  = uart_rx();
-    uint8_t pm25_high = uart_rx();
-    uint8_t pm10_low  = uart_rx();
-    uint8_t pm10_high = uart_rx();
+SDS_ISRS(0, SDS018_USART_0)
+#if SDS018_INSTANCES > 1
+SDS_ISRS(1, SDS018_USART_1)
+#endif
+#if SDS018_INSTANCES > 2
+SDS_ISRS(2, SDS018_USART_2)
+#endif
+#if SDS018_INSTANCES > 3
+SDS_ISRS(3, SDS018_USART_3)
+#endif
 
-    //read sensorID and checksum
-    uint8_t id1 = uart_rx();
-    uint8_t id2 = uart_rx();
-    uint8_t checksum = uart_rx();
-    uint8_t tail = uart_rx();
+// copy bytes to TX ring buffer, whole frame or nothing
+static uint8_t sds018_send(uint8_t dev, const uint8_t *data, uint8_t len)
+{
+    sds_dev_t *d = &devs[dev];
+    uint8_t head = d->tx_head;
+    uint8_t free_bytes = (d->tx_tail - head - 1) & SDS_TX_MASK;
 
-    if (tail != 0xAB)// last byte must be 0xAB
+    if (free_bytes < len)
+    {
+        d->stats.tx_dropped++;
         return 1;
+    }
+    for (uint8_t i = 0; i < len; i++)
+    {
+        d->tx_buf[head] = data[i];
+        head = (head + 1) & SDS_TX_MASK;
+    }
+    d->tx_head = head;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // UCSRnB is modified also by UDRE ISR
+    {
+        SDS_UCSRB(usart[dev]) |= (1 << UDRIE0);
+    }
+    return 0;
+}
+
+void sds018_encode_cmd(uint8_t *frame, uint8_t cmd, uint8_t set, uint8_t value)
+{
+    frame[0] = SDS_HEAD;
+    frame[1] = SDS_CMD_TX;
+    frame[2] = cmd;
+    frame[3] = set;
+    frame[4] = value;
+    for (uint8_t i = 5; i < 15; i++) // data4..data13 are reserved
+        frame[i] = 0;
+    frame[15] = 0xFF; // device ID 0xFFFF = all sensors
+    frame[16] = 0xFF;
+
+    // checksum is sum of data bytes and device ID
+    uint8_t sum = 0;
+    for (uint8_t i = 2; i < 17; i++)
+        sum += frame[i];
+    frame[17] = sum;
+    frame[18] = SDS_TAIL;
+}
+
+static uint8_t sds018_command(uint8_t dev, uint8_t cmd, uint8_t set, uint8_t value)
+{
+    uint8_t frame[SDS018_CMD_LEN];
+
+    sds018_encode_cmd(frame, cmd, set, value);
+    return sds018_send(INST(dev), frame, sizeof(frame));
+}
+
+uint8_t sds018_set_report_mode(uint8_t dev, uint8_t query)
+{
+    return sds018_command(dev, SDS018_CMD_REPORT_MODE, 1, query ? 1 : 0);
+}
+
+uint8_t sds018_query(uint8_t dev)
+{
+    return sds018_command(dev, SDS018_CMD_QUERY, 0, 0);
+}
+
+uint8_t sds018_set_sleep(uint8_t dev, uint8_t sleep)
+{
+    return sds018_command(dev, SDS018_CMD_SLEEP_WORK, 1, sleep ? 0 : 1);
+}
+
+uint8_t sds018_set_working_period(uint8_t dev, uint8_t minutes)
+{
+    if (minutes > 30) // longest period supported by sensor
+        minutes = 30;
+    return sds018_command(dev, SDS018_CMD_PERIOD, 1, minutes);
+}
+
+void sds018_parser_reset(sds018_parser_t *p)
+{
+    p->pos = 0;
+}
+
+uint8_t sds018_parse_byte(sds018_parser_t *p, uint8_t b)
+{
+    if (p->pos == 0)
+    {
+        if (b == SDS_HEAD) // skip everything until start byte
+            p->buf[p->pos++] = b;
+        return SDS018_PARSE_BUSY;
+    }
+
+    if ((p->pos == 1 && b != SDS_CMD_PM && b != SDS_CMD_REPLY) ||
+        (p->pos == SDS018_FRAME_LEN - 1 && b != SDS_TAIL))
+    {
+        // broken frame, the next frame can start inside the bytes already stored,
+        // so feed them again from the second byte on (the first one was a false header)
+        uint8_t n = p->pos;
+        p->pos = 0;
+        for (uint8_t i = 1; i < n; i++)
+            sds018_parse_byte(p, p->buf[i]);
+        sds018_parse_byte(p, b);
+        return SDS018_PARSE_RESYNC;
+    }
+
+    p->buf[p->pos++] = b;
+    if (p->pos < SDS018_FRAME_LEN)
+        return SDS018_PARSE_BUSY;
+
+    p->pos = 0;
+
+    // Calculate checksum. This is sum of 6 data bytes
+    uint8_t calc = 0;
+    for (uint8_t i = 2; i < 8; i++)
+        calc += p->buf[i];
+
+    if (calc != p->buf[8]) // reject corrupted frames
+        return SDS018_PARSE_BAD_CHECKSUM;
+
+    if (p->buf[1] == SDS_CMD_REPLY) // reply to command, keep its 4 data bytes
+    {
+        for (uint8_t i = 0; i < 4; i++)
+            p->reply[i] = p->buf[2 + i];
+        return SDS018_PARSE_REPLY;
+    }
 
-    // Calculate checksum. This is sum of fisrt 6 bytes
-    uint8_t calc = (pm25_low + pm25_high +
-                    pm10_low + pm10_high +
-                    id1 + id2) % 256;
+    // converting bytes into 16 bit values, low byte first
+    p->pm25_10 = (uint16_t)((p->buf[3] << 8) | p->buf[2]);
+    p->pm10_10 = (uint16_t)((p->buf[5] << 8) | p->buf[4]);
 
-    if (calc != checksum) // reject corrupted frames
+    return SDS018_PARSE_FRAME;
+}
+
+// move all bytes from ring buffer through the parser
+static void sds018_process(sds_dev_t *d)
+{
+    uint8_t tail = d->rx_tail;
+
+    while (tail != d->rx_head)
+    {
+        switch (sds018_parse_byte(&d->parser, d->rx_buf[tail]))
+        {
+            case SDS018_PARSE_FRAME:
+                d->stats.frames++;
+                d->frame_pending = 1;
+                if (d->sampler_state == SDS018_STATE_SAMPLING) // add frame to current burst
+                {
+                    d->sum25 += d->parser.pm25_10;
+                    d->sum10 += d->parser.pm10_10;
+                    d->sum_count++;
+                }
+                break;
+            case SDS018_PARSE_REPLY:
+                d->stats.replies++;
+                break;
+            case SDS018_PARSE_BAD_CHECKSUM:
+                d->stats.bad_checksum++;
+                break;
+            case SDS018_PARSE_RESYNC:
+                d->stats.resyncs++;
+                break;
+            default:
+                break;
+        }
+        tail = (tail + 1) & SDS_RX_MASK;
+        d->rx_tail = tail; // free the slot for ISR
+    }
+}
+
+uint8_t sds018_read(uint8_t dev, uint16_t *pm25_10, uint16_t *pm10_10)
+{
+    sds_dev_t *d = &devs[INST(dev)];
+
+    sds018_process(d);
+
+    if (!d->frame_pending)
         return 1;
-    
-    // converting bytes into 16 bit values
-    *pm25_10 = (uint16_t)((pm25_high << 8) | pm25_low);   
-    *pm10_10 = (uint16_t)((pm10_high << 8) | pm10_low);   
+
+    d->frame_pending = 0;
+    *pm25_10 = d->parser.pm25_10;
+    *pm10_10 = d->parser.pm10_10;
 
     return 0;// success
 }
+
+void sds018_get_stats(uint8_t dev, sds018_stats_t *out)
+{
+    sds_dev_t *d = &devs[INST(dev)];
+
+    sds018_process(d);
+
+    *out = d->stats;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        out->overruns = d->rx_overruns; // 16-bit value shared with ISR
+    }
+}
+
+static void sampler_set_state(sds_dev_t *d, uint8_t state, uint32_t now_ms)
+{
+    d->sampler_state = state;
+    d->state_start_ms = now_ms;
+    d->sum25 = 0;
+    d->sum10 = 0;
+    d->sum_count = 0;
+}
+
+void sds018_sampler_start(uint8_t dev, const sds018_policy_t *p, uint32_t now_ms)
+{
+    sds_dev_t *d = &devs[INST(dev)];
+
+    d->policy = p;
+    d->interval_ms = p->interval_ms;
+    d->have_last = 0;
+
+    sds018_set_report_mode(dev, 0);   // sensor sends frames by itself while working
+    sds018_set_working_period(dev, 0); // timing is done here, not by sensor firmware
+    sds018_set_sleep(dev, 0);
+    sampler_set_state(d, SDS018_STATE_SPINUP, now_ms);
+}
+
+// adapt sleep interval to PM2.5 trend, shorter interval while PM is climbing
+static void sampler_adapt(sds_dev_t *d, uint16_t pm25_10)
+{
+    const sds018_policy_t *policy = d->policy;
+
+    if (policy->adaptive && d->have_last)
+    {
+        if (pm25_10 > d->last25 + policy->rise_10)
+        {
+            d->interval_ms /= 2;
+            if (d->interval_ms < policy->min_interval_ms)
+                d->interval_ms = policy->min_interval_ms;
+        }
+        else
+        {
+            d->interval_ms *= 2; // stable or falling, relax back to policy interval
+            if (d->interval_ms > policy->interval_ms || d->interval_ms == 0)
+                d->interval_ms = policy->interval_ms;
+        }
+    }
+    d->last25 = pm25_10;
+    d->have_last = 1;
+}
+
+uint8_t sds018_sampler_update(uint8_t dev, uint32_t now_ms, uint16_t *pm25_10, uint16_t *pm10_10)
+{
+    sds_dev_t *d = &devs[INST(dev)];
+    const sds018_policy_t *policy = d->policy;
+
+    sds018_process(d);
+    d->frame_pending = 0; // frames are consumed through burst sums only
+
+    if (policy == 0)
+        return 1;
+
+    uint32_t elapsed = now_ms - d->state_start_ms;
+
+    switch (d->sampler_state)
+    {
+        case SDS018_STATE_SLEEP:
+            if (elapsed >= d->interval_ms)
+            {
+                sds018_set_sleep(dev, 0); // wake up, fan needs time to spin up
+                sampler_set_state(d, SDS018_STATE_SPINUP, now_ms);
+            }
+            break;
+
+        case SDS018_STATE_SPINUP:
+            if (elapsed >= policy->spinup_ms)
+                sampler_set_state(d, SDS018_STATE_SAMPLING, now_ms);
+            break;
+
+        case SDS018_STATE_SAMPLING:
+        {
+            // frames should come every second, allow twice as long before giving up
+            uint8_t timeout = elapsed >= 2UL * SDS_FRAME_PERIOD_MS * (policy->frames + 1);
+
+            if (d->sum_count > 0 && (d->sum_count >= policy->frames || timeout))
+            {
+                *pm25_10 = (uint16_t)(d->sum25 / d->sum_count);
+                *pm10_10 = (uint16_t)(d->sum10 / d->sum_count);
+                sampler_adapt(d, *pm25_10);
+
+                if (policy->interval_ms == 0) // continuous mode, sensor never sleeps
+                {
+                    sampler_set_state(d, SDS018_STATE_SAMPLING, now_ms);
+                }
+                else
+                {
+                    sds018_set_sleep(dev, 1);
+                    sampler_set_state(d, SDS018_STATE_SLEEP, now_ms);
+                }
+                return 0;
+            }
+            if (timeout)
+            {
+                // no frame at all, wake command was probably lost
+                d->stats.no_data++;
+                sds018_set_sleep(dev, 0);
+                sampler_set_state(d, SDS018_STATE_SPINUP, now_ms);
+            }
+        }
+        break;
+
+        default:
+            sampler_set_state(d, SDS018_STATE_SLEEP, now_ms);
+            break;
+    }
+    return 1;
+}
+
+uint8_t sds018_sampler_state(uint8_t dev)
+{
+    return devs[INST(dev)].sampler_state;
+}
+
+uint32_t sds018_sampler_interval(uint8_t dev)
+{
+    return devs[INST(dev)].interval_ms;
+}
@@ -3,27 +3,232 @@
 
 #include <stdint.h>
 
+#define SDS018_RX_BUFFER_SIZE 64 // size of UART receive ring buffer, must be power of two
+#define SDS018_TX_BUFFER_SIZE 64 // size of UART transmit ring buffer, must be power of two, holds 3 commands
+#define SDS018_FRAME_LEN      10 // AA C0 pm25L pm25H pm10L pm10H id1 id2 sum AB
+#define SDS018_CMD_LEN        19 // AA B4 data1..data13 idL idH sum AB
+
+//command IDs, sent as data1 of command frame and returned in reply frame
+#define SDS018_CMD_REPORT_MODE 2 // value 0 = active reporting, 1 = query mode
+#define SDS018_CMD_QUERY       4 // request one data frame in query mode
+#define SDS018_CMD_SLEEP_WORK  6 // value 0 = sleep (fan and laser off), 1 = work
+#define SDS018_CMD_PERIOD      8 // value 0 = continuous, 1-30 = minutes between measurements
+
+//states of the sampling policy, see sds018_sampler_update()
+#define SDS018_STATE_SLEEP    0 // sensor sleeps until next burst
+#define SDS018_STATE_SPINUP   1 // sensor woken up, frames are ignored until fan is stable
+#define SDS018_STATE_SAMPLING 2 // frames are averaged
+
+//results of sds018_parse_byte()
+#define SDS018_PARSE_BUSY         0 // frame not complete yet
+#define SDS018_PARSE_FRAME        1 // valid frame decoded into parser pm25_10/pm10_10
+#define SDS018_PARSE_BAD_CHECKSUM 2 // frame complete but checksum is wrong
+#define SDS018_PARSE_RESYNC       3 // wrong command or tail byte, parser restarted from header search
+#define SDS018_PARSE_REPLY        4 // valid command reply decoded into parser reply[]
+
+/**
+ * @brief Byte-at-a-time parser state for sds018 data frames
+ *
+ * Does not touch any hardware, so it can be fed from the UART ring
+ * buffer on the MCU or from recorded byte streams on a host.
+ */
+typedef struct {
+    uint8_t  pos;                     // number of bytes of current frame already stored
+    uint8_t  buf[SDS018_FRAME_LEN];   // bytes of current frame
+    uint16_t pm25_10;                 // PM2.5*10 from the last valid frame
+    uint16_t pm10_10;                 // PM10*10 from the last valid frame
+    uint8_t  reply[4];                // data bytes of the last command reply, reply[0] is command ID
+} sds018_parser_t;
+
+/**
+ * @brief Receive statistics of the sds018 driver
+ */
+typedef struct {
+    uint16_t frames;       // valid frames received
+    uint16_t overruns;     // bytes lost in UART hardware or because ring buffer was full
+    uint16_t bad_checksum; // complete frames rejected by checksum
+    uint16_t resyncs;      // partial frames dropped because of wrong command or tail byte
+    uint16_t replies;      // command replies received
+    uint16_t tx_dropped;   // commands not sent because TX buffer was full
+    uint16_t no_data;      // sampling bursts without any frame, sensor was woken again
+} sds018_stats_t;
+
+/**
+ * @brief Duty cycle policy of the sds018 sampler
+ *
+ * The sensor sleeps for interval_ms, then it is woken up, frames are
+ * ignored during spinup_ms and the next `frames` frames are averaged.
+ * After that the sensor is put to sleep again. With interval_ms = 0
+ * the sensor never sleeps and every `frames` frames are averaged.
+ */
+typedef struct {
+    uint32_t interval_ms;     // sleep time between bursts while PM is stable
+    uint32_t min_interval_ms; // shortest sleep time used by adaptive mode
+    uint16_t spinup_ms;       // fan spin-up time after wake
+    uint8_t  frames;          // number of frames averaged per burst
+    uint8_t  adaptive;        // nonzero: halve sleep time while PM2.5 is climbing
+    uint16_t rise_10;         // PM2.5*10 increase between bursts treated as climbing
+} sds018_policy_t;
+
 /**
- * @brief Initialize UART for sds018 sensor
+ * @brief Initialize UARTs of all sds018 instances
  *
- * Sets up USART at 9600 baud and enables RX input
- * must be called once before reading data from the sensor.
+ * Sets up each USART listed in board.h at 9600 baud, enables RX and TX
+ * with interrupts. Every instance has its own ring buffers, parser,
+ * statistics and sampler (about 190 bytes of SRAM each).
+ * Received bytes are stored into ring buffer by the ISR and commands
+ * are sent from TX ring buffer, so global interrupts must be enabled
+ * with sei() after initialization.
  */
 void sds018_init(void);
 
 /**
- * @brief Read one data frame from the sds018
+ * @brief Store one received byte in the receive ring buffer
+ *
+ * @param dev  Instance
+ * @param b    Byte as received from the sensor
+ *
+ * Called by the RX interrupt. Tests use it to play a simulated sensor
+ * with the RX interrupt disabled, it must not be called while the
+ * interrupt of the instance is enabled.
+ */
+void sds018_rx_byte(uint8_t dev, uint8_t b);
+
+/**
+ * @brief Take the next byte to be sent from the transmit ring buffer
  *
+ * @param dev  Instance
+ * @param b    Pointer where the byte will be stored
+ *
+ * @return 0 — byte taken, 1 — nothing to send
+ *
+ * Called by the UDRE interrupt. Same restriction as sds018_rx_byte().
+ */
+uint8_t sds018_tx_byte(uint8_t dev, uint8_t *b);
+
+/**
+ * @brief Get the latest data frame from the sds018
+ *
+ * @param dev      Instance, index into SDS018_USART_n list in board.h
  * @param pm25_10  Pointer to variable where PM2.5*10 will be stored.
  * @param pm10_10  Pointer to variable where PM10*10 will be stored.
  *
  * @return uint8_t 
- *         0 — data frame is valid  
- *         1 — wrong header, checksum error or corrupted frame
+ *         0 — new valid frame was received since the previous call  
+ *         1 — no new frame, output values are not changed
+ *
+ * The function does not block. It processes all bytes collected by the
+ * RX interrupt since the last call and returns the newest checksum-verified
+ * frame. The sensor sends one 10-byte frame per second, so the 64-byte
+ * ring buffer holds about 6 seconds of data between two calls.
+ */
+uint8_t sds018_read(uint8_t dev, uint16_t *pm25_10, uint16_t *pm10_10);
+
+/**
+ * @brief Copy receive statistics
  *
- * The function waits for the start byte 0xAA, checks frame type,
- * reads all bytes, verifies checksum, and extracts PM values
+ * @param dev    Instance
+ * @param stats  Pointer to structure to be filled
+ */
+void sds018_get_stats(uint8_t dev, sds018_stats_t *stats);
+
+/**
+ * @brief Reset parser to header search state
+ *
+ * @param p  Parser instance
+ */
+void sds018_parser_reset(sds018_parser_t *p);
+
+/**
+ * @brief Feed one received byte into the frame parser
+ *
+ * @param p  Parser instance
+ * @param b  Received byte
+ *
+ * @return SDS018_PARSE_BUSY, SDS018_PARSE_FRAME,
+ *         SDS018_PARSE_BAD_CHECKSUM, SDS018_PARSE_RESYNC or SDS018_PARSE_REPLY
+ */
+uint8_t sds018_parse_byte(sds018_parser_t *p, uint8_t b);
+
+/**
+ * @brief Encode one command frame
+ *
+ * @param frame  Output buffer for SDS018_CMD_LEN bytes
+ * @param cmd    Command ID, SDS018_CMD_xxx
+ * @param set    1 = set new value, 0 = query current value
+ * @param value  New value (mode, sleep/work or period)
+ *
+ * Frame is sent to all sensors (device ID 0xFFFF).
+ */
+void sds018_encode_cmd(uint8_t *frame, uint8_t cmd, uint8_t set, uint8_t value);
+
+/**
+ * @brief Select active reporting (0) or query mode (1)
+ *
+ * @return 0 — command queued, 1 — TX buffer full
+ */
+uint8_t sds018_set_report_mode(uint8_t dev, uint8_t query);
+
+/**
+ * @brief Request one data frame, used in query mode
+ *
+ * The answer is received as normal data frame, read it by sds018_read().
+ *
+ * @return 0 — command queued, 1 — TX buffer full
+ */
+uint8_t sds018_query(uint8_t dev);
+
+/**
+ * @brief Put sensor to sleep (1) or wake it up (0)
+ *
+ * @return 0 — command queued, 1 — TX buffer full
+ */
+uint8_t sds018_set_sleep(uint8_t dev, uint8_t sleep);
+
+/**
+ * @brief Set working period of the sensor firmware
+ *
+ * @param minutes 0 = continuous, 1-30 = one measurement every n minutes
+ *
+ * @return 0 — command queued, 1 — TX buffer full
+ */
+uint8_t sds018_set_working_period(uint8_t dev, uint8_t minutes);
+
+/**
+ * @brief Start duty cycled sampling
+ *
+ * @param dev     Instance
+ * @param policy  Sampling policy, must stay valid while sampler runs
+ * @param now_ms  Current time in ms
+ *
+ * Switches the sensor to active reporting with continuous working
+ * period (timing is controlled by the sampler) and wakes it up.
+ */
+void sds018_sampler_start(uint8_t dev, const sds018_policy_t *policy, uint32_t now_ms);
+
+/**
+ * @brief Run sampling policy, must be called periodically from main loop
+ *
+ * @param dev      Instance
+ * @param now_ms   Current time in ms
+ * @param pm25_10  Pointer where averaged PM2.5*10 will be stored
+ * @param pm10_10  Pointer where averaged PM10*10 will be stored
+ *
+ * @return 0 — new averaged value is available, 1 — no new value
+ *
+ * Frames are counted in background by the RX interrupt, so the function
+ * does not need to be called once per frame. Do not mix with sds018_read().
+ */
+uint8_t sds018_sampler_update(uint8_t dev, uint32_t now_ms, uint16_t *pm25_10, uint16_t *pm10_10);
+
+/**
+ * @brief Current state of the sampler, SDS018_STATE_xxx
+ */
+uint8_t sds018_sampler_state(uint8_t dev);
+
+/**
+ * @brief Current sleep interval in ms, shorter than policy interval while PM is climbing
  */
-uint8_t sds018_read(uint16_t *pm25_10, uint16_t *pm10_10);
+uint32_t sds018_sampler_interval(uint8_t dev);
 
 #endif
@@ -0,0 +1,157 @@
+#include "adc.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#if ADC_NOISE_REDUCTION
+# include <avr/sleep.h>
+#endif
+
+#define ADC_SAMPLES (1U << (2 * ADC_OVERSAMPLE_BITS)) // 4^n conversions per result
+
+#if ADC_OVERSAMPLE_BITS > 3
+# error "ADC_OVERSAMPLE_BITS > 3 does not fit 16-bit accumulator"
+#endif
+
+static uint8_t channels[ADC_MAX_CHANNELS]; // scan list
+static volatile uint8_t channel_count;
+
+// published results, written only by ISR
+static volatile uint16_t results[ADC_MAX_CHANNELS];
+static volatile uint8_t  seqs[ADC_MAX_CHANNELS];
+
+// scan state, used only by ISR after start
+static uint8_t  slot;        // slot being converted
+static uint8_t  sample;      // conversions of current slot, 0 = discarded one after mux change
+static uint16_t acc;         // sum of conversions of current slot, 64 * 1023 at most
+#if ADC_NOISE_REDUCTION
+static volatile uint8_t published; // results published by ISR, adc_service() waits for a full scan
+#endif
+
+static uint8_t initialized;
+
+// start conversion on current slot, in noise reduction mode conversion starts by sleep
+static void adc_start_conversion(void)
+{
+#if !ADC_NOISE_REDUCTION
+    ADCSRA |= (1 << ADSC);
+#endif
+}
+
+static void adc_select(uint8_t s)
+{
+    slot = s;
+    acc = 0;
+    // input settles only after a real mux change, a single channel keeps every conversion
+    sample = ((ADMUX & 0x0F) == channels[s]) ? 1 : 0;
+    ADMUX = (ADMUX & 0xF0) | channels[s]; // select ADC channel, reference bits are kept
+}
+
+void adc_init(void)
+{
+    if (initialized)
+        return;
+    initialized = 1;
+
+    channel_count = 0;
+
+    ADMUX = (1 << REFS0);//use AVcc (5V) as ADC reference voltage
+
+    ADCSRA = (1 << ADEN) | (1 << ADIE) |
+             (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0); //enable ADC with interrupt and set prescaler to 128 for stable readings(16MHz/128=125kHz)
+}
+
+uint8_t adc_add_channel(uint8_t channel)
+{
+    uint8_t s = channel_count;
+
+    if (s >= ADC_MAX_CHANNELS)
+        return ADC_NO_SLOT;
+
+    channels[s] = channel & 0x07;
+    DIDR0 |= (1 << (channel & 0x07)); // digital input buffer is not needed on analog pin
+
+    channel_count = s + 1; // ISR sees new channel from now
+
+    if (s == 0) // first channel, start scanning
+    {
+        adc_select(0);
+        sample = 0; // first conversion after reference setup is discarded too
+        adc_start_conversion();
+    }
+    return s;
+}
+
+ISR(ADC_vect)
+{
+    uint16_t value = ADC;
+
+    if (sample++ != 0) // first conversion after mux change is discarded
+        acc += value;
+
+    if (sample <= ADC_SAMPLES)
+    {
+        adc_start_conversion();
+        return;
+    }
+
+    // decimation, 4^n samples shifted by n gives 10+n bits
+    results[slot] = acc >> ADC_OVERSAMPLE_BITS;
+    seqs[slot]++;
+#if ADC_NOISE_REDUCTION
+    published++;
+#endif
+
+    uint8_t next = slot + 1;
+    if (next >= channel_count)
+        next = 0;
+    adc_select(next);
+    adc_start_conversion();
+}
+
+uint16_t adc_get(uint8_t s)
+{
+    uint8_t seq;
+    uint16_t value;
+
+    if (s >= ADC_MAX_CHANNELS)
+        return 0;
+
+    // 16-bit read is not atomic, repeat when ISR published meanwhile
+    do {
+        seq = seqs[s];
+        value = results[s];
+    } while (seq != seqs[s]);
+
+    return value;
+}
+
+uint8_t adc_get_seq(uint8_t s)
+{
+    if (s >= ADC_MAX_CHANNELS)
+        return 0;
+    return seqs[s];
+}
+
+void adc_service(void)
+{
+#if ADC_NOISE_REDUCTION
+    uint8_t n = channel_count;
+
+    if (n == 0)
+        return;
+
+    set_sleep_mode(SLEEP_MODE_ADC);
+    uint8_t start = published;
+    while ((uint8_t)(published - start) < n)
+    {
+        // other interrupts wake the CPU too, the conversion goes on meanwhile
+        // and a new one may be started by sleep only after it completed
+        if (ADCSRA & (1 << ADSC))
+            continue;
+        // entering sleep starts conversion, ADC interrupt wakes the CPU
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+
+#define ADC_MAX_CHANNELS    4 // max number of channels in scan list
+#define ADC_OVERSAMPLE_BITS 2 // 4^n conversions per result give n extra bits, 2 = 16 conversions, 12-bit result
+#ifndef ADC_NOISE_REDUCTION
+# define ADC_NOISE_REDUCTION 0 // 1 = conversions run only inside adc_service() in ADC Noise Reduction sleep
+#endif
+
+#define ADC_RESULT_BITS (10 + ADC_OVERSAMPLE_BITS)
+#define ADC_RESULT_MAX  ((1U << ADC_RESULT_BITS) - 1)
+#define ADC_NO_SLOT     0xFF
+
+/**
+ * @brief Initialize ADC for interrupt driven scanning
+ *
+ * AVcc reference, prescaler 128 (125 kHz ADC clock, 104 us per conversion),
+ * ADC complete interrupt enabled. Can be called more times, scan list is
+ * cleared only by the first call.
+ */
+void adc_init(void);
+
+/**
+ * @brief Add channel to scan list
+ *
+ * @param channel ADC input 0-7
+ *
+ * @return slot index used by adc_get(), ADC_NO_SLOT if the list is full
+ *
+ * Scanning starts automatically with the first channel. Channels are
+ * scanned round-robin, 1 discarded conversion after mux change and
+ * 4^ADC_OVERSAMPLE_BITS accumulated conversions per channel. One result
+ * per channel takes (4^n + 1) * 104 us, 1.8 ms for n = 2. With a single
+ * channel the mux never changes and a result takes 4^n * 104 us.
+ */
+uint8_t adc_add_channel(uint8_t channel);
+
+/**
+ * @brief Get latest decimated result of one slot
+ *
+ * @param slot  Value returned by adc_add_channel()
+ *
+ * @return Sum of 4^n conversions shifted right by n, 0..ADC_RESULT_MAX,
+ *         0 until first result is ready
+ *
+ * O(1) and lock-free: the result is read between two reads of the slot
+ * sequence counter and read again only if the ISR published meanwhile.
+ */
+uint16_t adc_get(uint8_t slot);
+
+/**
+ * @brief Number of results published for one slot, wraps at 256
+ *
+ * Can be used to check whether adc_get() returns a new value.
+ */
+uint8_t adc_get_seq(uint8_t slot);
+
+/**
+ * @brief Run one full scan in ADC Noise Reduction sleep
+ *
+ * Only with ADC_NOISE_REDUCTION = 1. Every conversion is started by
+ * entering sleep, so the CPU and I/O clocks are stopped while it runs.
+ * Returns when one new result of each channel was published, wake-ups
+ * by other interrupts do not shorten the scan.
+ * Timer0 (system tick) and the UART receiver are stopped too, call it
+ * only when the loss of (4^n + 1) * 104 us per channel is acceptable.
+ * Does nothing when ADC_NOISE_REDUCTION = 0.
+ */
+void adc_service(void);
+
+#endif
@@ -0,0 +1,56 @@
+#include "anim.h"
+#include "tick.h"
+
+void anim_start(anim_t *a, const anim_frame_t *timeline, uint8_t count, uint32_t now_ms)
+{
+    a->timeline = timeline;
+    a->count = count;
+    a->pos = 0;
+    a->due_ms = now_ms;
+}
+
+uint16_t anim_update(anim_t *a, uint32_t now_ms)
+{
+    if (a->count == 0)
+        return ANIM_DONE;
+
+    int32_t wait = (int32_t)(a->due_ms - now_ms);
+
+    if (wait > 0)
+        return (uint16_t)wait; // frame durations are 16-bit, so the wait is too
+
+    if (a->pos >= a->count)
+    {
+        a->count = 0; // last frame was shown for its full duration
+        return ANIM_DONE;
+    }
+
+    const anim_frame_t *f = &a->timeline[a->pos++];
+    anim_draw_fn_t draw = (anim_draw_fn_t)pgm_read_ptr(&f->draw);
+    uint16_t duration = pgm_read_word(&f->duration_ms);
+
+    uint32_t start = tick_us();
+    draw(pgm_read_byte(&f->frame));
+    a->stats.last_us = tick_us() - start;
+    if (a->stats.last_us > a->stats.max_us)
+        a->stats.max_us = a->stats.last_us;
+    if (a->stats.frames != 0xFFFF)
+        a->stats.frames++;
+
+    // next frame keeps the timeline unless this one was drawn a whole frame late
+    a->due_ms += duration;
+    if ((int32_t)(a->due_ms - now_ms) <= 0)
+        a->due_ms = now_ms + duration;
+
+    return (uint16_t)(a->due_ms - now_ms);
+}
+
+void anim_stop(anim_t *a)
+{
+    a->count = 0;
+}
+
+uint8_t anim_running(const anim_t *a)
+{
+    return a->count != 0;
+}
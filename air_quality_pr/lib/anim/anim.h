@@ -0,0 +1,81 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#define ANIM_DONE 0xFFFF // returned by anim_update() when the timeline has finished
+
+/**
+ * @brief Draw function of a frame, gets the frame number from the timeline
+ */
+typedef void (*anim_draw_fn_t)(uint8_t frame);
+
+/**
+ * @brief One timeline entry, tables are stored in PROGMEM
+ */
+typedef struct {
+    uint8_t frame;        // frame number passed to draw
+    uint16_t duration_ms; // time until next entry is drawn
+    anim_draw_fn_t draw;
+} anim_frame_t;
+
+/**
+ * @brief Render cost of the frames
+ */
+typedef struct {
+    uint16_t frames;  // frames drawn, saturated
+    uint32_t last_us; // draw time of last frame in us, a page-streamed frame takes ~100 ms
+    uint32_t max_us;  // longest draw time in us
+} anim_stats_t;
+
+/**
+ * @brief Animation state, 18 bytes
+ */
+typedef struct {
+    const anim_frame_t *timeline; // PROGMEM table
+    uint8_t count;                // entries in timeline
+    uint8_t pos;                  // next entry to draw
+    uint32_t due_ms;              // time the next entry is due
+    anim_stats_t stats;
+} anim_t;
+
+/**
+ * @brief Start a timeline, first frame is due immediately
+ *
+ * @param a         Animation state
+ * @param timeline  Frame table in PROGMEM
+ * @param count     Number of entries
+ * @param now_ms    Current time in ms
+ *
+ * Statistics are kept over restarts.
+ */
+void anim_start(anim_t *a, const anim_frame_t *timeline, uint8_t count, uint32_t now_ms);
+
+/**
+ * @brief Draw the next frame if it is due, never waits
+ *
+ * @param a       Animation state
+ * @param now_ms  Current time in ms
+ *
+ * @return Time in ms until the next call has something to do,
+ *         ANIM_DONE when the last frame has been shown for its duration
+ *
+ * At most one frame is drawn per call. A late frame shifts the rest of
+ * the timeline instead of drawing several frames at once.
+ */
+uint16_t anim_update(anim_t *a, uint32_t now_ms);
+
+/**
+ * @brief Stop the animation, last drawn frame stays on the display
+ */
+void anim_stop(anim_t *a);
+
+/**
+ * @brief Check if a timeline is in progress
+ *
+ * @return 1 if running, 0 if finished or stopped
+ */
+uint8_t anim_running(const anim_t *a);
+
+#endif
@@ -0,0 +1,54 @@
+#include "anomaly.h"
+
+void anomaly_init(anomaly_t *d)
+{
+    d->mean = 0;
+    d->mad = 0;
+    d->count = 0;
+    d->active = 0;
+}
+
+uint8_t anomaly_update(anomaly_t *d, const anomaly_cfg_t *cfg, int16_t x)
+{
+    int32_t xq = (int32_t)x << ANOMALY_FRAC;
+
+    if (d->count == 0) // first sample starts the mean
+    {
+        d->mean = xq;
+        d->mad = 0;
+        d->count = 1;
+        return ANOMALY_NONE;
+    }
+
+    int32_t dev = xq - d->mean;
+    int32_t adev = dev < 0 ? -dev : dev;
+
+    // spread starts at 0 and needs about one time constant of the EWMA to settle
+    uint8_t warm = d->count >= ANOMALY_WARMUP && (d->count >> cfg->shift) != 0;
+
+    uint8_t anomalous = warm &&
+                        dev > d->mad * cfg->z &&
+                        dev > ((int32_t)cfg->min_delta << ANOMALY_FRAC);
+
+    // deviation used for learning is limited, so one spike does not blow up the spread
+    int32_t limit = (d->mad << 2) + ((int32_t)cfg->min_delta << ANOMALY_FRAC);
+    if (warm && adev > limit)
+        adev = limit;
+
+    d->mean += dev >> cfg->shift;
+    d->mad  += (adev - d->mad) >> cfg->shift;
+
+    if (d->count < 0xFF)
+        d->count++;
+
+    if (!anomalous)
+    {
+        d->active = 0;
+        return ANOMALY_NONE;
+    }
+    if (d->active)
+        return ANOMALY_ACTIVE;
+
+    d->active = 1;
+    return ANOMALY_START;
+}
@@ -0,0 +1,56 @@
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+
+//results of anomaly_update()
+#define ANOMALY_NONE   0 // sample is in normal range
+#define ANOMALY_START  1 // first anomalous sample, new event
+#define ANOMALY_ACTIVE 2 // event continues
+
+#define ANOMALY_FRAC   4 // mean and deviation are stored in Q4
+#define ANOMALY_WARMUP 8 // samples needed before events are reported, and at least 2^shift
+
+/**
+ * @brief Detector configuration
+ */
+typedef struct {
+    uint8_t shift;     // EWMA alpha = 1/2^shift for mean and deviation, 7 at most
+    uint8_t z;         // event when sample > mean + z * mean absolute deviation
+    int16_t min_delta; // and sample > mean + min_delta, ignores events in very stable signal
+} anomaly_cfg_t;
+
+/**
+ * @brief Detector state, 10 bytes
+ *
+ * EWMA of the signal and EWMA of absolute deviation from it
+ * (robust and cheaper replacement of variance, no squares needed).
+ * Only rising spikes are reported, like smoke or gas leak.
+ */
+typedef struct {
+    int32_t mean;   // Q4
+    int32_t mad;    // mean absolute deviation, Q4
+    uint8_t count;  // samples seen, saturates at 255
+    uint8_t active; // event in progress
+} anomaly_t;
+
+/**
+ * @brief Reset detector
+ */
+void anomaly_init(anomaly_t *d);
+
+/**
+ * @brief Put one sample into detector
+ *
+ * @param d    Detector state
+ * @param cfg  Configuration
+ * @param x    New sample
+ *
+ * @return ANOMALY_NONE, ANOMALY_START or ANOMALY_ACTIVE
+ *
+ * Constant cost: a few 32-bit additions and shifts and one
+ * 32x8 multiply, no division.
+ */
+uint8_t anomaly_update(anomaly_t *d, const anomaly_cfg_t *cfg, int16_t x);
+
+#endif
@@ -0,0 +1,107 @@
+#include "aqi.h"
+
+// PM2.5 in 0.1 ug/m3, EPA 2024 revision
+static const aqi_bp_t bp_pm25[] PROGMEM = {
+    {    0,   90,   0,  50 },
+    {   91,  354,  51, 100 },
+    {  355,  554, 101, 150 },
+    {  555, 1254, 151, 200 },
+    { 1255, 2254, 201, 300 },
+    { 2255, 3254, 301, 500 },
+};
+
+// PM10 in ug/m3
+static const aqi_bp_t bp_pm10[] PROGMEM = {
+    {   0,  54,   0,  50 },
+    {  55, 154,  51, 100 },
+    { 155, 254, 101, 150 },
+    { 255, 354, 151, 200 },
+    { 355, 424, 201, 300 },
+    { 425, 604, 301, 500 },
+};
+
+// CO2 equivalent in ppm
+static const aqi_bp_t bp_gas[] PROGMEM = {
+    {    0,   800,   0,  50 },
+    {  801,  1000,  51, 100 },
+    { 1001,  1500, 101, 150 },
+    { 1501,  2000, 151, 200 },
+    { 2001,  5000, 201, 300 },
+    { 5001, 10000, 301, 500 },
+};
+
+#define BP_COUNT(t) ((uint8_t)(sizeof(t) / sizeof(t[0])))
+
+// upper index limit of each category
+static const uint16_t cat_top[] PROGMEM = { 50, 100, 150, 200, 300 };
+
+// labels of categories, fixed width rows so no pointer table is needed.
+// EPA names, "USG" is the EPA short form of unhealthy for sensitive groups
+static const char labels[][12] PROGMEM = {
+    "GOOD", "MODERATE", "USG", "UNHEALTHY", "V.UNHEALTHY", "HAZARDOUS"
+};
+
+uint16_t aqi_sub_index(const aqi_bp_t *table, uint8_t n, uint16_t c)
+{
+    for (uint8_t i = 0; i < n; i++)
+    {
+        uint16_t c_hi = pgm_read_word(&table[i].c_hi);
+
+        if (c > c_hi)
+            continue;
+
+        uint16_t c_lo = pgm_read_word(&table[i].c_lo);
+        uint16_t i_lo = pgm_read_word(&table[i].i_lo);
+        uint16_t i_hi = pgm_read_word(&table[i].i_hi);
+        uint16_t span = c_hi - c_lo;
+
+        if (c < c_lo) // only possible with gaps in table, take lower end
+            return i_lo;
+
+        // I = (Ihi - Ilo) / (Chi - Clo) * (C - Clo) + Ilo, rounded
+        return i_lo + (uint16_t)(((uint32_t)(i_hi - i_lo) * (c - c_lo) + span / 2) / span);
+    }
+    return AQI_MAX;
+}
+
+uint16_t aqi_pm25(uint16_t pm25_10)
+{
+    return aqi_sub_index(bp_pm25, BP_COUNT(bp_pm25), pm25_10);
+}
+
+uint16_t aqi_pm10(uint16_t pm10_10)
+{
+    return aqi_sub_index(bp_pm10, BP_COUNT(bp_pm10), pm10_10 / 10);
+}
+
+uint16_t aqi_gas(uint16_t ppm)
+{
+    return aqi_sub_index(bp_gas, BP_COUNT(bp_gas), ppm);
+}
+
+uint8_t aqi_category(uint16_t index)
+{
+    uint8_t cat = 0;
+
+    while (cat < BP_COUNT(cat_top) && index > pgm_read_word(&cat_top[cat]))
+        cat++;
+    return cat;
+}
+
+PGM_P aqi_label_P(uint8_t category)
+{
+    if (category > AQI_HAZARDOUS)
+        category = AQI_HAZARDOUS;
+    return labels[category];
+}
+
+uint16_t aqi_overall(uint16_t pm25_10, uint16_t pm10_10, uint16_t ppm)
+{
+    uint16_t index = aqi_pm25(pm25_10);
+    uint16_t sub = aqi_pm10(pm10_10);
+
+    if (sub > index) index = sub;
+    sub = aqi_gas(ppm);
+    if (sub > index) index = sub;
+    return index;
+}
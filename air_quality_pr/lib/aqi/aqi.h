@@ -0,0 +1,94 @@
+#ifndef AQI_H
+#define AQI_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+//index categories, same bins and names as US EPA AQI
+#define AQI_GOOD           0 // 0-50
+#define AQI_MODERATE       1 // 51-100
+#define AQI_USG            2 // 101-150, unhealthy for sensitive groups
+#define AQI_UNHEALTHY      3 // 151-200
+#define AQI_VERY_UNHEALTHY 4 // 201-300
+#define AQI_HAZARDOUS      5 // 301-500
+
+#define AQI_MAX 500 // index is clamped here
+#define AQI_OVERALL_CYCLES 3000 // budget of one aqi_overall() call, 190 us at 16 MHz
+
+/**
+ * @brief One segment of a breakpoint table
+ *
+ * Concentrations from c_lo to c_hi map linearly to index i_lo..i_hi.
+ */
+typedef struct {
+    uint16_t c_lo;
+    uint16_t c_hi;
+    uint16_t i_lo;
+    uint16_t i_hi;
+} aqi_bp_t;
+
+/**
+ * @brief Sub-index from breakpoint table
+ *
+ * @param table  Ascending segments in PROGMEM
+ * @param n      Number of segments
+ * @param c      Concentration in table units
+ *
+ * @return Index rounded to nearest integer, AQI_MAX above the last segment
+ *
+ * Linear scan of at most n segments and one 32 bit division.
+ */
+uint16_t aqi_sub_index(const aqi_bp_t *table, uint8_t n, uint16_t c);
+
+/**
+ * @brief PM2.5 sub-index, EPA 2024 breakpoints
+ *
+ * @param pm25_10  PM2.5 multiplied by 10
+ */
+uint16_t aqi_pm25(uint16_t pm25_10);
+
+/**
+ * @brief PM10 sub-index, EPA breakpoints
+ *
+ * @param pm10_10  PM10 multiplied by 10, truncated to whole ug/m3 like EPA does
+ */
+uint16_t aqi_pm10(uint16_t pm10_10);
+
+/**
+ * @brief Gas sub-index from MQ135 CO2 equivalent
+ *
+ * @param ppm  Value from mq135_get_ppm()
+ *
+ * Indoor CO2 bands: up to 800 ppm good, 1000 moderate, 1500 unhealthy
+ * for sensitive groups, 2000 unhealthy, 5000 very unhealthy.
+ */
+uint16_t aqi_gas(uint16_t ppm);
+
+/**
+ * @brief Category of an index
+ *
+ * @return AQI_GOOD .. AQI_HAZARDOUS
+ */
+uint8_t aqi_category(uint16_t index);
+
+/**
+ * @brief Label of a category, at most 11 chars
+ *
+ * @return String in PROGMEM, print with oled_puts_p()
+ */
+PGM_P aqi_label_P(uint8_t category);
+
+/**
+ * @brief Overall index, maximum of PM2.5, PM10 and gas sub-indices
+ *
+ * @param pm25_10  PM2.5 multiplied by 10
+ * @param pm10_10  PM10 multiplied by 10
+ * @param ppm      CO2 equivalent from MQ135
+ *
+ * Integer only: three table scans and three 32 bit divisions. Worst
+ * case stays below AQI_OVERALL_CYCLES, test_aqi measures it on the
+ * board and reports each sub-index.
+ */
+uint16_t aqi_overall(uint16_t pm25_10, uint16_t pm10_10, uint16_t ppm);
+
+#endif
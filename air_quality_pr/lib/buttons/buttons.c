@@ -0,0 +1,104 @@
+#include "buttons.h"
+#include "board.h" // BUTTONS_CFG_TABLE
+#include "tick.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#if DHT11_USE_PCINT1 && defined(BUTTONS_VECT)
+# error "PCINT1 is used by DHT11, move the buttons to another pin change group in board.h"
+#endif
+
+#define BUTTONS_PIN(port) (*(&(port) - 2)) // PINx is two registers below PORTx
+#define BUTTONS_DDR(port) (*(&(port) - 1))
+
+static const uint8_t pins[BUTTONS_COUNT] = BUTTONS_CFG_TABLE;
+static uint8_t pin_mask; // all button pins of the port
+
+static volatile uint8_t raw;      // pressed buttons after the last edge
+static volatile uint8_t pending;  // edge not debounced yet
+static volatile uint16_t edge_ms; // last edge, debounce time runs from here
+static volatile uint16_t first_ms; // first edge after stable state, start of latency
+static uint8_t stable;             // debounced pressed buttons
+static uint8_t waiting;            // press reported, latency not measured yet
+static uint16_t press_ms;          // first edge of reported press
+static buttons_stats_t stats;
+
+void buttons_init(void)
+{
+    pin_mask = 0;
+    for (uint8_t i = 0; i < BUTTONS_COUNT; i++)
+        pin_mask |= 1 << pins[i];
+
+    BUTTONS_DDR(BUTTONS_PORT) &= ~pin_mask; // inputs
+    BUTTONS_PORT |= pin_mask;               // with pull-up, pressed button reads 0
+    BUTTONS_PCMSK |= pin_mask;
+    PCICR |= 1 << BUTTONS_PCIE;
+}
+
+void buttons_edge(uint8_t pressed, uint16_t now_ms)
+{
+    if (!pending)
+        first_ms = now_ms;
+    raw = pressed;
+    edge_ms = now_ms;
+    pending = 1;
+}
+
+ISR(BUTTONS_VECT)
+{
+    uint8_t port = ~BUTTONS_PIN(BUTTONS_PORT); // sample first, bounce can change it soon
+    uint8_t pressed = 0;
+
+    for (uint8_t i = 0; i < BUTTONS_COUNT; i++)
+    {
+        if (port & (1 << pins[i]))
+            pressed |= 1 << i;
+    }
+    buttons_edge(pressed, (uint16_t)tick_ms());
+}
+
+uint8_t buttons_update(uint32_t now_ms)
+{
+    uint8_t state;
+    uint16_t first;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // ISR writes all of these
+    {
+        // signed, an edge can come after now_ms was read
+        if (!pending || (int16_t)((uint16_t)now_ms - edge_ms) < BUTTONS_DEBOUNCE_MS)
+            return 0;
+        pending = 0;
+        state = raw;
+        first = first_ms;
+    }
+
+    uint8_t pressed = state & ~stable;
+    stable = state;
+
+    if (pressed)
+    {
+        press_ms = first;
+        waiting = 1;
+        if (stats.presses != 0xFFFF)
+            stats.presses++;
+    }
+    return pressed;
+}
+
+void buttons_handled(uint32_t now_ms)
+{
+    if (!waiting)
+        return;
+    waiting = 0;
+
+    uint16_t latency = (uint16_t)now_ms - press_ms;
+    stats.last_ms = latency;
+    if (latency > stats.max_ms)
+        stats.max_ms = latency;
+}
+
+void buttons_get_stats(buttons_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,59 @@
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include <stdint.h>
+
+#define BUTTONS_DEBOUNCE_MS 20 // contacts must be stable this long, bounce of tact switches is < 10 ms
+
+/**
+ * @brief Input latency statistics
+ */
+typedef struct {
+    uint16_t presses; // debounced presses, saturated
+    uint16_t last_ms; // first edge of last press to buttons_handled()
+    uint16_t max_ms;  // longest latency
+} buttons_stats_t;
+
+/**
+ * @brief Enable pull-ups and pin change interrupt of the buttons in board.h
+ *
+ * Global interrupts must be enabled with sei().
+ */
+void buttons_init(void);
+
+/**
+ * @brief Record an edge, called by the pin change ISR
+ *
+ * @param pressed  Pressed buttons after the edge, bit i = row i of BUTTONS_CFG_TABLE
+ * @param now_ms   Low 16 bits of tick_ms()
+ *
+ * Does not touch any hardware, so presses can be injected from a simulator.
+ */
+void buttons_edge(uint8_t pressed, uint16_t now_ms);
+
+/**
+ * @brief Debounce, call at least every BUTTONS_DEBOUNCE_MS
+ *
+ * @param now_ms  Current time in ms
+ *
+ * @return Buttons pressed since last call, bit i = row i of BUTTONS_CFG_TABLE.
+ *         Constant time, only a few loads when no edge came.
+ */
+uint8_t buttons_update(uint32_t now_ms);
+
+/**
+ * @brief Tell that the reaction to the last press is visible
+ *
+ * @param now_ms  Current time in ms
+ *
+ * Measures latency from the first edge of the press, only the first call
+ * after a press counts.
+ */
+void buttons_handled(uint32_t now_ms);
+
+/**
+ * @brief Copy latency statistics
+ */
+void buttons_get_stats(buttons_stats_t *out);
+
+#endif
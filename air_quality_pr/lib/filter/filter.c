@@ -0,0 +1,122 @@
+#include "filter.h"
+#include <avr/pgmspace.h>
+
+void filter_init(filter_t *f, uint8_t type, uint8_t param)
+{
+    uint8_t max = 8; // EWMA shift limit
+
+    if (type == FILTER_MEDIAN)
+        max = FILTER_MEDIAN_MAX;
+    else if (type == FILTER_AVG)
+        max = FILTER_AVG_MAX;
+
+    if (param < 1)
+        param = 1;
+    if (param > max)
+        param = max;
+
+    f->type = type;
+    f->param = param;
+    f->idx = 0;
+    f->count = 0;
+    if (type == FILTER_AVG)
+        f->s.avg.sum = 0;
+}
+
+// replace oldest sample in sorted window by new one, single pass
+static int16_t filter_median(filter_t *f, int16_t x)
+{
+    int16_t *sorted = f->s.median.sorted;
+    uint8_t n = f->count;
+    uint8_t i;
+
+    if (n == f->param)
+    {
+        // remove oldest sample from sorted window
+        int16_t old = f->s.median.ring[f->idx];
+        for (i = 0; sorted[i] != old; i++);
+        for (; i < n - 1; i++)
+            sorted[i] = sorted[i + 1];
+        n--;
+    }
+
+    // insert new sample
+    for (i = n; i > 0 && sorted[i - 1] > x; i--)
+        sorted[i] = sorted[i - 1];
+    sorted[i] = x;
+    n++;
+
+    f->s.median.ring[f->idx] = x;
+    if (++f->idx >= f->param)
+        f->idx = 0;
+    f->count = n;
+
+    return sorted[n / 2];
+}
+
+static int16_t filter_ewma(filter_t *f, int16_t x)
+{
+    uint8_t k = f->param;
+    int32_t half = 1L << (k - 1);
+
+    if (f->count == 0)
+    {
+        f->s.ewma.acc = (int32_t)x << k;
+        f->count = 1;
+    }
+    else
+    {
+        // acc = acc * (1 - 1/2^k) + x, output is acc / 2^k rounded. Rounding
+        // the feedback too makes output settle at x from above and below.
+        f->s.ewma.acc += x - ((f->s.ewma.acc + half) >> k);
+    }
+    return (int16_t)((f->s.ewma.acc + half) >> k);
+}
+
+static int16_t filter_avg(filter_t *f, int16_t x)
+{
+    if (f->count == f->param)
+        f->s.avg.sum -= f->s.avg.ring[f->idx]; // oldest sample leaves window
+    else
+        f->count++;
+
+    f->s.avg.ring[f->idx] = x;
+    f->s.avg.sum += x;
+    if (++f->idx >= f->param)
+        f->idx = 0;
+
+    return (int16_t)(f->s.avg.sum / f->count);
+}
+
+int16_t filter_apply(filter_t *f, int16_t x)
+{
+    switch (f->type)
+    {
+        case FILTER_MEDIAN:
+            return filter_median(f, x);
+        case FILTER_EWMA:
+            return filter_ewma(f, x);
+        case FILTER_AVG:
+            return filter_avg(f, x);
+        default:
+            return x;
+    }
+}
+
+uint8_t filter_hysteresis(uint8_t *level, int16_t x, const int16_t *thresholds, uint8_t n, int16_t band)
+{
+    uint8_t l = *level;
+
+    if (l > n)
+        l = n;
+
+    // go up while value is clearly above next threshold
+    while (l < n && x >= (int16_t)pgm_read_word(&thresholds[l]) + band)
+        l++;
+    // go down while value is clearly below current threshold
+    while (l > 0 && x < (int16_t)pgm_read_word(&thresholds[l - 1]) - band)
+        l--;
+
+    *level = l;
+    return l;
+}
@@ -0,0 +1,83 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+//filter types
+#define FILTER_NONE   0 // output = input
+#define FILTER_MEDIAN 1 // median of last param samples (1..FILTER_MEDIAN_MAX), removes single spikes
+#define FILTER_EWMA   2 // exponential average, alpha = 1/2^param (param 1..8)
+#define FILTER_AVG    3 // moving average of last param samples (1..FILTER_AVG_MAX)
+
+#define FILTER_MEDIAN_MAX 5
+#define FILTER_AVG_MAX    8
+
+/**
+ * @brief One filter stage in configuration table
+ */
+typedef struct {
+    uint8_t channel; // channel index, defined by application
+    uint8_t type;    // FILTER_xxx
+    uint8_t param;   // window length or EWMA shift
+} filter_cfg_t;
+
+/**
+ * @brief State of one filter stage, 24 bytes for any type
+ *
+ * Per sample cost is O(1) for EWMA and moving average and
+ * O(param) for median (one pass over the sorted window).
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t param;
+    uint8_t idx;   // next position in ring
+    uint8_t count; // samples in window
+    union {
+        struct {
+            int16_t ring[FILTER_MEDIAN_MAX];   // samples in arrival order
+            int16_t sorted[FILTER_MEDIAN_MAX]; // the same samples sorted
+        } median;
+        struct {
+            int32_t acc; // output << param
+        } ewma;
+        struct {
+            int16_t ring[FILTER_AVG_MAX];
+            int32_t sum; // sum of samples in ring
+        } avg;
+    } s;
+} filter_t;
+
+/**
+ * @brief Initialize filter stage
+ *
+ * @param f      Filter state
+ * @param type   FILTER_xxx
+ * @param param  Window length or EWMA shift, clamped to valid range
+ */
+void filter_init(filter_t *f, uint8_t type, uint8_t param);
+
+/**
+ * @brief Put one sample through the filter
+ *
+ * @param f  Filter state
+ * @param x  New sample
+ *
+ * @return Filtered value. First output equals first sample, windows
+ *         are shorter until enough samples arrived.
+ */
+int16_t filter_apply(filter_t *f, int16_t x);
+
+/**
+ * @brief Classify value into levels with hysteresis
+ *
+ * @param level       Current level, updated in place (0..n)
+ * @param x           New value
+ * @param thresholds  n ascending thresholds in PROGMEM, level i starts at thresholds[i-1]
+ * @param n           Number of thresholds
+ * @param band        Hysteresis, value must pass a threshold by band to change the level
+ *
+ * @return New level. One byte of state per classifier.
+ */
+uint8_t filter_hysteresis(uint8_t *level, int16_t x, const int16_t *thresholds, uint8_t n, int16_t band);
+
+#endif
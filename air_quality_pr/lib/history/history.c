@@ -0,0 +1,148 @@
+#include "history.h"
+
+#define EMPTY_MIN INT16_MAX // bucket without samples has min > max
+#define EMPTY_MAX INT16_MIN
+
+typedef struct {
+    int16_t min;
+    int16_t max;
+    int32_t sum;
+    uint16_t count;
+} hist_acc_t; // running bucket
+
+typedef struct {
+    hist_acc_t     cur;                      // running 15 minute bucket
+    history_stat_t l1[HISTORY_L1_BUCKETS];   // closed 15 minute buckets
+    uint8_t        l1_idx;                   // oldest bucket in l1
+    hist_acc_t     l2_acc;                   // running 2 h bucket, sum of 15 minute means
+    history_stat_t l2[HISTORY_L2_BUCKETS];   // closed 2 h buckets
+    uint8_t        l2_idx;                   // oldest bucket in l2
+    history_stat_t win1h;                    // statistics of l1
+    history_stat_t win24h;                   // statistics of l2
+} hist_metric_t;
+
+static hist_metric_t metrics[HISTORY_METRICS];
+static uint32_t bucket_start_ms;
+static uint8_t  l2_merged; // 15 minute buckets merged into running 2 h bucket
+
+static void acc_clear(hist_acc_t *a)
+{
+    a->min = EMPTY_MIN;
+    a->max = EMPTY_MAX;
+    a->sum = 0;
+    a->count = 0;
+}
+
+static void acc_add(hist_acc_t *a, int16_t min, int16_t max, int16_t value)
+{
+    if (min < a->min) a->min = min;
+    if (max > a->max) a->max = max;
+    a->sum += value;
+    a->count++;
+}
+
+// close running bucket into statistics, empty bucket stays empty
+static void acc_close(const hist_acc_t *a, history_stat_t *s)
+{
+    s->min = a->min;
+    s->max = a->max;
+    s->mean = a->count ? (int16_t)(a->sum / (int32_t)a->count) : 0;
+}
+
+static void stat_clear(history_stat_t *s)
+{
+    s->min = EMPTY_MIN;
+    s->max = EMPTY_MAX;
+    s->mean = 0;
+}
+
+// recompute window statistics from ring of buckets, mean of non-empty buckets
+static void window_update(const history_stat_t *ring, uint8_t n, history_stat_t *win)
+{
+    hist_acc_t a;
+
+    acc_clear(&a);
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (ring[i].min <= ring[i].max)
+            acc_add(&a, ring[i].min, ring[i].max, ring[i].mean);
+    }
+    acc_close(&a, win);
+}
+
+void history_init(uint32_t now_ms)
+{
+    for (uint8_t m = 0; m < HISTORY_METRICS; m++)
+    {
+        hist_metric_t *h = &metrics[m];
+
+        acc_clear(&h->cur);
+        acc_clear(&h->l2_acc);
+        for (uint8_t i = 0; i < HISTORY_L1_BUCKETS; i++)
+            stat_clear(&h->l1[i]);
+        for (uint8_t i = 0; i < HISTORY_L2_BUCKETS; i++)
+            stat_clear(&h->l2[i]);
+        stat_clear(&h->win1h);
+        stat_clear(&h->win24h);
+        h->l1_idx = 0;
+        h->l2_idx = 0;
+    }
+    bucket_start_ms = now_ms;
+    l2_merged = 0;
+}
+
+void history_add(uint8_t metric, int16_t value)
+{
+    if (metric >= HISTORY_METRICS)
+        return;
+    acc_add(&metrics[metric].cur, value, value, value);
+}
+
+void history_update(uint32_t now_ms)
+{
+    if (now_ms - bucket_start_ms < HISTORY_BUCKET_MS)
+        return;
+    bucket_start_ms += HISTORY_BUCKET_MS;
+
+    uint8_t close_l2 = ++l2_merged >= HISTORY_L2_MERGE;
+    if (close_l2)
+        l2_merged = 0;
+
+    for (uint8_t m = 0; m < HISTORY_METRICS; m++)
+    {
+        hist_metric_t *h = &metrics[m];
+        history_stat_t *b = &h->l1[h->l1_idx];
+
+        // 15 minute bucket replaces the oldest one in 1 h ring
+        acc_close(&h->cur, b);
+        acc_clear(&h->cur);
+        if (++h->l1_idx >= HISTORY_L1_BUCKETS)
+            h->l1_idx = 0;
+        window_update(h->l1, HISTORY_L1_BUCKETS, &h->win1h);
+
+        if (b->min <= b->max)
+            acc_add(&h->l2_acc, b->min, b->max, b->mean);
+
+        if (close_l2)
+        {
+            // 2 hour bucket replaces the oldest one in 24 h ring
+            acc_close(&h->l2_acc, &h->l2[h->l2_idx]);
+            acc_clear(&h->l2_acc);
+            if (++h->l2_idx >= HISTORY_L2_BUCKETS)
+                h->l2_idx = 0;
+            window_update(h->l2, HISTORY_L2_BUCKETS, &h->win24h);
+        }
+    }
+}
+
+uint8_t history_get(uint8_t metric, uint8_t window, history_stat_t *out)
+{
+    if (metric >= HISTORY_METRICS)
+        return 1;
+
+    const hist_metric_t *h = &metrics[metric];
+
+    // closed buckets only, the running one would stretch the window by up to one bucket
+    *out = (window == HISTORY_24H) ? h->win24h : h->win1h;
+    return out->min > out->max;
+}
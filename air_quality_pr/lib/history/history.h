@@ -0,0 +1,75 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+//metrics kept in history
+#define HIST_PM25       0 // PM2.5*10
+#define HIST_PM10       1 // PM10*10
+#define HISTORY_METRICS 2
+
+//query windows
+#define HISTORY_1H  0 // last four 15 minute buckets
+#define HISTORY_24H 1 // last twelve 2 hour buckets
+
+#define HISTORY_BUCKET_MS (15UL * 60UL * 1000UL) // 15 minutes
+#define HISTORY_L1_BUCKETS 4  // 15 minute buckets for 1 h window
+#define HISTORY_L2_MERGE   8  // 15 minute buckets merged into one 2 h bucket
+#define HISTORY_L2_BUCKETS 12 // 2 h buckets for 24 h window
+
+/**
+ * @brief Statistics of one metric over a window
+ */
+typedef struct {
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} history_stat_t;
+
+/**
+ * @brief Clear history
+ *
+ * @param now_ms  Current time in ms, start of the first bucket
+ *
+ * SRAM: 130 bytes per metric, 260 bytes for HISTORY_METRICS = 2.
+ */
+void history_init(uint32_t now_ms);
+
+/**
+ * @brief Add one sample of a metric to the running 15 minute bucket
+ *
+ * @param metric  HIST_xxx
+ * @param value   New sample
+ *
+ * O(1): updates running min, max and sum.
+ */
+void history_add(uint8_t metric, int16_t value);
+
+/**
+ * @brief Close buckets when their time is over, call from main loop
+ *
+ * @param now_ms  Current time in ms
+ *
+ * Every 15 minutes the running bucket is moved to the 1 h ring and
+ * merged into the running 2 h bucket, every 2 hours that one is moved
+ * to the 24 h ring. Window statistics are recomputed only at those
+ * moments (4 or 12 buckets), so queries never scan.
+ */
+void history_update(uint32_t now_ms);
+
+/**
+ * @brief Get min/max/mean of a metric over a window
+ *
+ * @param metric  HIST_xxx
+ * @param window  HISTORY_1H or HISTORY_24H
+ * @param out     Statistics, mean is mean of bucket means
+ *
+ * @return 0 — statistics valid, 1 — no sample in the window yet
+ *
+ * Windows hold closed buckets only: the 1 h window is the hour that ended
+ * at the last 15 minute boundary, the 24 h window ends at the last 2 h
+ * boundary. O(1), can be called from UI every frame.
+ */
+uint8_t history_get(uint8_t metric, uint8_t window, history_stat_t *out);
+
+#endif
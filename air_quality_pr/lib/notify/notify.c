@@ -0,0 +1,53 @@
+#include "notify.h"
+
+typedef struct {
+    uint8_t mask;    // topics of interest
+    uint8_t pending; // changed topics not taken yet
+    notify_stats_t stats;
+} notify_sub_t;
+
+static notify_sub_t subs[NOTIFY_MAX_SUBS];
+static uint8_t sub_count;
+
+uint8_t notify_subscribe(uint8_t mask)
+{
+    if (sub_count >= NOTIFY_MAX_SUBS)
+        return NOTIFY_NO_SUB;
+
+    subs[sub_count].mask = mask;
+    subs[sub_count].pending = mask; // everything is new for a new subscriber
+    return sub_count++;
+}
+
+void notify_publish(uint8_t topics)
+{
+    for (uint8_t i = 0; i < sub_count; i++)
+        subs[i].pending |= topics & subs[i].mask;
+}
+
+uint8_t notify_take(uint8_t id)
+{
+    if (id >= sub_count)
+        return 0;
+
+    notify_sub_t *s = &subs[id];
+    uint8_t topics = s->pending;
+
+    s->pending = 0;
+    if (topics)
+    {
+        if (s->stats.wakeups != 0xFFFF)
+            s->stats.wakeups++;
+    }
+    else if (s->stats.idle != 0xFFFF)
+    {
+        s->stats.idle++;
+    }
+    return topics;
+}
+
+void notify_get_stats(uint8_t id, notify_stats_t *out)
+{
+    if (id < sub_count)
+        *out = subs[id].stats;
+}
@@ -0,0 +1,51 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stdint.h>
+
+#define NOTIFY_MAX_SUBS 2    // 6 bytes of SRAM per subscriber, main.c uses both
+#define NOTIFY_NO_SUB   0xFF // returned by notify_subscribe() when table is full
+
+#define NOTIFY_TOPIC(n) ((uint8_t)(1 << (n))) // topic bit, e.g. NOTIFY_TOPIC(SENSOR_PM25)
+
+/**
+ * @brief Work statistics of one subscriber
+ */
+typedef struct {
+    uint16_t wakeups; // notify_take() calls that returned some topic, i.e. work was done
+    uint16_t idle;    // notify_take() calls without any change, work was skipped
+} notify_stats_t;
+
+/**
+ * @brief Register a subscriber
+ *
+ * @param mask  Topics the subscriber is interested in
+ *
+ * @return Subscriber id, NOTIFY_NO_SUB if table is full
+ */
+uint8_t notify_subscribe(uint8_t mask);
+
+/**
+ * @brief Mark topics as changed for every subscriber interested in them
+ *
+ * @param topics  NOTIFY_TOPIC() bits
+ *
+ * O(subscribers), only sets bits. Call from main code, not from ISR.
+ */
+void notify_publish(uint8_t topics);
+
+/**
+ * @brief Get and clear changed topics of a subscriber
+ *
+ * @param id  Subscriber id
+ *
+ * @return Changed topics since last call, 0 = nothing to do
+ */
+uint8_t notify_take(uint8_t id);
+
+/**
+ * @brief Copy work statistics of a subscriber
+ */
+void notify_get_stats(uint8_t id, notify_stats_t *out);
+
+#endif
@@ -7,10 +7,12 @@
  */
 #ifndef _font_h_
 # define _font_h_
+# include <stdint.h>
 # include <avr/pgmspace.h>
 
 // extern const char ssd1306oled_font[][6] PROGMEM;
-// extern const char special_char[][2] PROGMEM;
+// extern const uint8_t special_char[128] PROGMEM;
+// extern const uint8_t double_nibble[16] PROGMEM;
 
 const char ssd1306oled_font[][6] PROGMEM = {
     {0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // sp
@@ -110,8 +112,7 @@ const char ssd1306oled_font[][6] PROGMEM = {
     {0x00, 0x08, 0x04, 0x08, 0x08, 0x04}, // ~
     /* end of normal char-set */
     /* put your own signs/chars here, edit special_char too */
-    /* be sure that your first special char stand here */
-    {0x00, 0x3A, 0x40, 0x40, 0x20, 0x7A}, // ü, !!! Important: this must be special_char[0] !!!
+    {0x00, 0x3A, 0x40, 0x40, 0x20, 0x7A}, // ü
     {0x00, 0x3D, 0x40, 0x40, 0x40, 0x3D}, // Ü
     {0x00, 0x21, 0x54, 0x54, 0x54, 0x79}, // ä
     {0x00, 0x7D, 0x12, 0x11, 0x12, 0x7D}, // Ä
@@ -124,24 +125,26 @@ const char ssd1306oled_font[][6] PROGMEM = {
     {0x00, 0x5C, 0x62, 0x02, 0x62, 0x5C} // Ω
 };
 
-const char special_char[][2] PROGMEM = {
-    // define position of special char in font
-    // {special char, position in font}
-    // be sure that last element of this
-    // array are {0xff, 0xff} and first element
-    // are {first special char, first element after normal char-set in font}
-    {'ü', 95},  // special_char[0]
-    {'Ü', 96},
-    {'ä', 97},
-    {'Ä', 98},
-    {'ö', 99},
-    {'Ö', 100},
-    {'°', 101},
-    {'ß', 102},
-    {'µ', 103},
-    {'ω', 104},
-    {'Ω', 105},
-    {0xff, 0xff} // end of table special_char
+const uint8_t special_char[128] PROGMEM = {
+    // position of special char in font, indexed by char-0x80
+    // (last byte of its UTF-8 sequence), 0 = no glyph
+    [(uint8_t)'ü'-0x80] = 95,
+    [(uint8_t)'Ü'-0x80] = 96,
+    [(uint8_t)'ä'-0x80] = 97,
+    [(uint8_t)'Ä'-0x80] = 98,
+    [(uint8_t)'ö'-0x80] = 99,
+    [(uint8_t)'Ö'-0x80] = 100,
+    [(uint8_t)'°'-0x80] = 101,
+    [(uint8_t)'ß'-0x80] = 102,
+    [(uint8_t)'µ'-0x80] = 103,
+    [(uint8_t)'ω'-0x80] = 104,
+    [(uint8_t)'Ω'-0x80] = 105,
+};
+
+// low nibble of a glyph column with every bit doubled, for DOUBLESIZE
+const uint8_t double_nibble[16] PROGMEM = {
+    0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+    0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff
 };
 
 #endif
\ No newline at end of file
@@ -40,6 +40,9 @@
  *  at GRAPHICMODE lib needs static SRAM for display:
  *  DISPLAY-WIDTH * DISPLAY-HEIGHT + 2 bytes
  *
+ *  at GRAPHICMODE with PAGEMODE lib needs static SRAM for display:
+ *  DISPLAY-WIDTH (2 * DISPLAY-WIDTH with I2C in interrupt) + DISPLAY-HEIGHT/4 bytes
+ *
  *  at TEXTMODE lib need static SRAM for display:
  *  2 bytes (cursorPosition)
  */
@@ -58,9 +61,119 @@ static struct {
 } cursorPosition;
 
 static uint8_t charMode = NORMALSIZE;
-#if defined GRAPHICMODE
+
+// RAM pointer of the controller, address commands that would not move it are dropped
+static uint8_t ramPage = 0xff; // 0xff = unknown, next write sends its address
+static uint8_t ramCol;
+static uint8_t ramLo;          // column window of last address command
+static uint8_t ramHi;
+static uint8_t busError;       // polled transfer failed, pointer is unknown
+
+#if defined I2C
+# define OLED_XFER_COST 2      // address and control byte of each transfer
+#else
+# define OLED_XFER_COST 0
+#endif
+#if defined GRAPHICMODE && defined PAGEMODE
+# include <stdlib.h>
+# if defined I2C && OLED_TWI_ASYNC
+#  define OLED_PAGE_BUFFERS 2 // next page is drawn while the page before is sent
+# else
+#  define OLED_PAGE_BUFFERS 1
+# endif
+static uint8_t pageBuffer[OLED_PAGE_BUFFERS][DISPLAY_WIDTH];
+static uint8_t *renderBuf = pageBuffer[0]; // buffer of the page drawn now
+static uint8_t renderPage = 0xff;          // page drawn now, 0xff = outside of oled_render()
+static uint32_t pageSum[DISPLAY_HEIGHT/8]; // CRC-32 of each page on the panel
+static uint8_t pageKnown;                  // bit per page: pageSum is valid
+
+// CRC-32 (IEEE) of a page, table of 16 entries for one nibble per step. A 16 bit
+// sum is too weak here: drawn digits like "27" and "72" or "427" and "472" collide
+static const uint32_t crcNibble[16] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+static uint32_t oled_page_sum(const uint8_t *buf) {
+    uint32_t crc = 0xffffffff;
+    for (uint8_t x = 0; x < DISPLAY_WIDTH; x++) {
+        crc ^= buf[x];
+        crc = (crc >> 4) ^ pgm_read_dword(&crcNibble[crc & 0x0f]);
+        crc = (crc >> 4) ^ pgm_read_dword(&crcNibble[crc & 0x0f]);
+    }
+    return crc;
+}
+static uint16_t flushBytes; // bytes on the wire of last oled_render()
+static uint8_t flushXfers;  // transfers of last oled_render()
+
+// write one buffer byte, bytes outside of the page drawn now are clipped
+static void oled_put_byte(uint8_t page, uint8_t x, uint8_t b){
+    if (page == renderPage) renderBuf[x] = b;
+}
+static uint8_t oled_get_byte(uint8_t page, uint8_t x){
+    return (page == renderPage) ? renderBuf[x] : 0;
+}
+// buffer row of a page, 0 = page is clipped
+static uint8_t *oled_row(uint8_t page){
+    return (page == renderPage) ? renderBuf : 0;
+}
+static void oled_row_put(uint8_t *row, uint8_t page, uint8_t x, uint8_t b){
+    row[x] = b;
+}
+// rows y1..y2 cross the page drawn now, other draw calls are skipped early
+static uint8_t oled_page_hit(int16_t y1, int16_t y2){
+    int16_t top = renderPage * 8;
+    if (y1 > y2) {
+        int16_t t = y1;
+        y1 = y2;
+        y2 = t;
+    }
+    return y2 >= top && y1 < top + 8;
+}
+#elif defined GRAPHICMODE
 # include <stdlib.h>
 static uint8_t displayBuffer[DISPLAY_HEIGHT/8][DISPLAY_WIDTH];
+// changed columns of each page since last transfer, clean page has lo > hi
+static uint8_t dirtyLo[DISPLAY_HEIGHT/8];
+static uint8_t dirtyHi[DISPLAY_HEIGHT/8];
+static uint16_t flushBytes; // bytes on the wire of last oled_display()
+static uint8_t flushXfers;  // transfers of last oled_display()
+
+static void oled_set_clean(uint8_t page){
+    dirtyLo[page] = 0xff;
+    dirtyHi[page] = 0;
+}
+static void oled_mark(uint8_t page, uint8_t x){
+    if (x < dirtyLo[page]) dirtyLo[page] = x;
+    if (x > dirtyHi[page]) dirtyHi[page] = x;
+}
+// windows of the running oled_display(), main code may mark new changes meanwhile
+static uint8_t flushLo[DISPLAY_HEIGHT/8];
+static uint8_t flushHi[DISPLAY_HEIGHT/8];
+static uint8_t flushCont; // bit per page: RAM pointer is already there, no address command
+static uint8_t flushPage; // next page to send
+#if defined I2C && OLED_TWI_ASYNC
+static uint8_t flushFrom; // first page of transfer on the wire
+#endif
+// write one buffer byte, column becomes dirty only if the byte changes
+static void oled_put_byte(uint8_t page, uint8_t x, uint8_t b){
+    if (displayBuffer[page][x] != b) {
+        displayBuffer[page][x] = b;
+        oled_mark(page, x);
+    }
+}
+static uint8_t oled_get_byte(uint8_t page, uint8_t x){
+    return displayBuffer[page][x];
+}
+// buffer row of a page, 0 = page is clipped
+static uint8_t *oled_row(uint8_t page){
+    return (page < DISPLAY_HEIGHT/8) ? displayBuffer[page] : 0;
+}
+static void oled_row_put(uint8_t *row, uint8_t page, uint8_t x, uint8_t b){
+    if (row[x] != b) {
+        row[x] = b;
+        oled_mark(page, x);
+    }
+}
 #elif defined TEXTMODE
 #else
 # error "No valid displaymode! Refer oled.h"
@@ -98,16 +211,70 @@ const uint8_t init_sequence [] PROGMEM = {    // Initialization Sequence
     0x8D, 0x14,      // Set DC-DC enable
 };
 // #pragma mark LCD COMMUNICATION
+#if defined I2C && OLED_TWI_ASYNC
+// Transfers run in background in TWI interrupt, only the buffers are waited for
+#define OLED_CMD_MAX 8 // command bytes per transfer, longer sequences are split
+static uint8_t cmdBuf[OLED_CMD_MAX];
+static void oled_cmd_done(twi_xfer_t *x);
+static twi_xfer_t cmdXfer = { OLED_I2C_ADR, 0x00, cmdBuf, 0, TWI_OK, oled_cmd_done };
+static twi_xfer_t dataXfer = { OLED_I2C_ADR, 0x40, 0, 0, TWI_OK, 0 };
+
+// window of display chain was not set, its queued data must not be written elsewhere
+static void oled_cmd_done(twi_xfer_t *x) {
+    if (x->status != TWI_OK) dataXfer.len = 0;
+}
+
+// wait until previous transfers and a running oled_display() are finished
+static void oled_sync(void) {
+    // display chain submits its next page in the interrupt of the previous one,
+    // so both are idle only when the chain has ended
+    while (cmdXfer.status == TWI_BUSY || dataXfer.status == TWI_BUSY) {
+        twi_idle(); // checks TWI_TIMEOUT_MS
+    }
+    if (cmdXfer.status != TWI_OK || dataXfer.status != TWI_OK) {
+        ramPage = 0xff;
+#if defined PAGEMODE
+        pageKnown = 0; // pages are sent again by next oled_render()
+#endif
+    }
+#if defined GRAPHICMODE && !defined PAGEMODE
+    if (dataXfer.done) {
+        // previous flush failed or was aborted by timeout: its unsent pages,
+        // including the ones on the wire, become dirty again
+        for (uint8_t i = flushFrom; i < DISPLAY_HEIGHT/8; i++) {
+            if (flushLo[i] > flushHi[i]) continue;
+            oled_mark(i, flushLo[i]);
+            oled_mark(i, flushHi[i]);
+        }
+        dataXfer.done = 0;
+    }
+#endif
+}
+#endif
 void oled_command(uint8_t cmd[], uint8_t size) {
-#if defined I2C
-    twi_start();
-    twi_write((OLED_I2C_ADR<<1) | TWI_WRITE);
+    ramPage = 0xff; // any command may move the RAM pointer
+#if defined I2C && OLED_TWI_ASYNC
+    for (uint8_t i = 0; i < size; i += OLED_CMD_MAX) {
+        uint8_t n = (size - i < OLED_CMD_MAX) ? size - i : OLED_CMD_MAX;
+        oled_sync();
+        memcpy(cmdBuf, &cmd[i], n);
+        cmdXfer.len = n;
+        twi_submit(&cmdXfer);
+    }
+#elif defined I2C
+    // every wait is bounded by TWI_TIMEOUT_MS, transfer is dropped on first error
+    busError = 1;
+    if (twi_start() != TWI_OK) return;
     // i2c_start((OLED_I2C_ADR << 1) | 0);
-    twi_write(0x00);
     // i2c_byte(0x00);    // 0x00 for command, 0x40 for data
-    for (uint8_t i=0; i<size; i++) {
-        twi_write(cmd[i]);
-        // i2c_byte(cmd[i]);
+    if (twi_write((OLED_I2C_ADR<<1) | TWI_WRITE) == TWI_OK &&
+        twi_write(0x00) == TWI_OK) {
+        uint8_t i;
+        for (i=0; i<size; i++) {
+            if (twi_write(cmd[i]) != TWI_OK) break;
+            // i2c_byte(cmd[i]);
+        }
+        if (i == size) busError = 0;
     }
     twi_stop();
 #elif defined SPI
@@ -121,15 +288,29 @@ void oled_command(uint8_t cmd[], uint8_t size) {
 #endif
 }
 void oled_data(uint8_t data[], uint16_t size) {
-#if defined I2C
-    twi_start();
-    twi_write((OLED_I2C_ADR<<1) | TWI_WRITE);
+#if defined I2C && OLED_TWI_ASYNC
+    // data is sent from its place, display buffer may change while it is sent,
+    // the change is marked dirty and sent by the next oled_display()
+    oled_sync();
+    dataXfer.buf = data;
+    dataXfer.len = size;
+    twi_submit(&dataXfer);
+#if defined TEXTMODE
+    oled_sync(); // data is on the stack of the caller
+#endif
+#elif defined I2C
+    busError = 1;
+    if (twi_start() != TWI_OK) return;
     // i2c_start((OLED_I2C_ADR << 1) | 0);
-    twi_write(0x40);
     // i2c_byte(0x40);    // 0x00 for command, 0x40 for data
-    for (uint16_t i = 0; i<size; i++) {
-        twi_write(data[i]);
-        // i2c_byte(data[i]);
+    if (twi_write((OLED_I2C_ADR<<1) | TWI_WRITE) == TWI_OK &&
+        twi_write(0x40) == TWI_OK) {
+        uint16_t i;
+        for (i = 0; i<size; i++) {
+            if (twi_write(data[i]) != TWI_OK) break;
+            // i2c_byte(data[i]);
+        }
+        if (i == size) busError = 0;
     }
     twi_stop();
     // i2c_stop();
@@ -143,6 +324,64 @@ void oled_data(uint8_t data[], uint16_t size) {
     OLED_PORT |= (1 << CS_PIN);
 #endif
 }
+// commands of the RAM window of columns lo..hi of a page, returns their count
+static uint8_t oled_window(uint8_t cmd[], uint8_t page, uint8_t lo, uint8_t hi) {
+#if defined (SSD1306) || defined (SSD1309)
+    // column window lo..hi, pages up to 7, pointer wraps to column lo of next page
+    cmd[0] = 0x21; cmd[1] = lo; cmd[2] = hi;
+    cmd[3] = 0x22; cmd[4] = page; cmd[5] = DISPLAY_HEIGHT/8-1;
+    return 6;
+#elif defined SH1106
+    (void)hi;
+    cmd[0] = 0xb0+page; cmd[1] = 0x00+((2+lo) & (0x0f)); cmd[2] = 0x10+( ((2+lo) & (0xf0)) >> 4 );
+    return 3;
+#endif
+}
+// pointer after n data bytes, only set when all of them were sent
+static void oled_advance(uint16_t n) {
+    if (ramPage == 0xff) return;
+    if (ramCol + n <= ramHi) {
+        ramCol += n;
+        return;
+    }
+#if defined (SSD1306) || defined (SSD1309)
+    uint8_t w = ramHi - ramLo + 1;
+    uint16_t pos = ramCol - ramLo + n;
+    if (ramPage + pos / w < DISPLAY_HEIGHT/8) {
+        ramPage += pos / w;
+        ramCol = ramLo + pos % w;
+        return;
+    }
+#endif
+    ramPage = 0xff;
+}
+// point RAM at column x of page before data up to column last, nothing is sent if it is there,
+// returns command bytes sent
+static uint8_t oled_address(uint8_t page, uint8_t x, uint8_t last) {
+#if defined I2C && OLED_TWI_ASYNC
+    oled_sync(); // pointer is known only after running transfers
+#endif
+    if (page == ramPage && x == ramCol && last <= ramHi) return 0;
+    uint8_t cmd[6];
+    uint8_t n = oled_window(cmd, page, x, DISPLAY_WIDTH-1);
+    busError = 0;
+    oled_command(cmd, n);
+    if (busError) return n;
+    ramPage = page;
+    ramCol = ramLo = x;
+    ramHi = DISPLAY_WIDTH-1;
+    return n;
+}
+// data at the RAM pointer
+static void oled_ram(uint8_t data[], uint16_t size) {
+    busError = 0;
+    oled_data(data, size);
+    if (busError) {
+        ramPage = 0xff;
+    } else {
+        oled_advance(size);
+    }
+}
 // #pragma mark -
 // #pragma mark GENERAL FUNCTIONS
 void oled_init(uint8_t dispAttr){
@@ -175,26 +414,37 @@ void oled_goto_xpix_y(uint8_t x, uint8_t y){
     if( x > (DISPLAY_WIDTH) || y > (DISPLAY_HEIGHT/8-1)) return;// out of display
     cursorPosition.x=x;
     cursorPosition.y=y;
-#if defined (SSD1306) || defined (SSD1309)
-    uint8_t commandSequence[] = {0xb0+y, 0x21, x, 0x7f};
-#elif defined SH1106
-    uint8_t commandSequence[] = {0xb0+y, 0x21, 0x00+((2+x) & (0x0f)), 0x10+( ((2+x) & (0xf0)) >> 4 ), 0x7f};
-#endif
-    oled_command(commandSequence, sizeof(commandSequence));
+    // no transfer here, the address is sent with the next data that needs it
 }
 void oled_clrscr(void){
-#ifdef GRAPHICMODE
+#if defined GRAPHICMODE && defined PAGEMODE
+    oled_address(0, 0, DISPLAY_WIDTH-1); // waits for page buffers on the wire
+    memset(pageBuffer[0], 0x00, DISPLAY_WIDTH);
+    uint32_t empty = oled_page_sum(pageBuffer[0]);
+    pageKnown = 0;
+    for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
+        // nothing is sent while the pointer wraps here from the page before,
+        // after a failed transfer it is unknown and the page is addressed again
+        oled_address(i, 0, DISPLAY_WIDTH-1);
+        if (busError) continue;
+        oled_ram(pageBuffer[0], DISPLAY_WIDTH);
+        if (busError) continue;
+        pageSum[i] = empty;
+        pageKnown |= 1 << i;
+    }
+#elif defined GRAPHICMODE
+    memset(displayBuffer, 0x00, sizeof(displayBuffer));
+    oled_address(0, 0, DISPLAY_WIDTH-1);
+    oled_ram(displayBuffer[0], sizeof(displayBuffer)); // all pages, pointer wraps
     for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
-        memset(displayBuffer[i], 0x00, sizeof(displayBuffer[i]));
-        oled_gotoxy(0,i);
-        oled_data(displayBuffer[i], sizeof(displayBuffer[i]));
+        oled_set_clean(i); // buffer and display are the same now
     }
 #elif defined TEXTMODE
     uint8_t displayBuffer[DISPLAY_WIDTH];
     memset(displayBuffer, 0x00, sizeof(displayBuffer));
     for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
-        oled_gotoxy(0,i);
-        oled_data(displayBuffer, sizeof(displayBuffer));
+        oled_address(i, 0, DISPLAY_WIDTH-1);
+        oled_ram(displayBuffer, sizeof(displayBuffer));
     }
 #endif
     oled_home();
@@ -224,6 +474,67 @@ void oled_set_contrast(uint8_t contrast){
     uint8_t commandSequence[2] = {0x81, contrast};
     oled_command(commandSequence, sizeof(commandSequence));
 }
+// position of char in font, 0xff = no glyph
+static uint8_t oled_glyph(uint8_t c){
+    if (c < ' ' || c == 0x7f) return 0xff;
+    if (c < 0x80) return c - ' ';
+    c = pgm_read_byte(&special_char[c-0x80]);
+    return c ? c : 0xff;
+}
+#ifdef GRAPHICMODE
+// draw glyph at cursor into row of cursor page and row below (DOUBLESIZE), 0 = clipped
+static void oled_blit(uint8_t *row, uint8_t *below, uint8_t g){
+    const char *glyph = FONT[g];
+    uint8_t x = cursorPosition.x;
+    uint8_t y = cursorPosition.y;
+    if (charMode == DOUBLESIZE) {
+        for (uint8_t i = 0; i < sizeof(FONT[0]); i++, x += 2) {
+            uint8_t b = pgm_read_byte(&glyph[i]);
+            if (row) {
+                uint8_t d = pgm_read_byte(&double_nibble[b & 0x0f]);
+                oled_row_put(row, y, x, d);
+                oled_row_put(row, y, x+1, d);
+            }
+            if (below) {
+                uint8_t d = pgm_read_byte(&double_nibble[b >> 4]);
+                oled_row_put(below, y+1, x, d);
+                oled_row_put(below, y+1, x+1, d);
+            }
+        }
+    } else if (row) {
+        for (uint8_t i = 0; i < sizeof(FONT[0]); i++) {
+            oled_row_put(row, y, x+i, pgm_read_byte(&glyph[i]));
+        }
+    }
+}
+// print string straight into the buffer, rows and bounds are set once per line,
+// chars that don't fit are skipped like at oled_putc()
+static void oled_puts_buf(const char *s, uint8_t flash){
+    uint8_t w = sizeof(FONT[0])*charMode;
+    uint8_t last = DISPLAY_WIDTH-sizeof(FONT[0])-1; // last cursor position a glyph fits at
+    if (last > DISPLAY_WIDTH-w) last = DISPLAY_WIDTH-w;
+    uint8_t page = 0xff;
+    uint8_t *row = 0, *below = 0;
+    uint8_t c;
+    while ((c = flash ? pgm_read_byte(s) : *s)) {
+        s++;
+        if (c < ' ') {
+            oled_putc(c); // control chars move the cursor
+            continue;
+        }
+        if (cursorPosition.x > last) continue;
+        uint8_t g = oled_glyph(c);
+        if (g == 0xff) continue;
+        if (page != cursorPosition.y) {
+            page = cursorPosition.y;
+            row = oled_row(page);
+            below = (charMode == DOUBLESIZE) ? oled_row(page+1) : 0;
+        }
+        if (row || below) oled_blit(row, below, g);
+        cursorPosition.x += w;
+    }
+}
+#endif
 void oled_putc(char c){
     switch (c) {
         case '\b':
@@ -250,113 +561,41 @@ void oled_putc(char c){
             // carrige return
             oled_gotoxy(0, cursorPosition.y);
             break;
-        default:
+        default: {
             // char doesn't fit in line
-            if( (cursorPosition.x >= DISPLAY_WIDTH-sizeof(FONT[0])) || (c < ' ') ) break;
+            if (cursorPosition.x >= DISPLAY_WIDTH-sizeof(FONT[0])) break;
             // mapping char
-            c -= ' ';
-            if (c >= pgm_read_byte(&special_char[0][1]) ) {
-                char temp = c;
-                c = 0xff;
-                for (uint8_t i=0; pgm_read_byte(&special_char[i][1]) != 0xff; i++) {
-                    if ( pgm_read_byte(&special_char[i][0])-' ' == temp ) {
-                        c = pgm_read_byte(&special_char[i][1]);
-                        break;
-                    }
-                }
-                if ( c == 0xff ) break;
-            }
+            uint8_t g = oled_glyph(c);
+            if (g == 0xff) break;
             // print char at display
 #ifdef GRAPHICMODE
-            if (charMode == DOUBLESIZE) {
-                uint16_t doubleChar[sizeof(FONT[0])];
-                uint8_t dChar;
-                if ((cursorPosition.x+2*sizeof(FONT[0]))>DISPLAY_WIDTH) break;
-                
-                for (uint8_t i=0; i < sizeof(FONT[0]); i++) {
-                    doubleChar[i] = 0;
-                    dChar = pgm_read_byte(&(FONT[(uint8_t)c][i]));
-                    for (uint8_t j=0; j<8; j++) {
-                        if ((dChar & (1 << j))) {
-                            doubleChar[i] |= (1 << (j*2));
-                            doubleChar[i] |= (1 << ((j*2)+1));
-                        }
-                    }
-                }
-                for (uint8_t i = 0; i < sizeof(FONT[0]); i++)
-                {
-                    // load bit-pattern from flash
-                    displayBuffer[cursorPosition.y+1][cursorPosition.x+(2*i)] = doubleChar[i] >> 8;
-                    displayBuffer[cursorPosition.y+1][cursorPosition.x+(2*i)+1] = doubleChar[i] >> 8;
-                    displayBuffer[cursorPosition.y][cursorPosition.x+(2*i)] = doubleChar[i] & 0xff;
-                    displayBuffer[cursorPosition.y][cursorPosition.x+(2*i)+1] = doubleChar[i] & 0xff;
-                }
-                cursorPosition.x += sizeof(FONT[0])*2;
-            } else {
-            	if ((cursorPosition.x+sizeof(FONT[0]))>DISPLAY_WIDTH) break;
-            	
-                for (uint8_t i = 0; i < sizeof(FONT[0]); i++)
-                {
-                    // load bit-pattern from flash
-                    displayBuffer[cursorPosition.y][cursorPosition.x+i] =pgm_read_byte(&(FONT[(uint8_t)c][i]));
-                }
-                cursorPosition.x += sizeof(FONT[0]);
-            }
+            if ((cursorPosition.x+sizeof(FONT[0])*charMode)>DISPLAY_WIDTH) break;
+            oled_blit(oled_row(cursorPosition.y),
+                      (charMode == DOUBLESIZE) ? oled_row(cursorPosition.y+1) : 0, g);
+            cursorPosition.x += sizeof(FONT[0])*charMode;
 #elif defined TEXTMODE
             if (charMode == DOUBLESIZE) {
-                uint16_t doubleChar[sizeof(FONT[0])];
-                uint8_t dChar;
+                uint8_t data[sizeof(FONT[0])*2];
                 if ((cursorPosition.x+2*sizeof(FONT[0]))>DISPLAY_WIDTH) break;
                 
-                for (uint8_t i=0; i < sizeof(FONT[0]); i++) {
-                    doubleChar[i] = 0;
-                    dChar = pgm_read_byte(&(FONT[(uint8_t)c][i]));
-                    for (uint8_t j=0; j<8; j++) {
-                        if ((dChar & (1 << j))) {
-                            doubleChar[i] |= (1 << (j*2));
-                            doubleChar[i] |= (1 << ((j*2)+1));
-                        }
-                    }
-                }
-                uint8_t data[sizeof(FONT[0])*2];
                 for (uint8_t i = 0; i < sizeof(FONT[0]); i++)
                 {
                     // print font to ram, print 6 columns
-                    data[i<<1]=(doubleChar[i] & 0xff);
-                    data[(i<<1)+1]=(doubleChar[i] & 0xff);
+                    data[i<<1]=pgm_read_byte(&double_nibble[pgm_read_byte(&FONT[g][i]) & 0x0f]);
+                    data[(i<<1)+1]=data[i<<1];
                 }
-                oled_data(data, sizeof(FONT[0])*2);
-                
-#if defined (SSD1306) || defined (SSD1309)
-                uint8_t commandSequence[] = {0xb0+cursorPosition.y+1,
-                    0x21,
-                    cursorPosition.x,
-                    0x7f};
-#elif defined SH1106
-                uint8_t commandSequence[] = {0xb0+cursorPosition.y+1,
-                    0x21,
-                    0x00+((2+cursorPosition.x) & (0x0f)),
-                    0x10+( ((2+cursorPosition.x) & (0xf0)) >> 4 ),
-                    0x7f};
-#endif
-                oled_command(commandSequence, sizeof(commandSequence));
+                oled_address(cursorPosition.y, cursorPosition.x, cursorPosition.x+sizeof(data)-1);
+                oled_ram(data, sizeof(FONT[0])*2);
                 
                 for (uint8_t i = 0; i < sizeof(FONT[0]); i++)
                 {
                     // print font to ram, print 6 columns
-                    data[i<<1]=(doubleChar[i] >> 8);
-                    data[(i<<1)+1]=(doubleChar[i] >> 8);
+                    data[i<<1]=pgm_read_byte(&double_nibble[pgm_read_byte(&FONT[g][i]) >> 4]);
+                    data[(i<<1)+1]=data[i<<1];
                 }
-                oled_data(data, sizeof(FONT[0])*2);
+                oled_address(cursorPosition.y+1, cursorPosition.x, cursorPosition.x+sizeof(data)-1);
+                oled_ram(data, sizeof(FONT[0])*2);
                 
-                commandSequence[0] = 0xb0+cursorPosition.y;
-#if defined (SSD1306) || defined (SSD1309)
-                commandSequence[2] = cursorPosition.x+(2*sizeof(FONT[0]));
-#elif defined SH1106
-                commandSequence[2] = 0x00+((2+cursorPosition.x+(2*sizeof(FONT[0]))) & (0x0f));
-                commandSequence[3] = 0x10+( ((2+cursorPosition.x+(2*sizeof(FONT[0]))) & (0xf0)) >> 4 );
-#endif
-                oled_command(commandSequence, sizeof(commandSequence));
                 cursorPosition.x += sizeof(FONT[0])*2;
             } else {
                 uint8_t data[sizeof(FONT[0])];
@@ -365,13 +604,15 @@ void oled_putc(char c){
             	for (uint8_t i = 0; i < sizeof(FONT[0]); i++)
                 {
                     // print font to ram, print 6 columns
-                    data[i]=(pgm_read_byte(&(FONT[(uint8_t)c][i])));
+                    data[i]=(pgm_read_byte(&(FONT[g][i])));
                 }
-                oled_data(data, sizeof(FONT[0]));
+                oled_address(cursorPosition.y, cursorPosition.x, cursorPosition.x+sizeof(data)-1);
+                oled_ram(data, sizeof(FONT[0]));
                 cursorPosition.x += sizeof(FONT[0]);
             }
 #endif
             break;
+        }
     }
     
 }
@@ -408,32 +649,88 @@ void oled_flip(uint8_t flipping){
 	}
 }
 void oled_puts(const char* s){
+#ifdef GRAPHICMODE
+    oled_puts_buf(s, 0);
+#else
     while (*s) {
         oled_putc(*s++);
     }
+#endif
 }
 void oled_puts_p(const char* progmem_s){
+#ifdef GRAPHICMODE
+    oled_puts_buf(progmem_s, 1);
+#else
     register uint8_t c;
     while ((c = pgm_read_byte(progmem_s++))) {
         oled_putc(c);
     }
+#endif
 }
 #ifdef GRAPHICMODE
 // #pragma mark -
 // #pragma mark GRAPHIC FUNCTIONS
+// set or clear the mask bits of columns x1..x2 (x1 <= x2) of a page, clipped to the display
+static void oled_span(uint8_t page, uint8_t x1, uint8_t x2, uint8_t mask, uint8_t color){
+    uint8_t *row = oled_row(page);
+    if (!row || x1 > DISPLAY_WIDTH-1) return;
+    if (x2 > DISPLAY_WIDTH-1) x2 = DISPLAY_WIDTH-1;
+    if (color == WHITE) {
+        for (uint8_t x = x1; x <= x2; x++) oled_row_put(row, page, x, row[x] | mask);
+    } else {
+        mask = ~mask;
+        for (uint8_t x = x1; x <= x2; x++) oled_row_put(row, page, x, row[x] & mask);
+    }
+}
+// fill columns x1..x2 (x1 <= x2) of rows y1..y2 (y1 <= y2) as masked page byte runs
+static void oled_fill(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color){
+    if (y1 > DISPLAY_HEIGHT-1) return;
+    if (y2 > DISPLAY_HEIGHT-1) y2 = DISPLAY_HEIGHT-1;
+    uint8_t first = y1 / 8, last = y2 / 8;
+#if defined PAGEMODE
+    if (renderPage < first || renderPage > last) return; // clipped to the page drawn now
+    first = last = renderPage;
+#endif
+    for (uint8_t page = first; page <= last; page++) {
+        uint8_t mask = 0xff;
+        if (page == y1 / 8) mask &= (uint8_t)(0xff << (y1 % 8));
+        if (page == y2 / 8) mask &= (uint8_t)(0xff >> (7 - y2 % 8));
+        oled_span(page, x1, x2, mask, color);
+    }
+}
+// horizontal span x1..x2 (x1 <= x2) of row y, clipped to the display
+static void oled_hspan(int16_t x1, int16_t x2, int16_t y, uint8_t color){
+    if (y < 0 || y > DISPLAY_HEIGHT-1 || x2 < 0 || x1 > DISPLAY_WIDTH-1) return;
+    if (x1 < 0) x1 = 0;
+    if (x2 > DISPLAY_WIDTH-1) x2 = DISPLAY_WIDTH-1;
+    oled_span(y / 8, x1, x2, 1 << (y % 8), color);
+}
 uint8_t oled_drawPixel(uint8_t x, uint8_t y, uint8_t color){
     if( x > DISPLAY_WIDTH-1 || y > (DISPLAY_HEIGHT-1)) return 1; // out of Display
+#if defined PAGEMODE
+    if (y / 8 != renderPage) return 0; // clipped to the page drawn now
+#endif
     
+    uint8_t b = oled_get_byte(y / 8, x);
     if( color == WHITE){
-        displayBuffer[(y / 8)][x] |= (1 << (y % 8));
+        b |= (1 << (y % 8));
     } else {
-        displayBuffer[(y / 8)][x] &= ~(1 << (y % 8));
+        b &= ~(1 << (y % 8));
     }
+    oled_put_byte(y / 8, x, b);
     
     return 0;
 }
 uint8_t oled_drawLine(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color){
 	uint8_t result;
+#if defined PAGEMODE
+    if (!oled_page_hit(y1, y2)) return 0;
+#endif
+    if (x1 == x2 || y1 == y2) {
+        // horizontal and vertical lines are page byte runs
+        oled_fill(x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, x1 < x2 ? x2 : x1, y1 < y2 ? y2 : y1, color);
+        return x2 > DISPLAY_WIDTH-1 || y2 > DISPLAY_HEIGHT-1;
+    }
 	
     int dx =  abs(x2-x1), sx = x1<x2 ? 1 : -1;
     int dy = -abs(y2-y1), sy = y1<y2 ? 1 : -1;
@@ -460,8 +757,6 @@ uint8_t oled_drawRect(uint8_t px1, uint8_t py1, uint8_t px2, uint8_t py2, uint8_
     return result;
 }
 uint8_t oled_fillRect(uint8_t px1, uint8_t py1, uint8_t px2, uint8_t py2, uint8_t color){
-    uint8_t result;
-    
     if( px1 > px2){
         uint8_t temp = px1;
         px1 = px2;
@@ -470,14 +765,15 @@ uint8_t oled_fillRect(uint8_t px1, uint8_t py1, uint8_t px2, uint8_t py2, uint8_
         py1 = py2;
         py2 = temp;
     }
-    for (uint8_t i=0; i<=(py2-py1); i++){
-        result = oled_drawLine(px1, py1+i, px2, py1+i, color);
-    }
+    if (py1 <= py2) oled_fill(px1, py1, px2, py2, color);
     
-    return result;
+    return px2 > DISPLAY_WIDTH-1 || py2 > DISPLAY_HEIGHT-1;
 }
 uint8_t oled_drawCircle(uint8_t center_x, uint8_t center_y, uint8_t radius, uint8_t color){
     uint8_t result;
+#if defined PAGEMODE
+    if (!oled_page_hit((int16_t)center_y - radius, (int16_t)center_y + radius)) return 0;
+#endif
     
     int16_t f = 1 - radius;
     int16_t ddF_x = 1;
@@ -512,15 +808,44 @@ uint8_t oled_drawCircle(uint8_t center_x, uint8_t center_y, uint8_t radius, uint
     return result;
 }
 uint8_t oled_fillCircle(uint8_t center_x, uint8_t center_y, uint8_t radius, uint8_t color) {
-    uint8_t result;
-    for(uint8_t i=0; i<= radius;i++){
-        result = oled_drawCircle(center_x, center_y, i, color);
+#if defined PAGEMODE
+    if (!oled_page_hit((int16_t)center_y - radius, (int16_t)center_y + radius)) return 0;
+#endif
+    
+    int16_t f = 1 - radius;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * radius;
+    int16_t x = 0;
+    int16_t y = radius;
+    
+    // filled as horizontal spans between the points of the outline
+    oled_hspan(center_x - radius, center_x + radius, center_y, color);
+    
+    while (x<y) {
+        if (f >= 0) {
+            // last point of rows +-y
+            oled_hspan(center_x - x, center_x + x, center_y + y, color);
+            oled_hspan(center_x - x, center_x + x, center_y - y, color);
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        
+        oled_hspan(center_x - y, center_x + y, center_y + x, color);
+        oled_hspan(center_x - y, center_x + y, center_y - x, color);
     }
-    return result;
+    return center_x + radius > DISPLAY_WIDTH-1 || center_y + radius > DISPLAY_HEIGHT-1 ||
+           radius > center_x || radius > center_y;
 }
 uint8_t oled_drawBitmap(uint8_t x, uint8_t y, const uint8_t *picture, uint8_t width, uint8_t height, uint8_t color){
     uint8_t result,i,j, byteWidth = (width+7)/8;
     for (j = 0; j < height; j++) {
+#if defined PAGEMODE
+        if (!oled_page_hit(y+j, y+j)) continue;
+#endif
         for(i=0; i < width;i++){
             if(pgm_read_byte(picture + j * byteWidth + i / 8) & (128 >> (i & 7))){
                 result = oled_drawPixel(x+i, y+j, color);
@@ -531,32 +856,215 @@ uint8_t oled_drawBitmap(uint8_t x, uint8_t y, const uint8_t *picture, uint8_t wi
     }
     return result;
 }
+#if defined PAGEMODE
+void oled_render(oled_draw_fn_t draw) {
+    flushBytes = 0;
+    flushXfers = 0;
+#if defined I2C && OLED_TWI_ASYNC
+    uint8_t sent = 0xff; // page buffer handed to the bus last
+    oled_sync(); // errors of the render before are known now
+#endif
+    for (uint8_t p = 0; p < DISPLAY_HEIGHT/8; p++) {
+        uint8_t n = p % OLED_PAGE_BUFFERS;
+#if defined I2C && OLED_TWI_ASYNC
+        if (n == sent) oled_sync(); // buffer is still on the wire
+#endif
+        renderBuf = pageBuffer[n];
+        renderPage = p;
+        memset(renderBuf, 0x00, DISPLAY_WIDTH);
+        draw();
+        uint32_t sum = oled_page_sum(renderBuf);
+        if ((pageKnown & (1 << p)) && pageSum[p] == sum) continue; // panel shows this page already
+
+        uint8_t cmd = oled_address(p, 0, DISPLAY_WIDTH-1);
+        if (cmd) {
+            flushXfers++;
+            flushBytes += OLED_XFER_COST + cmd;
+        }
+        oled_ram(renderBuf, DISPLAY_WIDTH); // returns at once with I2C in interrupt
+        flushXfers++;
+        flushBytes += OLED_XFER_COST + DISPLAY_WIDTH;
+#if defined I2C && OLED_TWI_ASYNC
+        sent = n;
+#endif
+        pageSum[p] = sum;
+        if (busError) {
+            pageKnown &= ~(1 << p);
+        } else {
+            pageKnown |= 1 << p;
+        }
+    }
+    renderPage = 0xff; // draw calls outside of oled_render() change nothing
+}
+uint8_t oled_check_buffer(uint8_t x, uint8_t y) {
+    if( x > DISPLAY_WIDTH-1 || y > (DISPLAY_HEIGHT-1)) return 0; // out of Display
+    return oled_get_byte(y / 8, x) & (1 << (y % 8));
+}
+#else
+void oled_render(oled_draw_fn_t draw) {
+    oled_clear_buffer();
+    draw();
+    oled_display();
+}
+#if defined I2C && OLED_TWI_ASYNC
+static void oled_flush_next(twi_xfer_t *x);
+#endif
+// send (or only count) address and data of next dirty page, returns 0 when all pages are sent
+static uint8_t oled_flush_page(uint8_t send) {
+    uint8_t p = flushPage;
+    while (p < DISPLAY_HEIGHT/8 && flushLo[p] > flushHi[p]) p++;
+    flushPage = p;
+    if (p >= DISPLAY_HEIGHT/8) return 0;
+
+    uint8_t lo = flushLo[p];
+    uint8_t hi = flushHi[p];
+    uint16_t len = hi - lo + 1;
+    // full rows that follow each other are one block of the buffer, one transfer for all
+    while (lo == 0 && hi == DISPLAY_WIDTH-1 && flushPage+1 < DISPLAY_HEIGHT/8 &&
+           (flushCont & (1 << (flushPage+1)))) {
+        flushPage++;
+        len += DISPLAY_WIDTH;
+    }
+    flushPage++;
+    uint8_t address = !(flushCont & (1 << p));
+    uint8_t cmd[6];
+    uint8_t n = oled_window(cmd, p, lo, hi);
+    if (!send) {
+        if (address) {
+            flushXfers++;
+            flushBytes += OLED_XFER_COST + n;
+        }
+        flushXfers++;
+        flushBytes += OLED_XFER_COST + len;
+        return 1;
+    }
+#if defined I2C && OLED_TWI_ASYNC
+    // runs in TWI interrupt for all but the first page, see oled_flush_next()
+    flushFrom = p;
+    if (address) {
+        memcpy(cmdBuf, cmd, n);
+        cmdXfer.len = n;
+        twi_submit(&cmdXfer);
+    }
+    dataXfer.buf = &displayBuffer[p][lo];
+    dataXfer.len = len;
+    dataXfer.done = oled_flush_next;
+    twi_submit(&dataXfer);
+    // errors are found by oled_sync(), it drops the pointer then
+#else
+    busError = 0;
+    if (address) oled_command(cmd, n);
+    if (!busError) oled_data(&displayBuffer[p][lo], len);
+    if (busError) {
+        ramPage = 0xff;
+        return 1;
+    }
+#endif
+    if (address) {
+        ramPage = p;
+        ramCol = ramLo = lo;
+        ramHi = hi;
+    }
+    oled_advance(len);
+    return 1;
+}
+#if defined I2C && OLED_TWI_ASYNC
+// called from TWI interrupt when data of a page is sent, submits the next one
+static void oled_flush_next(twi_xfer_t *x) {
+    // bus error, chain stops with done still set, see oled_sync()
+    if (x && (x->status != TWI_OK || cmdXfer.status != TWI_OK)) return;
+    if (!oled_flush_page(1)) dataXfer.done = 0;
+}
+#endif
 void oled_display() {
+    // only the changed columns of each page are sent, nothing if the buffer did not change
+#if defined I2C && OLED_TWI_ASYNC
+    oled_sync(); // previous flush must end, its windows are reused
+#endif
 #if defined (SSD1306) || defined (SSD1309)
-    oled_gotoxy(0,0);
-    oled_data(&displayBuffer[0][0], DISPLAY_WIDTH*DISPLAY_HEIGHT/8);
-#elif defined SH1106
+    uint8_t lo = 0xff, hi = 0; // window of pages before, lo > hi = none
+    uint8_t first = 0;         // first page of that window
+#endif
+    flushCont = 0;
+    for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
+        flushLo[i] = dirtyLo[i];
+        flushHi[i] = dirtyHi[i];
+        oled_set_clean(i);
+#if defined (SSD1306) || defined (SSD1309)
+        if (flushLo[i] > flushHi[i]) {
+            lo = 0xff;
+            hi = 0;
+            continue;
+        }
+        // pointer wraps from the end of the page above to this page, the page joins
+        // its window if the extra columns sent cost less than an address command
+        if (lo <= hi) {
+            uint8_t nlo = (flushLo[i] < lo) ? flushLo[i] : lo;
+            uint8_t nhi = (flushHi[i] > hi) ? flushHi[i] : hi;
+            uint16_t extra = (uint16_t)(i - first) * ((nhi - nlo) - (hi - lo)) +
+                             (nhi - nlo) - (flushHi[i] - flushLo[i]);
+            if (extra <= OLED_XFER_COST + 6) {
+                for (uint8_t j = first; j <= i; j++) {
+                    flushLo[j] = nlo;
+                    flushHi[j] = nhi;
+                }
+                flushCont |= 1 << i;
+                lo = nlo;
+                hi = nhi;
+                continue;
+            }
+        }
+        first = i;
+        lo = flushLo[i];
+        hi = flushHi[i];
+#endif
+    }
+    // first page needs no address if the pointer was left there before
     for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
-        oled_gotoxy(0,i);
-        oled_data(displayBuffer[i], sizeof(displayBuffer[i]));
+        if (flushLo[i] > flushHi[i]) continue;
+        if (ramPage == i && ramCol == flushLo[i] && ramLo == flushLo[i] && ramHi == flushHi[i]) {
+            flushCont |= 1 << i;
+        }
+        break;
     }
+    flushBytes = 0;
+    flushXfers = 0;
+    flushPage = 0;
+    while (oled_flush_page(0));
+    flushPage = 0;
+#if defined I2C && OLED_TWI_ASYNC
+    oled_flush_next(0); // returns at once, panel is updated in background
+#else
+    while (oled_flush_page(1));
 #endif
 }
 void oled_clear_buffer() {
     for (uint8_t i = 0; i < DISPLAY_HEIGHT/8; i++){
-        memset(displayBuffer[i], 0x00, sizeof(displayBuffer[i]));
+        for (uint8_t x = 0; x < DISPLAY_WIDTH; x++){
+            oled_put_byte(i, x, 0x00);
+        }
     }
 }
 uint8_t oled_check_buffer(uint8_t x, uint8_t y) {
     if( x > DISPLAY_WIDTH-1 || y > (DISPLAY_HEIGHT-1)) return 0; // out of Display
-    return displayBuffer[(y / (DISPLAY_HEIGHT/8))][x] & (1 << (y % (DISPLAY_HEIGHT/8)));
+    return oled_get_byte(y / 8, x) & (1 << (y % 8));
 }
 void oled_display_block(uint8_t x, uint8_t line, uint8_t width) {
     if (line > (DISPLAY_HEIGHT/8-1) || x > DISPLAY_WIDTH - 1){return;}
     if (x + width > DISPLAY_WIDTH) { // no -1 here, x alone is width 1
         width = DISPLAY_WIDTH - x;
     }
-    oled_goto_xpix_y(x,line);
-    oled_data(&displayBuffer[line][x], width);
+    oled_address(line, x, x+width-1);
+    oled_ram(&displayBuffer[line][x], width);
+    if (x <= dirtyLo[line] && x + width > dirtyHi[line]) {
+        oled_set_clean(line); // all changes of the line were sent
+    }
+}
+#endif
+uint16_t oled_flush_bytes(void) {
+    return flushBytes;
+}
+uint8_t oled_flush_xfers(void) {
+    return flushXfers;
 }
 #endif
\ No newline at end of file
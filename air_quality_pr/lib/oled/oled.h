@@ -38,7 +38,8 @@
  *  at ATMega328P like Arduino Uno
  *
  *  at GRAPHICMODE lib needs SRAM for display
- *  DISPLAY-WIDTH * DISPLAY-HEIGHT + 2 bytes
+ *  DISPLAY-WIDTH * DISPLAY-HEIGHT + 2 bytes,
+ *  with PAGEMODE one or two pages of DISPLAY-WIDTH bytes
  */
 
 #ifndef OLED_H
@@ -62,11 +63,18 @@ extern "C" {
     /* TODO: define displaymode */
 #define GRAPHICMODE  // for text and graphic
     // TEXTMODE // for only text to display,
+#ifndef OLED_FRAMEBUFFER
+#define PAGEMODE     // with GRAPHICMODE: no frame buffer, screens are drawn page by page
+    // by oled_render(), build with -DOLED_FRAMEBUFFER for a frame buffer of DISPLAY_WIDTH*DISPLAY_HEIGHT/8 bytes
+#endif
     /* TODO: define font */
 #define FONT  ssd1306oled_font  // Refer font-name at font.h
     
     // using 7-bit-adress for lcd-library
     // if you use your own library for twi check I2C-adress-handle
+#ifndef OLED_TWI_ASYNC
+#define OLED_TWI_ASYNC 1   // 1 = I2C transfers run in TWI interrupt, 0 = polled (blocking), build with -DOLED_TWI_ASYNC=0 to compare
+#endif
 #define OLED_I2C_ADR (0x3c)  // 7 bit slave-adress without r/w-bit
     // e.g. 8 bit slave-adress:
     // 0x78 = adress 0x3C with cleared r/w-bit (write-mode)
@@ -100,7 +108,7 @@ extern "C" {
 #define DISPLAY_WIDTH 128
 #define DISPLAY_HEIGHT 64
 
-// Transmit command or data to display
+// Transmit command or data to display, data is written at the RAM address of the last command
 void oled_command(uint8_t cmd[], uint8_t size);
 void oled_data(uint8_t data[], uint16_t size);
 void oled_init(uint8_t dispAttr);
@@ -118,6 +126,7 @@ void oled_gotoxy(uint8_t x, uint8_t y);  // set curser at pos x, y. x means char
 // y means line (page, refer lcd manual)
 void oled_goto_xpix_y(uint8_t x, uint8_t y); // set curser at pos x, y. x means pixel,
 // y means line (page, refer lcd manual)
+// nothing is sent by goto, the display address follows with the next data that needs it
 void oled_putc(char c);  // print character on screen at TEXTMODE
 // at GRAPHICMODE print character to buffer
 void oled_charMode(uint8_t mode);  // set size of chars
@@ -126,7 +135,16 @@ void oled_flip(uint8_t flipping);  // flip display,
                         // == 1: flip horizontal & vertical
                         // == 2: flip(mirrored) vertical
                         // == 3: flip(mirrored) horizontal
+#if defined PAGEMODE && !defined GRAPHICMODE
+# error "PAGEMODE needs GRAPHICMODE! Refer oled.h"
+#endif
+
 #if defined GRAPHICMODE
+    // Draw routine of a screen, draws the whole screen with the functions below
+    typedef void (*oled_draw_fn_t)(void);
+    // Draw screen and send it to the display. With PAGEMODE draw runs once per page,
+    // clipped to that page, and pages equal to the display content are not sent
+    void oled_render(oled_draw_fn_t draw);
     uint8_t oled_drawPixel(uint8_t x, uint8_t y, uint8_t color);
     uint8_t oled_drawLine(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color);
     uint8_t oled_drawRect(uint8_t px1, uint8_t py1, uint8_t px2, uint8_t py2, uint8_t color);
@@ -134,11 +152,16 @@ void oled_flip(uint8_t flipping);  // flip display,
     uint8_t oled_drawCircle(uint8_t center_x, uint8_t center_y, uint8_t radius, uint8_t color);
     uint8_t oled_fillCircle(uint8_t center_x, uint8_t center_y, uint8_t radius, uint8_t color);
     uint8_t oled_drawBitmap(uint8_t x, uint8_t y, const uint8_t picture[], uint8_t width, uint8_t height, uint8_t color);
-    void oled_display(void);       // copy buffer to display RAM
-    void oled_clear_buffer(void);  // clear display buffer
+    uint16_t oled_flush_bytes(void); // bytes on the wire of last oled_display()/oled_render(), 0 = nothing changed
+    uint8_t oled_flush_xfers(void);  // transfers of last oled_display()/oled_render(), address commands included
     uint8_t oled_check_buffer(uint8_t x, uint8_t y); // read a pixel value from the display buffer
+                                     // (PAGEMODE: only from the page drawn now)
+#if !defined PAGEMODE
+    void oled_display(void);       // copy changed columns of buffer to display RAM
+    void oled_clear_buffer(void);  // clear display buffer
     void oled_display_block(uint8_t x, uint8_t line, uint8_t width); // display (part of) a display line
 #endif
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,55 @@
+#include "power.h"
+#include "tick.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
+
+static power_stats_t stats;
+static uint16_t sleep_us; // sleep time below 1 ms, moved to stats.sleep_ms
+static uint32_t start_ms;
+
+void power_init(uint32_t now_ms)
+{
+    power_spi_disable();
+    power_timer2_disable();
+
+    start_ms = now_ms;
+}
+
+void power_idle(void)
+{
+    uint32_t start = tick_us();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    sleep_enable();
+    sei(); // instruction after sei() always runs, so no interrupt is lost before sleep
+    sleep_cpu();
+    sleep_disable();
+
+    // wake-up ISR has already run here, its time is counted as sleep
+    sleep_us += (uint16_t)(tick_us() - start); // one sleep is at most one tick
+    while (sleep_us >= 1000)
+    {
+        sleep_us -= 1000;
+        stats.sleep_ms++;
+    }
+    stats.wakeups++;
+}
+
+void power_get_stats(power_stats_t *out)
+{
+    *out = stats;
+}
+
+uint8_t power_active_percent(uint32_t now_ms)
+{
+    uint32_t hundredth = (now_ms - start_ms) / 100;
+
+    if (hundredth == 0)
+        return 100;
+
+    uint32_t sleep_pct = stats.sleep_ms / hundredth;
+    return sleep_pct >= 100 ? 0 : 100 - (uint8_t)sleep_pct;
+}
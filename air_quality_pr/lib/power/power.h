@@ -0,0 +1,47 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Time spent in sleep since power_init()
+ */
+typedef struct {
+    uint32_t sleep_ms; // total time in idle sleep
+    uint32_t wakeups;  // number of sleeps, ended by any interrupt
+} power_stats_t;
+
+/**
+ * @brief Switch off clocks of unused peripherals and start statistics
+ *
+ * @param now_ms  Current time in ms
+ *
+ * SPI and Timer/Counter2 are not used by the firmware and get stopped
+ * in PRR. Everything else keeps running.
+ */
+void power_init(uint32_t now_ms);
+
+/**
+ * @brief Sleep until the next interrupt
+ *
+ * Uses SLEEP_MODE_IDLE, so Timer0 tick, USART, TWI, ADC and pin change
+ * interrupts keep working and wake the CPU. The tick wakes it at least
+ * every 1 ms. Call only when there is nothing to do.
+ */
+void power_idle(void);
+
+/**
+ * @brief Copy sleep statistics
+ */
+void power_get_stats(power_stats_t *out);
+
+/**
+ * @brief CPU active time in percent since power_init()
+ *
+ * @param now_ms  Current time in ms
+ *
+ * @return 0..100, 100 = CPU never slept
+ */
+uint8_t power_active_percent(uint32_t now_ms);
+
+#endif
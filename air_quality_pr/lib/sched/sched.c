@@ -0,0 +1,99 @@
+#include "sched.h"
+#include "tick.h"
+
+#define TASK_ACTIVE 0x01
+
+typedef struct {
+    sched_fn_t fn;
+    uint16_t period_ms;
+    uint16_t deadline_ms;
+    uint16_t next_ms;     // next release, low 16 bits of tick_ms()
+    uint8_t  flags;
+    sched_stats_t stats;
+} sched_task_t;
+
+static sched_task_t tasks[SCHED_MAX_TASKS];
+static uint8_t task_count;
+
+// 16-bit time compare, correct while times are less than 32768 ms apart
+static uint8_t time_reached(uint16_t now, uint16_t t)
+{
+    return (int16_t)(now - t) >= 0;
+}
+
+uint8_t sched_add(sched_fn_t fn, uint16_t period_ms, uint16_t deadline_ms, uint16_t delay_ms)
+{
+    if (task_count >= SCHED_MAX_TASKS)
+        return SCHED_NO_TASK;
+
+    sched_task_t *t = &tasks[task_count];
+
+    t->fn = fn;
+    t->period_ms = period_ms;
+    t->deadline_ms = deadline_ms;
+    t->next_ms = (uint16_t)tick_ms() + delay_ms;
+    t->flags = TASK_ACTIVE;
+    t->stats.runs = 0;
+    t->stats.misses = 0;
+    t->stats.max_us = 0;
+    return task_count++;
+}
+
+void sched_trigger(uint8_t id, uint16_t delay_ms)
+{
+    if (id >= task_count)
+        return;
+    tasks[id].next_ms = (uint16_t)tick_ms() + delay_ms;
+    tasks[id].flags |= TASK_ACTIVE;
+}
+
+void sched_stop(uint8_t id)
+{
+    if (id < task_count)
+        tasks[id].flags &= ~TASK_ACTIVE;
+}
+
+uint8_t sched_run(void)
+{
+    uint8_t ran = 0;
+
+    for (uint8_t i = 0; i < task_count; i++)
+    {
+        sched_task_t *t = &tasks[i];
+        uint16_t release = t->next_ms;
+
+        if (!(t->flags & TASK_ACTIVE) || !time_reached((uint16_t)tick_ms(), release))
+            continue;
+
+        // next release is set before the run, so the task can re-trigger or stop itself
+        if (t->period_ms == 0)
+            t->flags &= ~TASK_ACTIVE;
+        else
+            t->next_ms = release + t->period_ms;
+
+        uint32_t start = tick_us();
+        t->fn();
+        uint32_t run_us = tick_us() - start;
+        uint16_t end = (uint16_t)tick_ms();
+
+        if (t->stats.runs != 0xFFFF)
+            t->stats.runs++;
+        if (run_us > t->stats.max_us)
+            t->stats.max_us = run_us;
+        if ((uint16_t)(end - release) > t->deadline_ms && t->stats.misses != 0xFFFF)
+            t->stats.misses++;
+
+        // more than one period late, drop lost releases
+        if (t->period_ms != 0 && (t->flags & TASK_ACTIVE) && time_reached(end, t->next_ms + t->period_ms))
+            t->next_ms = end + t->period_ms;
+
+        ran++;
+    }
+    return ran;
+}
+
+void sched_get_stats(uint8_t id, sched_stats_t *out)
+{
+    if (id < task_count)
+        *out = tasks[id].stats;
+}
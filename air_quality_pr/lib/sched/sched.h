@@ -0,0 +1,70 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_MAX_TASKS 7    // 17 bytes of SRAM per task
+#define SCHED_NO_TASK   0xFF // returned by sched_add() when table is full
+
+/**
+ * @brief Task function, runs to completion, must not block
+ */
+typedef void (*sched_fn_t)(void);
+
+/**
+ * @brief Run-time statistics of one task
+ */
+typedef struct {
+    uint16_t runs;    // number of runs since sched_add(), saturated
+    uint16_t misses;  // runs finished later than release + deadline, saturated
+    uint32_t max_us;  // longest run time in us, a full frame flush takes ~100 ms
+} sched_stats_t;
+
+/**
+ * @brief Add a task
+ *
+ * @param fn           Task function
+ * @param period_ms    Period, 0 = one-shot task run once per sched_trigger()
+ * @param deadline_ms  Allowed time from release to end of run
+ * @param delay_ms     Time from now to first release
+ *
+ * @return Task id in order of adding, tasks added first run first
+ *         when released together. SCHED_NO_TASK if table is full.
+ *
+ * Periods and delays must be below 32768 ms.
+ */
+uint8_t sched_add(sched_fn_t fn, uint16_t period_ms, uint16_t deadline_ms, uint16_t delay_ms);
+
+/**
+ * @brief Release a task after delay_ms, also re-arms one-shot tasks
+ *
+ * @param id        Task id from sched_add()
+ * @param delay_ms  0 = run on next sched_run()
+ */
+void sched_trigger(uint8_t id, uint16_t delay_ms);
+
+/**
+ * @brief Stop a task until next sched_trigger()
+ */
+void sched_stop(uint8_t id);
+
+/**
+ * @brief Run all released tasks once, call from main loop
+ *
+ * @return Number of tasks that ran, 0 means the CPU is idle until
+ *         the next release
+ *
+ * A periodic task that is late by more than one period skips the
+ * lost releases instead of running several times in a row.
+ */
+uint8_t sched_run(void);
+
+/**
+ * @brief Copy statistics of a task
+ *
+ * @param id   Task id from sched_add()
+ * @param out  Statistics
+ */
+void sched_get_stats(uint8_t id, sched_stats_t *out);
+
+#endif
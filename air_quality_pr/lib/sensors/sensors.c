@@ -0,0 +1,203 @@
+#include "sensors.h"
+#include "aqi.h"
+#include "notify.h"
+#include <avr/eeprom.h>
+#include <stddef.h>
+
+#define SENSORS_EE_MAGIC 0x53 // marks valid snapshot
+
+static sensor_rec_t records[SENSOR_COUNT]; // 35 bytes
+static uint32_t first_ms[SENSOR_COUNT];    // time of first real measurement, 0 = not yet
+static uint8_t measured;                   // records measured since power on, one bit each
+
+// last known values in EEPROM, 28 bytes. Packed so a host build has the
+// same layout, it would pad each record to 6 bytes
+typedef struct __attribute__((packed)) {
+    int16_t  value;
+    uint16_t index;
+    uint8_t  level;
+} sensors_snap_rec_t;
+
+typedef struct {
+    uint8_t magic;
+    uint8_t mask; // stored records, one bit each
+    sensors_snap_rec_t rec[SENSOR_COUNT];
+    uint8_t check; // sum of previous bytes, inverted
+} sensors_snap_t;
+
+_Static_assert(sizeof(sensors_snap_t) == 28, "update snapshot size in sensors.h");
+
+static sensors_snap_t EEMEM ee_snap;
+
+// maximum age of each record in seconds before it is marked stale
+static const uint16_t max_age_s[SENSOR_COUNT] PROGMEM = {
+    10,  // temperature, DHT11 every 2 s
+    10,  // humidity
+    5,   // CO2, updated every loop
+    660, // PM2.5, SDS018 burst at least every 5.5 min
+    660, // PM10
+};
+
+static const char lbl_none[]   PROGMEM = "--";
+static const char lbl_err[]    PROGMEM = "ERR";
+static const char lbl_stale[]  PROGMEM = "STALE";
+static const char lbl_good[]   PROGMEM = "GOOD";
+static const char lbl_normal[] PROGMEM = "NORMAL";
+static const char lbl_bad[]    PROGMEM = "BAD";
+
+void sensors_init(void)
+{
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        records[i].value = 0;
+        records[i].index = 0;
+        records[i].updated_s = 0;
+        records[i].level = 0;
+        records[i].status = SENSOR_OK;
+        records[i].stale = 0;
+        records[i].valid = 0;
+    }
+}
+
+void sensors_set(uint8_t id, int16_t value, uint16_t index, uint8_t level, uint32_t now_ms)
+{
+    if (id >= SENSOR_COUNT)
+        return;
+
+    sensor_rec_t *r = &records[id];
+
+    if (!(measured & (1 << id)))
+    {
+        measured |= 1 << id;
+        first_ms[id] = now_ms ? now_ms : 1; // 0 means not measured
+    }
+
+    // only a change of a shown field is published, a new timestamp alone is not
+    if (!r->valid || r->stale || r->status != SENSOR_OK || r->value != value || r->index != index || r->level != level)
+        notify_publish(NOTIFY_TOPIC(id));
+
+    r->value = value;
+    r->index = index;
+    r->level = level;
+    r->updated_s = (uint16_t)(now_ms / 1000);
+    r->status = SENSOR_OK;
+    r->stale = 0;
+    r->valid = 1;
+}
+
+void sensors_set_error(uint8_t id, uint8_t status)
+{
+    if (id < SENSOR_COUNT && records[id].status != status)
+    {
+        records[id].status = status;
+        notify_publish(NOTIFY_TOPIC(id));
+    }
+}
+
+void sensors_update_stale(uint32_t now_ms)
+{
+    uint16_t now_s = (uint16_t)(now_ms / 1000);
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        // age is checked every loop, so it never gets near the 18 h wrap before the flag is set
+        if (records[i].valid && !records[i].stale && (uint16_t)(now_s - records[i].updated_s) > pgm_read_word(&max_age_s[i]))
+        {
+            records[i].stale = 1;
+            notify_publish(NOTIFY_TOPIC(i));
+        }
+    }
+}
+
+static uint8_t sensors_snap_check(const sensors_snap_t *c)
+{
+    const uint8_t *p = (const uint8_t *)c;
+    uint8_t sum = 0;
+
+    for (uint8_t i = 0; i < offsetof(sensors_snap_t, check); i++)
+        sum += p[i];
+    return ~sum;
+}
+
+void sensors_snapshot_save(void)
+{
+    sensors_snap_t c;
+
+    c.magic = SENSORS_EE_MAGIC;
+    c.mask = 0;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        // error keeps the last good value, so every valid record is worth storing
+        if (records[i].valid)
+            c.mask |= 1 << i;
+        c.rec[i].value = records[i].value;
+        c.rec[i].index = records[i].index;
+        c.rec[i].level = records[i].level;
+    }
+    c.check = sensors_snap_check(&c);
+    eeprom_update_block(&c, &ee_snap, sizeof(c)); // only changed bytes are written
+}
+
+uint8_t sensors_restore(void)
+{
+    sensors_snap_t c;
+
+    eeprom_read_block(&c, &ee_snap, sizeof(c));
+    if (c.magic != SENSORS_EE_MAGIC || c.check != sensors_snap_check(&c))
+        return 0;
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (!(c.mask & (1 << i)) || records[i].valid)
+            continue;
+
+        records[i].value = c.rec[i].value;
+        records[i].index = c.rec[i].index;
+        records[i].level = c.rec[i].level;
+        records[i].stale = 1; // shown as last known value until the sensor answers
+        records[i].valid = 1;
+        notify_publish(NOTIFY_TOPIC(i));
+    }
+    return c.mask;
+}
+
+uint32_t sensors_first_ms(uint8_t id)
+{
+    return id < SENSOR_COUNT ? first_ms[id] : 0;
+}
+
+const sensor_rec_t *sensors_get(uint8_t id)
+{
+    return &records[id < SENSOR_COUNT ? id : 0];
+}
+
+PGM_P sensors_label_P(uint8_t id)
+{
+    const sensor_rec_t *r = sensors_get(id);
+
+    if (r->status != SENSOR_OK) return lbl_err;
+    if (!r->valid)              return lbl_none;
+    if (r->stale)               return lbl_stale;
+
+    if (id >= SENSOR_CO2)
+        return aqi_label_P(r->level);
+
+    switch (r->level)
+    {
+        case LEVEL_GOOD:   return lbl_good;
+        case LEVEL_NORMAL: return lbl_normal;
+        default:           return lbl_bad;
+    }
+}
+
+uint16_t sensors_overall_aqi(void)
+{
+    uint16_t index = 0;
+
+    for (uint8_t i = SENSOR_CO2; i < SENSOR_COUNT; i++)
+    {
+        if (records[i].valid && !records[i].stale && records[i].index > index)
+            index = records[i].index;
+    }
+    return index;
+}
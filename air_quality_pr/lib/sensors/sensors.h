@@ -0,0 +1,128 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+//measured quantities, one record each
+typedef enum {
+    SENSOR_TEMP = 0, // 0C
+    SENSOR_HUM,      // %
+    SENSOR_CO2,      // CO2 equivalent in ppm
+    SENSOR_PM25,     // 0.1 ug/m3
+    SENSOR_PM10,     // 0.1 ug/m3
+    SENSOR_COUNT
+} sensor_id_t;
+
+//comfort levels of temperature and humidity, pollutants use AQI_xxx categories
+typedef enum {
+    LEVEL_GOOD = 0,
+    LEVEL_NORMAL,
+    LEVEL_BAD
+} sensor_level_t;
+
+//record status
+#define SENSOR_OK          0
+#define SENSOR_ERR_TIMEOUT 1 // sensor did not answer
+#define SENSOR_ERR_CRC     2 // answer was damaged
+
+/**
+ * @brief State of one measured quantity, 7 bytes
+ */
+typedef struct {
+    int16_t  value;      // fixed point, unit see sensor_id_t
+    uint16_t index;      // AQI sub-index of pollutants, 0 for comfort values
+    uint16_t updated_s;  // tick_ms()/1000 of last update, wraps after 18 h
+    uint8_t  level  : 3; // sensor_level_t or AQI category
+    uint8_t  status : 3; // SENSOR_OK or SENSOR_ERR_xxx
+    uint8_t  stale  : 1; // no update for longer than the maximum age of the sensor
+    uint8_t  valid  : 1; // value was measured at least once
+} sensor_rec_t;
+
+/**
+ * @brief Clear all records, nothing is valid until the first sensors_set()
+ */
+void sensors_init(void);
+
+/**
+ * @brief Store a new measurement
+ *
+ * @param id      SENSOR_xxx
+ * @param value   Filtered value in fixed point units of the sensor
+ * @param index   AQI sub-index, 0 for comfort values
+ * @param level   Comfort level or AQI category
+ * @param now_ms  Current time in ms
+ *
+ * Clears error and stale flags. NOTIFY_TOPIC(id) is published when
+ * a field shown to the user changed.
+ */
+void sensors_set(uint8_t id, int16_t value, uint16_t index, uint8_t level, uint32_t now_ms);
+
+/**
+ * @brief Mark a sensor as failing, last value is kept
+ *
+ * @param id      SENSOR_xxx
+ * @param status  SENSOR_ERR_xxx
+ *
+ * NOTIFY_TOPIC(id) is published when the status changed.
+ */
+void sensors_set_error(uint8_t id, uint8_t status);
+
+/**
+ * @brief Mark records stale when they are older than their maximum age
+ *
+ * @param now_ms  Current time in ms
+ *
+ * NOTIFY_TOPIC(id) is published for records which just became stale.
+ */
+void sensors_update_stale(uint32_t now_ms);
+
+/**
+ * @brief Store last known values of valid records in EEPROM
+ *
+ * The snapshot is 28 bytes. Only changed bytes are written, call at most
+ * every few minutes to spare the EEPROM (100 000 write cycles). Every
+ * 30 minutes a byte that changes each time, like the check byte, is
+ * written 17 520 times per year and wears out after about 5.7 years.
+ */
+void sensors_snapshot_save(void);
+
+/**
+ * @brief Restore last known values from EEPROM after sensors_init()
+ *
+ * Restored records are valid and stale, so their values can be shown
+ * at once while the levels show STALE until the first measurement.
+ *
+ * @return Mask of restored records (1 << SENSOR_xxx), 0 if no snapshot
+ */
+uint8_t sensors_restore(void);
+
+/**
+ * @brief Time to first real value of a record
+ *
+ * @return tick_ms() of the first sensors_set() since power on,
+ *         0 if the sensor was not measured yet
+ */
+uint32_t sensors_first_ms(uint8_t id);
+
+/**
+ * @brief Read-only access to a record
+ */
+const sensor_rec_t *sensors_get(uint8_t id);
+
+/**
+ * @brief Label of a record for display
+ *
+ * @return String in PROGMEM: "ERR", "STALE", "--" before the first
+ *         measurement, otherwise comfort or AQI category label
+ */
+PGM_P sensors_label_P(uint8_t id);
+
+/**
+ * @brief Overall index, worst sub-index of valid and fresh pollutants
+ *
+ * @return 0..500, 0 if no pollutant is available yet
+ */
+uint16_t sensors_overall_aqi(void);
+
+#endif
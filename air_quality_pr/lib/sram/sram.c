@@ -0,0 +1,29 @@
+#include <avr/io.h>
+
+#include "sram.h"
+
+#define SRAM_PAINT 0xC5 // pattern of SRAM never used by the stack
+
+extern uint8_t __heap_start; // end of static data from the linker, heap is not used
+
+void sram_paint(void)
+{
+    uint8_t *p = &__heap_start;
+
+    while (p < (uint8_t *)SP) // stack grows down from SP, all below is free now
+        *p++ = SRAM_PAINT;
+}
+
+uint16_t sram_static(void)
+{
+    return (uint16_t)(&__heap_start - (uint8_t *)RAMSTART);
+}
+
+uint16_t sram_peak(void)
+{
+    const uint8_t *p = &__heap_start;
+
+    while (p <= (const uint8_t *)RAMEND && *p == SRAM_PAINT)
+        p++;
+    return (RAMEND + 1 - RAMSTART) - (uint16_t)(p - &__heap_start);
+}
@@ -0,0 +1,29 @@
+#ifndef SRAM_H
+#define SRAM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Fill free SRAM below the stack with a pattern, call first in main()
+ *
+ * Must run before interrupts are enabled, the pattern is later
+ * overwritten by the deepest stack frames of code and interrupts.
+ */
+void sram_paint(void);
+
+/**
+ * @brief Static data in bytes, .data and .bss from the linker
+ */
+uint16_t sram_static(void);
+
+/**
+ * @brief Peak SRAM use in bytes since sram_paint()
+ *
+ * @return Static data plus the deepest stack seen
+ *
+ * Scans the painted area up to the first overwritten byte, about
+ * 6 cycles per free byte.
+ */
+uint16_t sram_peak(void);
+
+#endif
@@ -0,0 +1,56 @@
+#include "tick.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#ifndef F_CPU
+# define F_CPU 16000000UL
+#endif
+
+#define TICK_PRESCALER 64
+#define TICK_OCR ((F_CPU / TICK_PRESCALER / TICK_HZ) - 1) // 249 for 16MHz
+#define TICK_US_PER_COUNT (1000000UL / (F_CPU / TICK_PRESCALER)) // 4 us for 16MHz
+
+static volatile uint32_t tick_count; // incremented every 1 ms in ISR
+
+void tick_init(void)
+{
+    TCCR0A = (1 << WGM01); // CTC mode, TOP = OCR0A
+    TCCR0B = (1 << CS01) | (1 << CS00); // prescaler 64
+    OCR0A  = TICK_OCR;
+    TIMSK0 |= (1 << OCIE0A); // compare match A interrupt
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+    tick_count++;
+}
+
+uint32_t tick_ms(void)
+{
+    uint32_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // 32-bit value is not read atomically by 8-bit CPU
+    {
+        t = tick_count;
+    }
+    return t;
+}
+
+uint32_t tick_us(void)
+{
+    uint32_t ms;
+    uint8_t count;
+    uint8_t pending;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ms = tick_count;
+        count = TCNT0;
+        pending = TIFR0 & (1 << OCF0A);
+    }
+    // counter restarted from 0 but the ISR did not run yet
+    if (pending && count < TICK_OCR / 2)
+        ms++;
+
+    return ms * 1000UL + (uint32_t)count * TICK_US_PER_COUNT;
+}
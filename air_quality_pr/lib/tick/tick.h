@@ -0,0 +1,35 @@
+#ifndef TICK_H
+#define TICK_H
+
+#include <stdint.h>
+
+#define TICK_HZ 1000 // tick frequency, 1 tick = 1 ms
+
+/**
+ * @brief Start millisecond system tick
+ *
+ * Timer/Counter0 is used in CTC mode with prescaler 64
+ * (16MHz/64/250 = 1kHz). Global interrupts must be enabled
+ * with sei() for the tick to run.
+ */
+void tick_init(void);
+
+/**
+ * @brief Get milliseconds since tick_init()
+ *
+ * @return uint32_t  Millisecond counter, overflows after ~49 days.
+ *                   Compare times only by difference, e.g.
+ *                   (uint32_t)(now - start) >= timeout
+ */
+uint32_t tick_ms(void);
+
+/**
+ * @brief Get microseconds since tick_init(), 4 us resolution
+ *
+ * @return uint32_t  Microsecond counter from tick_ms() and Timer0 count,
+ *                   overflows after ~71 minutes. Use only for measuring
+ *                   short durations by difference.
+ */
+uint32_t tick_us(void);
+
+#endif
@@ -8,6 +8,36 @@
 
 // -- Includes -------------------------------------------------------
 #include <twi.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <util/atomic.h>
+#include "tick.h"
+
+
+// -- Defines --------------------------------------------------------
+#define TWI_RECOVER_CLOCKS 9 /* slave releases SDA after at most 9 clocks */
+#define TWI_HALF_BIT_US 5    /* GPIO clock of 100 kHz during recovery */
+
+/* TWCR values of the background engine */
+#define TWI_CR_NEXT  ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))  /* send TWDR, wait for next interrupt */
+#define TWI_CR_START ((1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE))
+
+/* Open drain pin control: low = output 0, high = input with pull-up */
+#define PIN_LOW(pin) do { TWI_PORT &= ~(1<<(pin)); DDR(TWI_PORT) |= (1<<(pin)); } while (0)
+#define PIN_RELEASE(pin) do { DDR(TWI_PORT) &= ~(1<<(pin)); TWI_PORT |= (1<<(pin)); } while (0)
+
+
+// -- Variables ------------------------------------------------------
+static uint8_t twi_error;       /* first error since last twi_get_error() */
+static uint16_t twi_recoveries; /* bus recoveries since reset */
+
+/* Background engine, queue and state are shared with TWI_vect */
+static twi_xfer_t *twi_queue[TWI_QUEUE_LEN];
+static volatile uint8_t twi_q_tail;         /* running transaction */
+static volatile uint8_t twi_q_count;        /* queued including the running one */
+static uint16_t twi_pos;                     /* 0 = ctrl next, then buf[twi_pos - 1] */
+static volatile uint16_t twi_progress_ms;   /* last interrupt, deadline of a stuck bus */
+static twi_stats_t twi_stats;
 
 
 // -- Functions ------------------------------------------------------
@@ -29,16 +59,59 @@ void twi_init(void)
 }
 
 
+/*
+ * Function: twi_wait()
+ * Purpose:  Wait for TWINT with deadline, recover the bus on timeout.
+ * Returns:  TWI_OK or TWI_ERR_TIMEOUT
+ */
+static uint8_t twi_wait(void)
+{
+    uint32_t start = tick_ms();
+
+    while ((TWCR & (1<<TWINT)) == 0)
+    {
+        /* tick granularity is 1 ms, so wait at least TWI_TIMEOUT_MS full ticks */
+        if ((uint32_t)(tick_ms() - start) > TWI_TIMEOUT_MS)
+        {
+            if (twi_error == TWI_OK)
+                twi_error = TWI_ERR_TIMEOUT;
+            twi_recover();
+            return TWI_ERR_TIMEOUT;
+        }
+    }
+    return TWI_OK;
+}
+
+
 /*
  * Function: twi_start()
  * Purpose:  Start communication on I2C/TWI bus.
- * Returns:  none
+ * Returns:  TWI_OK, TWI_ERR_TIMEOUT or TWI_ERR_BUS
  */
-void twi_start(void)
+uint8_t twi_start(void)
 {
+    uint8_t twi_status;
+
+    /* Let queued transactions finish first */
+    while (!twi_idle())
+        ;
+
     /* Send Start condition */
     TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
-    while ((TWCR & (1<<TWINT)) == 0);
+    if (twi_wait() != TWI_OK)
+        return TWI_ERR_TIMEOUT;
+
+    /* Status Code:
+         - 0x08: Start condition has been transmitted
+         - 0x10: Repeated start condition has been transmitted
+    */
+    twi_status = TWSR & 0xf8;
+    if (twi_status == 0x08 || twi_status == 0x10)
+        return TWI_OK;
+
+    if (twi_error == TWI_OK)
+        twi_error = TWI_ERR_BUS;
+    return TWI_ERR_BUS;
 }
 
 
@@ -46,7 +119,7 @@ void twi_start(void)
  * Function: twi_write()
  * Purpose:  Write one byte to the I2C/TWI bus.
  * Input:    data Byte to be transmitted
- * Returns:  ACK/NACK received value
+ * Returns:  ACK/NACK received value or TWI_ERR_TIMEOUT
  */
 uint8_t twi_write(uint8_t data)
 {
@@ -55,7 +128,8 @@ uint8_t twi_write(uint8_t data)
     /* Send SLA+R, SLA+W, or data byte on I2C/TWI bus */
     TWDR = data;
     TWCR = (1<<TWINT) | (1<<TWEN);
-    while ((TWCR & (1<<TWINT)) == 0);
+    if (twi_wait() != TWI_OK)
+        return TWI_ERR_TIMEOUT;
 
     /* Check value of TWI status register */
     twi_status = TWSR & 0xf8;
@@ -77,7 +151,7 @@ uint8_t twi_write(uint8_t data)
  * Purpose:  Read one byte from the I2C/TWI bus and acknowledge
  *           it by ACK or NACK.
  * Input:    ack ACK/NACK value to be transmitted
- * Returns:  Received data byte
+ * Returns:  Received data byte, 0xff on timeout
  */
 uint8_t twi_read(uint8_t ack)
 {
@@ -85,7 +159,8 @@ uint8_t twi_read(uint8_t ack)
         TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
     else
         TWCR = (1<<TWINT) | (1<<TWEN);
-    while ((TWCR & (1<<TWINT)) == 0);
+    if (twi_wait() != TWI_OK)
+        return 0xff;
 
     return (TWDR);
 }
@@ -106,14 +181,15 @@ void twi_stop(void)
  * Function: twi_test_address()
  * Purpose:  Test presence of one I2C device on the bus.
  * Input:    addr Slave address
- * Returns:  ACK/NACK received value
+ * Returns:  ACK/NACK received value or error code
  */
 uint8_t twi_test_address(uint8_t addr)
 {
     uint8_t ack;  // ACK response from Slave
 
-    twi_start();
-    ack = twi_write((addr<<1) | TWI_WRITE);
+    ack = twi_start();
+    if (ack == TWI_OK)
+        ack = twi_write((addr<<1) | TWI_WRITE);
     twi_stop();
 
     return ack;
@@ -131,16 +207,18 @@ uint8_t twi_test_address(uint8_t addr)
  */
 void twi_readfrom_mem_into(uint8_t addr, uint8_t memaddr, volatile uint8_t *buf, uint8_t nbytes)
 {
-    twi_start();
-    if (twi_write((addr<<1) | TWI_WRITE) == 0)
+    if (twi_start() == TWI_OK && twi_write((addr<<1) | TWI_WRITE) == 0)
     {
         // Set starting address
         twi_write(memaddr);
         twi_stop();
 
         // Read data into the buffer
-        twi_start();
-        twi_write((addr<<1) | TWI_READ);
+        if (twi_start() != TWI_OK || twi_write((addr<<1) | TWI_READ) != 0)
+        {
+            twi_stop();
+            return;
+        }
         if (nbytes >= 2)
         {
             for (uint8_t i=0; i<(nbytes-1); i++)
@@ -155,4 +233,258 @@ void twi_readfrom_mem_into(uint8_t addr, uint8_t memaddr, volatile uint8_t *buf,
     {
         twi_stop();
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Function: twi_get_error()
+ * Purpose:  Get and clear the first error since last call.
+ * Returns:  TWI_OK, TWI_ERR_TIMEOUT or TWI_ERR_BUS
+ */
+uint8_t twi_get_error(void)
+{
+    uint8_t err = twi_error;
+
+    twi_error = TWI_OK;
+    return err;
+}
+
+
+/*
+ * Function: twi_get_recoveries()
+ * Purpose:  Number of bus recoveries since reset.
+ * Returns:  Counter
+ */
+uint16_t twi_get_recoveries(void)
+{
+    return twi_recoveries;
+}
+
+
+/*
+ * Function: twi_abort()
+ * Purpose:  Drop all queued transactions after a stuck bus and recover it.
+ * Returns:  none
+ */
+static void twi_abort(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        while (twi_q_count)
+        {
+            twi_queue[twi_q_tail]->status = TWI_ERR_TIMEOUT;
+            twi_q_tail = (twi_q_tail + 1) % TWI_QUEUE_LEN;
+            twi_q_count--;
+        }
+        if (twi_error == TWI_OK)
+            twi_error = TWI_ERR_TIMEOUT;
+        twi_recover(); /* clears TWIE with TWCR */
+    }
+}
+
+
+/*
+ * Function: twi_finish()
+ * Purpose:  End the running transaction in TWI_vect and start the next one.
+ * Input:    status Result of the transaction
+ *           stop Generate Stop condition, not after lost arbitration
+ * Returns:  none
+ */
+static void twi_finish(uint8_t status, uint8_t stop)
+{
+    twi_xfer_t *x = twi_queue[twi_q_tail];
+
+    if (twi_stats.xfers != 0xffff)
+        twi_stats.xfers++;
+    if (status == TWI_ERR_NACK && twi_stats.nacks != 0xffff)
+        twi_stats.nacks++;
+    if (status == TWI_ERR_ARB && twi_stats.arb_lost != 0xffff)
+        twi_stats.arb_lost++;
+    if (status != TWI_OK && twi_error == TWI_OK)
+        twi_error = status;
+
+    /* Slot is released after the callback, so a submit from the callback
+       is queued behind the others and does not start the unit itself */
+    x->status = status;
+    if (x->done)
+        x->done(x);
+    twi_q_tail = (twi_q_tail + 1) % TWI_QUEUE_LEN;
+    twi_q_count--;
+
+    /* With both TWSTO and TWSTA the unit sends Stop followed by Start */
+    if (twi_q_count)
+        TWCR = TWI_CR_START | (stop ? (1<<TWSTO) : 0);
+    else
+        TWCR = (1<<TWINT) | (1<<TWEN) | (stop ? (1<<TWSTO) : 0);
+}
+
+
+/*
+ * Function: TWI_vect
+ * Purpose:  Background engine, one step per TWI status code.
+ */
+ISR(TWI_vect)
+{
+    twi_xfer_t *x = twi_queue[twi_q_tail];
+
+    twi_progress_ms = (uint16_t)tick_ms();
+
+    switch (TWSR & 0xf8)
+    {
+    case 0x08:  /* Start transmitted */
+    case 0x10:  /* Repeated start transmitted */
+        twi_pos = 0;
+        TWDR = (x->addr<<1) | TWI_WRITE;
+        TWCR = TWI_CR_NEXT;
+        break;
+
+    case 0x18:  /* SLA+W transmitted, ACK received */
+    case 0x28:  /* Data byte transmitted, ACK received */
+        if (twi_pos > x->len)
+        {
+            twi_stats.bytes += x->len + 2;
+            twi_finish(TWI_OK, 1);
+            break;
+        }
+        TWDR = twi_pos ? x->buf[twi_pos - 1] : x->ctrl;
+        twi_pos++;
+        TWCR = TWI_CR_NEXT;
+        break;
+
+    case 0x20:  /* SLA+W transmitted, NACK received */
+    case 0x30:  /* Data byte transmitted, NACK received */
+        twi_stats.bytes += twi_pos + 1;
+        twi_finish(TWI_ERR_NACK, 1);
+        break;
+
+    case 0x38:  /* Arbitration lost, bus is released without Stop */
+        twi_stats.bytes += twi_pos;
+        twi_finish(TWI_ERR_ARB, 0);
+        break;
+
+    default:    /* Bus error or unexpected state */
+        twi_finish(TWI_ERR_BUS, 1);
+        break;
+    }
+}
+
+
+/*
+ * Function: twi_submit()
+ * Purpose:  Queue a write transaction for the background engine.
+ * Input:    x Transaction owned by the caller
+ * Returns:  TWI_OK or TWI_ERR_FULL
+ */
+uint8_t twi_submit(twi_xfer_t *x)
+{
+    uint8_t result = TWI_ERR_FULL;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (twi_q_count < TWI_QUEUE_LEN)
+        {
+            x->status = TWI_BUSY;
+            twi_queue[(twi_q_tail + twi_q_count) % TWI_QUEUE_LEN] = x;
+            /* engine is idle, start it; otherwise twi_finish() starts this one */
+            if (twi_q_count++ == 0)
+            {
+                twi_progress_ms = (uint16_t)tick_ms();
+                TWCR = TWI_CR_START;
+            }
+            result = TWI_OK;
+        }
+    }
+    return result;
+}
+
+
+/*
+ * Function: twi_idle()
+ * Purpose:  Check if the background engine has nothing to do, abort
+ *           it when the bus made no progress for TWI_TIMEOUT_MS.
+ * Returns:  1 if idle, 0 if busy
+ */
+uint8_t twi_idle(void)
+{
+    uint16_t progress;
+
+    if (twi_q_count == 0)
+        return 1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        progress = twi_progress_ms;
+    }
+    /* tick granularity is 1 ms, so wait at least TWI_TIMEOUT_MS full ticks */
+    if ((uint16_t)((uint16_t)tick_ms() - progress) > TWI_TIMEOUT_MS)
+    {
+        twi_abort();
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * Function: twi_sync()
+ * Purpose:  Wait until a submitted transaction is finished.
+ * Input:    x Transaction
+ * Returns:  Final status of the transaction
+ */
+uint8_t twi_sync(twi_xfer_t *x)
+{
+    while (x->status == TWI_BUSY)
+        twi_idle();
+    return x->status;
+}
+
+
+/*
+ * Function: twi_get_stats()
+ * Purpose:  Copy background engine statistics.
+ * Returns:  none
+ */
+void twi_get_stats(twi_stats_t *out)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *out = twi_stats;
+    }
+}
+
+
+/*
+ * Function: twi_recover()
+ * Purpose:  Free a bus held by a slave: clock SCL until SDA is released,
+ *           generate Stop condition and initialize TWI unit again.
+ * Returns:  none
+ */
+void twi_recover(void)
+{
+    /* Take pins from TWI unit */
+    TWCR = 0;
+    PIN_RELEASE(TWI_SDA_PIN);
+    PIN_RELEASE(TWI_SCL_PIN);
+
+    /* Slave in the middle of a byte holds SDA low, clock the rest of it out */
+    for (uint8_t i = 0; i < TWI_RECOVER_CLOCKS; i++)
+    {
+        if (PIN(TWI_PORT) & (1<<TWI_SDA_PIN))
+            break;
+        PIN_LOW(TWI_SCL_PIN);
+        _delay_us(TWI_HALF_BIT_US);
+        PIN_RELEASE(TWI_SCL_PIN);
+        _delay_us(TWI_HALF_BIT_US);
+    }
+
+    /* Stop condition: SDA rises while SCL is high */
+    PIN_LOW(TWI_SDA_PIN);
+    _delay_us(TWI_HALF_BIT_US);
+    PIN_RELEASE(TWI_SCL_PIN);
+    _delay_us(TWI_HALF_BIT_US);
+    PIN_RELEASE(TWI_SDA_PIN);
+    _delay_us(TWI_HALF_BIT_US);
+
+    twi_init();
+    if (twi_recoveries != 0xffff)
+        twi_recoveries++;
+}
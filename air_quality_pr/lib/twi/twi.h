@@ -35,7 +35,14 @@
 #ifndef F_CPU
 # define F_CPU 16000000 /**< @brief CPU frequency in Hz required TWI_BIT_RATE_REG */
 #endif
-#define F_SCL 100000 /**< @brief I2C/TWI bit rate. Must be greater than 31000 */
+#ifndef TWI_FAST_MODE
+# define TWI_FAST_MODE 0 /**< @brief 1 = 400 kHz, needs external pull-ups (most OLED modules have 4k7) */
+#endif
+#if TWI_FAST_MODE
+# define F_SCL 400000 /**< @brief I2C/TWI bit rate. Must be greater than 31000 */
+#else
+# define F_SCL 100000 /**< @brief I2C/TWI bit rate. Must be greater than 31000 */
+#endif
 #define TWI_BIT_RATE_REG ((F_CPU/F_SCL - 16) / 2) /**< @brief TWI bit rate register value */
 
 
@@ -54,10 +61,53 @@
 #define TWI_READ 1 /**< @brief Mode for reading from I2C/TWI device */
 #define TWI_ACK 0 /**< @brief ACK value for writing to I2C/TWI bus */
 #define TWI_NACK 1 /**< @brief NACK value for writing to I2C/TWI bus */
+#define TWI_TIMEOUT_MS 2 /**< @brief Deadline of one bus operation, one byte takes 90 us at 100 kHz */
+#define TWI_QUEUE_LEN 4 /**< @brief Transactions waiting for the background engine, 2 bytes of SRAM each */
 #define DDR(_x) (*(&_x - 1)) /**< @brief Address of Data Direction Register of port _x */
 #define PIN(_x) (*(&_x - 2)) /**< @brief Address of input register of port _x */
 
 
+/**
+ * @name Status codes
+ */
+#define TWI_OK 0 /**< @brief Operation finished, ACK received */
+#define TWI_ERR_NACK 1 /**< @brief NACK received */
+#define TWI_ERR_TIMEOUT 2 /**< @brief TWINT was not set before deadline, bus was recovered */
+#define TWI_ERR_BUS 3 /**< @brief Start condition was not transmitted, bus is busy or lost */
+#define TWI_ERR_ARB 4 /**< @brief Arbitration lost to another master */
+#define TWI_BUSY 5 /**< @brief Transaction is queued or running */
+#define TWI_ERR_FULL 6 /**< @brief Queue is full, transaction was not submitted */
+
+
+// -- Types ----------------------------------------------------------
+struct twi_xfer;
+typedef void (*twi_done_fn_t)(struct twi_xfer *x); /**< @brief Completion callback, runs in TWI interrupt */
+
+/**
+ * @brief  Write transaction run by the background engine: SLA+W, ctrl, buf[0..len-1].
+ * @note   The structure and buf are owned by the caller and must stay
+ *         valid until status is not TWI_BUSY.
+ */
+typedef struct twi_xfer {
+    uint8_t addr;            /**< @brief 7-bit slave address */
+    uint8_t ctrl;            /**< @brief First byte after SLA+W, e.g. OLED control byte */
+    const uint8_t *buf;      /**< @brief Payload */
+    uint16_t len;            /**< @brief Payload length */
+    volatile uint8_t status; /**< @brief TWI_BUSY, then TWI_OK or error code */
+    twi_done_fn_t done;      /**< @brief Called when finished, may submit, NULL = none */
+} twi_xfer_t;
+
+/**
+ * @brief Background engine statistics
+ */
+typedef struct {
+    uint32_t bytes;     /**< @brief Bytes on the wire including SLA+W */
+    uint16_t xfers;     /**< @brief Finished transactions, saturated */
+    uint16_t nacks;     /**< @brief Transactions ended by NACK, saturated */
+    uint16_t arb_lost;  /**< @brief Transactions ended by lost arbitration, saturated */
+} twi_stats_t;
+
+
 // -- Function prototypes --------------------------------------------
 /**
  * @brief  Initialize TWI unit, enable internal pull-ups, and set SCL frequency.
@@ -73,9 +123,16 @@ void twi_init(void);
 
 /**
  * @brief  Start communication on I2C/TWI bus.
- * @return none
+ * @return Status code
+ * @retval TWI_OK - Start or repeated start has been transmitted
+ * @retval TWI_ERR_TIMEOUT - No response within TWI_TIMEOUT_MS, bus was recovered
+ * @retval TWI_ERR_BUS - Unexpected status, e.g. arbitration lost
+ * @par    Worst-case latency: TWI_TIMEOUT_MS + 1 ms tick granularity + bus recovery (~0.1 ms)
+ * @note   Deadlines use tick_ms(), so tick must run and interrupts must be enabled.
+ *         Waits until the background engine is idle, polled and queued
+ *         transactions never mix on the bus.
  */
-void twi_start(void);
+uint8_t twi_start(void);
 
 
 /**
@@ -84,6 +141,8 @@ void twi_start(void);
  * @return ACK/NACK received value
  * @retval 0 - ACK has been received
  * @retval 1 - NACK has been received
+ * @retval TWI_ERR_TIMEOUT - No response within TWI_TIMEOUT_MS, bus was recovered
+ * @par    Worst-case latency: same as twi_start()
  * @note   Function returns 0 if 0x18, 0x28, or 0x40 status code is detected\n
  *           - 0x18: SLA+W has been transmitted and ACK has been received\n
  *           - 0x28: Data byte has been transmitted and ACK has been received\n
@@ -96,7 +155,8 @@ uint8_t twi_write(uint8_t data);
  * @brief  Read one byte from the I2C/TWI bus and acknowledge
  *         it by ACK or NACK.
  * @param  ack - ACK/NACK value to be transmitted
- * @return Received data byte
+ * @return Received data byte, 0xff on timeout (see twi_get_error())
+ * @par    Worst-case latency: same as twi_start()
  */
 uint8_t twi_read(uint8_t ack);
 
@@ -128,6 +188,68 @@ uint8_t twi_test_address(uint8_t addr);
  */
 void twi_readfrom_mem_into(uint8_t addr, uint8_t memaddr, volatile uint8_t *buf, uint8_t nbytes);
 
+
+/**
+ * @brief  Get and clear the first error since last call.
+ * @return TWI_OK or TWI_ERR_TIMEOUT / TWI_ERR_BUS
+ */
+uint8_t twi_get_error(void);
+
+
+/**
+ * @brief  Number of bus recoveries since reset.
+ * @return Counter, saturated at 0xffff
+ */
+uint16_t twi_get_recoveries(void);
+
+
+/**
+ * @brief  Free a bus held by a slave and reinitialize TWI unit.
+ * @par    Implementation notes:
+ *           - TWI unit is disabled and SCL is clocked by GPIO up to
+ *             9 times until the slave releases SDA
+ *           - Stop condition is generated and TWI is initialized again
+ *           - Takes about 0.1 ms at most
+ * @return none
+ */
+void twi_recover(void);
+
+/**
+ * @brief  Queue a write transaction for the interrupt driven engine.
+ * @param  x Transaction, status is set to TWI_BUSY
+ * @return TWI_OK or TWI_ERR_FULL
+ * @par    Returns at once. Transactions run in submit order, each one
+ *         ends with Stop, the next one starts in the same interrupt.
+ *         Safe to call from the done callback.
+ */
+uint8_t twi_submit(twi_xfer_t *x);
+
+
+/**
+ * @brief  Wait until a submitted transaction is finished.
+ * @param  x Transaction
+ * @return Final status: TWI_OK, TWI_ERR_NACK, TWI_ERR_ARB, TWI_ERR_BUS or TWI_ERR_TIMEOUT
+ * @par    A transfer without progress for TWI_TIMEOUT_MS aborts all
+ *         queued transactions with TWI_ERR_TIMEOUT and recovers the bus.
+ */
+uint8_t twi_sync(twi_xfer_t *x);
+
+
+/**
+ * @brief  Check if the background engine has nothing to do.
+ * @return 1 if idle, 0 while transactions are queued or running
+ * @par    Also checks the TWI_TIMEOUT_MS deadline, see twi_sync().
+ */
+uint8_t twi_idle(void);
+
+
+/**
+ * @brief  Copy background engine statistics.
+ * @param  out Statistics
+ * @return none
+ */
+void twi_get_stats(twi_stats_t *out);
+
 /** @} */
 
 #endif
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <stdint.h>
-#include <util/delay.h>
 
 #include "oled.h"
 #include "ui.h"
+#include "aqi.h"
+#include "sensors.h"
+#include "anim.h"
+#include "history.h"
 
 
 static void put_int(int value)//print integer as decimal text on display
@@ -27,205 +30,210 @@ static void put_int_1dp(int value10) // Print value/10 with one decimal digit, f
     oled_putc('0' + frac);
 }
 
-//all screens enum
-typedef enum {
-    UI_SCREEN_NONE = 0,
-    UI_SCREEN_ENV_VALUES,   
-    UI_SCREEN_ENV_LEVELS,   
-    UI_SCREEN_PM_VALUES,    
-    UI_SCREEN_PM_LEVELS     
-} ui_screen_t;
+static void put_aqi(uint16_t index, uint8_t category) // Print index and its category, for example "57 MODERATE"
+{
+    char buf[8];
+    utoa(index, buf, 10);
+    oled_puts(buf);
+    oled_putc(' ');
+    oled_puts_p(aqi_label_P(category));
+}
 
-static ui_screen_t ui_current_screen = UI_SCREEN_NONE; //which screen is currently drawn
+static uint8_t put_valid(uint8_t id) // Print "--" instead of a value that was never measured, returns 1 if value can be printed
+{
+    if (sensors_get(id)->valid)
+        return 1;
+    oled_puts_p(PSTR("--"));
+    return 0;
+}
 
-void ui_force_redraw(void) // force next call to redraw full screen layout
+static void put_level(uint8_t id) // Print sub-index and category of pollutant, or its state label
 {
-    ui_current_screen = UI_SCREEN_NONE;
+    const sensor_rec_t *r = sensors_get(id);
+
+    if (r->valid && !r->stale && r->status == SENSOR_OK)
+        put_aqi(r->index, aqi_category(r->index));
+    else
+        oled_puts_p(sensors_label_P(id));
 }
 
 // SCREEN 1 with temp, hum, co2 values
-void screen_temp_hum_values(int t,
-                            int h,
-                            const char *co2_q,
-                            uint16_t co2_raw)
+static void draw_temp_hum_values(void)
 {
-    if (ui_current_screen != UI_SCREEN_ENV_VALUES) //drawing static labels only when screen change
+    oled_gotoxy(0, 2);
+    oled_puts("Temp.   : ");
+    if (put_valid(SENSOR_TEMP))
     {
-        oled_clrscr();
-
-        oled_gotoxy(0, 2);
-        oled_puts("Temperature : ");
-
-        oled_gotoxy(0, 4);
-        oled_puts("Humidity    : ");
+        put_int(sensors_get(SENSOR_TEMP)->value);
+        oled_puts(" C");
+    }
 
-        oled_gotoxy(0, 6);
-        oled_puts("CO2 level   : ");
+    oled_gotoxy(0, 4);
+    oled_puts("Humidity: ");
+    if (put_valid(SENSOR_HUM))
+    {
+        put_int(sensors_get(SENSOR_HUM)->value);
+        oled_puts(" %");
+    }
 
-        oled_gotoxy(0, 7);
-        oled_puts("CO2 raw     : ");
+    //CO2 qualitative level
+    oled_gotoxy(0, 6);
+    oled_puts("CO2     : ");
+    oled_puts_p(sensors_label_P(SENSOR_CO2));
 
-        ui_current_screen = UI_SCREEN_ENV_VALUES;
+    //MQ135 CO2 equivalent
+    oled_gotoxy(0, 7);
+    oled_puts("CO2 ppm : ");
+    if (put_valid(SENSOR_CO2))
+    {
+        char buf[8];
+        utoa(sensors_get(SENSOR_CO2)->value, buf, 10);
+        oled_puts(buf);
     }
-    //updating temperature value
-    oled_gotoxy(14, 2);
-    oled_puts("        ");
-    oled_gotoxy(14, 2);
-    put_int(t);
-    oled_puts(" C");
-
-    //updating humidity value
-    oled_gotoxy(14, 4);
-    oled_puts("        ");
-    oled_gotoxy(14, 4);
-    put_int(h);
-    oled_puts(" %");
-
-    //updating CO2 qualitative level
-    oled_gotoxy(14, 6);
-    oled_puts("        ");
-    oled_gotoxy(14, 6);
-    oled_puts(co2_q);
-
-    //updating raw MQ135 ADC value
-    oled_gotoxy(14, 7);
-    oled_puts("        ");
-    oled_gotoxy(14, 7);
-
-    char buf[8];
-    itoa(co2_raw, buf, 10);
-    oled_puts(buf);
+}
 
-    oled_display();
+void screen_temp_hum_values(void)
+{
+    oled_render(draw_temp_hum_values);
 }
 
 // SCREEN 2 with temp, hum, co2 levels
-void screen_temp_hum_levels(const char *t_q,
-                            const char *h_q,
-                            const char *co2_q)
+static void draw_temp_hum_levels(void)
 {
-    if (ui_current_screen != UI_SCREEN_ENV_LEVELS)
-    {
-        oled_clrscr();
+    oled_gotoxy(0, 2);
+    oled_puts("Temp.   : ");
+    oled_puts_p(sensors_label_P(SENSOR_TEMP));
 
-        oled_gotoxy(0, 2);
-        oled_puts("Temperature : ");
+    oled_gotoxy(0, 4);
+    oled_puts("Humidity: ");
+    oled_puts_p(sensors_label_P(SENSOR_HUM));
 
-        oled_gotoxy(0, 4);
-        oled_puts("Humidity    : ");
-
-        oled_gotoxy(0, 6);
-        oled_puts("CO2 level   : ");
+    oled_gotoxy(0, 6);
+    oled_puts("CO2     : ");
+    oled_puts_p(sensors_label_P(SENSOR_CO2));
+}
 
-        ui_current_screen = UI_SCREEN_ENV_LEVELS;
-    }
-    //updating level strings of temp, hum, co2
-    oled_gotoxy(14, 2);
-    oled_puts("        ");
-    oled_gotoxy(14, 2);
-    oled_puts(t_q);
-
-    oled_gotoxy(14, 4);
-    oled_puts("        ");
-    oled_gotoxy(14, 4);
-    oled_puts(h_q);
-
-    oled_gotoxy(14, 6);
-    oled_puts("        ");
-    oled_gotoxy(14, 6);
-    oled_puts(co2_q);
-
-    oled_display();
+void screen_temp_hum_levels(void)
+{
+    oled_render(draw_temp_hum_levels);
 }
 
-// SCREEN 3 with PM values
-void screen_pm_values(int pm25_10, int pm10_10)
+static void put_history(uint8_t metric) // Print 1 h and 24 h means of a PM metric, "--" while a window is empty
 {
-    if (ui_current_screen != UI_SCREEN_PM_VALUES)
-    {
-        oled_clrscr();
+    history_stat_t s;
+
+    oled_puts("  1h ");
+    if (history_get(metric, HISTORY_1H, &s) == 0)
+        put_int_1dp(s.mean);
+    else
+        oled_puts_p(PSTR("--"));
 
-        oled_gotoxy(0, 2);
-        oled_puts("PM2.5 : ");
+    oled_puts("  24h ");
+    if (history_get(metric, HISTORY_24H, &s) == 0)
+        put_int_1dp(s.mean);
+    else
+        oled_puts_p(PSTR("--"));
+}
 
-        oled_gotoxy(0, 6);
-        oled_puts("PM10  : ");
+// SCREEN 3 with PM values and their 1 h / 24 h means
+static void draw_pm_values(void)
+{
+    oled_gotoxy(0, 2);
+    oled_puts("PM2.5 : ");
+    if (put_valid(SENSOR_PM25))
+    {
+        put_int_1dp(sensors_get(SENSOR_PM25)->value);
+        oled_puts(" ug/m3");
+    }
+    oled_gotoxy(0, 3);
+    put_history(HIST_PM25);
 
-        ui_current_screen = UI_SCREEN_PM_VALUES;
+    oled_gotoxy(0, 6);
+    oled_puts("PM10  : ");
+    if (put_valid(SENSOR_PM10))
+    {
+        put_int_1dp(sensors_get(SENSOR_PM10)->value);
+        oled_puts(" ug/m3");
     }
+    oled_gotoxy(0, 7);
+    put_history(HIST_PM10);
+}
 
-    //pm2.5 value
-    oled_gotoxy(8, 2);        
-    oled_puts("           ");// clear old value
-    oled_gotoxy(8, 2);
-    put_int_1dp(pm25_10);
-    oled_puts(" ug/m3");
-
-    //pm10 value
-    oled_gotoxy(8, 6);       
-    oled_puts("           ");// clear old value
-    oled_gotoxy(8, 6);
-    put_int_1dp(pm10_10);
-    oled_puts(" ug/m3");
-
-    oled_display();
+void screen_pm_values(void)
+{
+    oled_render(draw_pm_values);
 }
 
-// SCREEN 4 with PM levels
-void screen_pm_levels(const char *pm25_q, const char *pm10_q)
+// SCREEN 4 with PM sub-indices and their categories, "PM2.5 500 V.UNHEALTHY" fills the line
+static void draw_pm_levels(void)
 {
-    if (ui_current_screen != UI_SCREEN_PM_LEVELS)
-    {
-        oled_clrscr();
+    oled_gotoxy(0, 2);
+    oled_puts("PM2.5 ");
+    put_level(SENSOR_PM25);
 
-        oled_gotoxy(0, 2);
-        oled_puts("PM2.5 : ");
+    oled_gotoxy(0, 6);
+    oled_puts("PM10  ");
+    put_level(SENSOR_PM10);
+}
 
-        oled_gotoxy(0, 6);
-        oled_puts("PM10  : ");
+void screen_pm_levels(void)
+{
+    oled_render(draw_pm_levels);
+}
 
-        ui_current_screen = UI_SCREEN_PM_LEVELS;
-    }
 
-    //pm2.5 level
-    oled_gotoxy(8, 2);
-    oled_puts("           ");
-    oled_gotoxy(8, 2);
-    oled_puts(pm25_q);
+static void draw_cat_frame(void);//declaration for cat drawing function   
 
-    //pm10 level
-    oled_gotoxy(8, 6);
-    oled_puts("           ");
-    oled_gotoxy(8, 6);
-    oled_puts(pm10_q);
+static anim_t cat_anim;  // cat timeline state and its render cost
+static uint16_t cat_aqi; // index shown under the cat
+static uint8_t cat_tail; // tail position of the frame drawn
 
-    oled_display();
+static void cat_frame(uint8_t frame) // timeline callback, odd frames have the tail up
+{
+    cat_tail = frame & 1;
+    oled_render(draw_cat_frame);
 }
 
+// 6 frames, 500ms = 3 seconds animation
+static const anim_frame_t cat_timeline[] PROGMEM = {
+    { 0, 500, cat_frame },
+    { 1, 500, cat_frame },
+    { 2, 500, cat_frame },
+    { 3, 500, cat_frame },
+    { 4, 500, cat_frame },
+    { 5, 500, cat_frame },
+};
+
+//cat animation with moving tail, text shows overall air quality index
+void ui_cat_start(uint16_t aqi, uint32_t now_ms)
+{
+    cat_aqi = aqi;
+    anim_start(&cat_anim, cat_timeline, sizeof(cat_timeline) / sizeof(cat_timeline[0]), now_ms);
+}
 
-static void draw_cat_frame(uint8_t tail_up, const char *overall_quality);//declaration for cat drawing function   
+void ui_cat_set_aqi(uint16_t aqi)
+{
+    cat_aqi = aqi;
+}
 
-//cat animation with moving tail, text shows overall air quality
-void ui_show_cat(const char *overall_quality)
+uint16_t ui_cat_update(uint32_t now_ms)
 {
-    // 6 frames, 500ms = 3 seconds animation
-    for (uint8_t i = 0; i < 6; i++)
-    {
-        uint8_t tail_up = (i & 1);// alternate cat's tail position 
+    return anim_update(&cat_anim, now_ms);
+}
 
-        draw_cat_frame(tail_up, overall_quality);
-        oled_display();
-        _delay_ms(500);
-    }
+void ui_cat_stop(void)
+{
+    anim_stop(&cat_anim);
+}
 
-    ui_force_redraw();//after animation we force full redraw of normal screens
+void ui_cat_get_stats(anim_stats_t *out)
+{
+    *out = cat_anim.stats;
 }
 
 // drawing one frame of the cat with tail position and overall air quality text function
-static void draw_cat_frame(uint8_t tail_up, const char *overall_quality)
+static void draw_cat_frame(void)
 {
-    oled_clear_buffer();
-
     // cat's body rectangle
     uint8_t x1 = 44;
     uint8_t y1 = 16;
@@ -260,7 +268,7 @@ static void draw_cat_frame(uint8_t tail_up, const char *overall_quality)
     oled_drawLine(74, 44, 74, 48, WHITE);
 
     // drawing tail with two positions 
-    if (tail_up)
+    if (cat_tail)
     {
         oled_drawLine(x2,   34, x2+10, 22, WHITE);
         oled_drawLine(x2+10,22, x2+10, 34, WHITE);
@@ -271,8 +279,8 @@ static void draw_cat_frame(uint8_t tail_up, const char *overall_quality)
         oled_drawLine(x2+10,46, x2+10, 34, WHITE);
     }
 
-    //text label under the cat with combined air quality
-    oled_gotoxy(2, 7);
-    oled_puts("Air quality: ");
-    oled_puts(overall_quality);
+    //text label under the cat with combined air quality index
+    oled_gotoxy(0, 7);
+    oled_puts("AQI: ");
+    put_aqi(cat_aqi, aqi_category(cat_aqi));
 }
@@ -2,57 +2,75 @@
 #define UI_H
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "anim.h"
 
 /**
  * @brief Draw screen with temperature, humidity and CO2 values
  *
- * @param t         Temperature in 0C
- * @param h         Humidity in %
- * @param co2_q     Text label for CO2 quality
- * @param co2_raw   Raw ADC value from mq135 sensor.
- *
- * draws static labels once, then updates only the numeric values.
+ * Screens are draw routines for oled_render(), labels and values are drawn
+ * each time and only changed parts reach the display.
+ * Values are read from the sensor records, "--" until first measurement.
  * Used as the main environment values screen.
  */
-void screen_temp_hum_values(int t, int h, const char *co2_q, uint16_t co2_raw);
+void screen_temp_hum_values(void);
 
 /**
  * @brief Draw screen with qualitative air levels for T/H/CO2
  *
- * @param t_q   Quality string for temperature
- * @param h_q   Quality string for humidity
- * @param co2_q Quality string for CO2 from mq135
- *
- * Shows the "GOOD / NORMAL / BAD" summary for the environmental sensors
+ * Shows the comfort level of temperature and humidity and the gas index
+ * category, or ERR/STALE from the sensor records
  */
-void screen_temp_hum_levels(const char *t_q, const char *h_q, const char *co2_q);
+void screen_temp_hum_levels(void);
 
 /**
  * @brief Draw numeric PM2.5 and PM10 values
  *
- * @param pm25_10  PM2.5 multiplied by 10
- * @param pm10_10  PM10 multiplied by 10
+ * Displays PM concentrations from the sensor records, each with its
+ * 1 h and 24 h mean from history_get().
+ */
+void screen_pm_values(void);
+
+/**
+ * @brief Draw PM2.5 and PM10 sub-indices
  *
- * Displays PM concentrations using values read from the sds018 sensor.
+ * shows the index and its category, for example "57 MODERATE".
  */
-void screen_pm_values(int pm25_10, int pm10_10);
+void screen_pm_levels(void);
 
 /**
- * @brief Draw qualitative PM2.5 and PM10 levels
+ * @brief Start animated cat screen with overall air quality
  *
- * @param pm25_q   Quality label for PM2.5
- * @param pm10_q   Quality label for PM10
+ * @param aqi     Overall index from aqi_overall()
+ * @param now_ms  Current time in ms
  *
- * shows the "GOOD / NORMAL / BAD" for particulate matter.
+ * Does not draw anything, frames are drawn by ui_cat_update().
+ */
+void ui_cat_start(uint16_t aqi, uint32_t now_ms);
+
+/**
+ * @brief Change the index shown under the cat, used from next frame
  */
-void screen_pm_levels(const char *pm25_q, const char *pm10_q);
+void ui_cat_set_aqi(uint16_t aqi);
 
 /**
- * @brief Reset UI screen state
+ * @brief Draw next cat frame when it is due, returns immediately
+ *
+ * @param now_ms  Current time in ms
  *
- * Forces the next screen function to fully redraw it\s static layout
- * Used when animation or screen switching 
+ * @return ms until next frame, ANIM_DONE when the 3 s animation finished
+ */
+uint16_t ui_cat_update(uint32_t now_ms);
+
+/**
+ * @brief Stop the cat animation, used when another screen is shown
+ */
+void ui_cat_stop(void);
+
+/**
+ * @brief Copy frame count and per-frame render time of the cat
  */
-void ui_force_redraw(void);
+void ui_cat_get_stats(anim_stats_t *out);
 
 #endif
@@ -1,5 +1,7 @@
 #include <avr/io.h> // Core AVR I/O definitions (registers, ports, bit operations)
-#include <util/delay.h> //provides _delay_ms() and _delay_us() functions for timing
+#include <avr/interrupt.h> // sei() for interrupt driven sensor drivers
+#include <avr/pgmspace.h> // configuration tables in flash
+#include <avr/wdt.h> // watchdog resets the board when the main loop hangs
 #include <stdlib.h>//Standard library utilities
 
 #include "oled.h" //OLED display driver (initialization, drawing, text rendering)
@@ -9,241 +11,529 @@
 #include "dht11.h"
 #include "mq135.h"
 #include "sds018.h"
+#include "tick.h"
+#include "adc.h"
+#include "filter.h"
+#include "anomaly.h"
+#include "history.h"
+#include "aqi.h"
+#include "sensors.h"
+#include "sched.h"
+#include "notify.h"
+#include "power.h"
+#include "buttons.h"
+#include "sram.h"
+
+#define DHT11_INTERVAL_MS 2000 // time between two DHT11 measurements
+#define DHT11_POWERUP_MS  1000 // DHT11 ignores start pulses for 1 s after power on
+#define DHT11_READ_MS     50   // start pulse and response take ~25 ms, result is polled after this
+#define STARTUP_MS        2000 // MQ135 output settles after heater power on
+#define SPLASH_MS         1000 // splash is shown while the first values arrive
+#define SNAPSHOT_MS       1800000UL // last known values are saved to EEPROM every 30 minutes
+
+// Display power policy, time from the last event worth looking at
+#define DISPLAY_CONTRAST     0x3F   // normal contrast, same as oled init sequence
+#define DISPLAY_DIM_CONTRAST 0x01   // dimmed contrast
+#define DISPLAY_DIM_MS       60000UL  // dim after 1 minute
+#define DISPLAY_OFF_MS       0        // display sleep time, 0 = never (mains powered), e.g. 300000UL on battery
+
+// Buttons, rows of BUTTONS_CFG_TABLE in board.h
+#define BUTTON_NEXT (1 << 0) // next screen
+#define BUTTON_PREV (1 << 1) // previous screen
+#define BUTTON_HOLD (1 << 2) // stop/restart rotation
+
+// Driver instances, rows of the tables in board.h
+#define TH_SENSOR 0 // DHT11 for temperature and humidity
+#define PM_SENSOR 0 // SDS018 for PM2.5 and PM10
+
+// Longest task is one full display transfer (~100 ms at 100 kHz),
+// DHT11/SDS018/ADC never block and each TWI byte waits at most TWI_TIMEOUT_MS,
+// so the shortest watchdog period well above that is used
+#define WATCHDOG_TIMEOUT WDTO_1S
+
+// Duty cycle of the SDS018: laser and fan are on only during short bursts,
+// the burst is repeated more often while PM2.5 is rising
+static const sds018_policy_t pm_policy = {
+    .interval_ms     = 300000UL, // 5 minutes sleep while PM is stable
+    .min_interval_ms = 60000UL,  // 1 minute sleep while PM is climbing
+    .spinup_ms       = 20000,    // fan needs some time to get stable air flow
+    .frames          = 5,        // average of 5 frames per burst
+    .adaptive        = 1,
+    .rise_10         = 50,       // +5.0 ug/m3 between bursts means climbing
+};
+
+
+// Sensor channels passed through filter stages and hysteresis classifier
+enum {
+    CH_TEMP = 0,
+    CH_HUM,
+    CH_MQ,
+    CH_PM25,
+    CH_PM10,
+    CH_COUNT
+};
+
+// Filter stages of each channel, applied in table order
+static const filter_cfg_t filter_cfg[] PROGMEM = {
+    { CH_TEMP, FILTER_MEDIAN, 3 }, // DHT11 sometimes returns one wrong reading
+    { CH_HUM,  FILTER_MEDIAN, 3 },
+    { CH_MQ,   FILTER_MEDIAN, 5 }, // remove ADC spikes first
+    { CH_MQ,   FILTER_EWMA,   2 }, // then smooth, alpha = 1/4
+    { CH_PM25, FILTER_MEDIAN, 3 }, // drop single glitched PM burst
+    { CH_PM10, FILTER_MEDIAN, 3 },
+};
+
+#define FILTER_STAGES (sizeof(filter_cfg) / sizeof(filter_cfg[0]))
+
+static filter_t filters[FILTER_STAGES]; // 24 bytes per stage
+
+// Comfort bands GOOD -> NORMAL -> BAD of temperature and humidity, thresholds are
+// distance from the comfortable value. Air pollution is rated by the AQI engine.
+#define COMFORT_TEMP 23 // 0C
+#define COMFORT_HUM  45 // %
+static const int16_t th_temp[2] PROGMEM = { 4, 9 };   // 20..26 0C good, 15..31 0C normal
+static const int16_t th_hum[2]  PROGMEM = { 16, 26 }; // 30..60 % good, 20..70 % normal
+
+// Overall AQI category that wakes the display, with the same classifier. Thresholds
+// are the first index of each category above GOOD, the bins of aqi_category().
+// Printed categories are the plain bins, so they always match the printed index.
+static const int16_t th_aqi[AQI_HAZARDOUS] PROGMEM = { 51, 101, 151, 201, 301 };
+#define AQI_BAND 3 // index points a category border must be passed by
+
+static uint8_t quality_level[CH_MQ]; // comfort level of temperature and humidity, 0 = GOOD
+static uint8_t overall_level;        // overall AQI category with hysteresis
+
+// Spike detectors of gas and PM channels, the UI jumps to the screen with the value on a new event
+static const anomaly_cfg_t gas_anomaly = { 6, 4, 80 };  // ~1 Hz samples, mean over ~1 minute, at least +80 counts of the 12 bit value
+static const anomaly_cfg_t pm_anomaly  = { 3, 4, 100 }; // one sample per burst, mean over 8 bursts, at least +10 ug/m3
+
+static anomaly_t detectors[3]; // CH_MQ, CH_PM25, CH_PM10, 10 bytes each
+
+// Feed a sample into the detector of the channel, returns 1 when new event started
+static uint8_t anomaly_check(uint8_t ch, int16_t x, const anomaly_cfg_t *cfg)
+{
+    return anomaly_update(&detectors[ch - CH_MQ], cfg, x) == ANOMALY_START;
+}
+
+static void filters_init(void)
+{
+    for (uint8_t i = 0; i < FILTER_STAGES; i++)
+        filter_init(&filters[i], pgm_read_byte(&filter_cfg[i].type), pgm_read_byte(&filter_cfg[i].param));
 
+    for (uint8_t i = 0; i < sizeof(detectors) / sizeof(detectors[0]); i++)
+        anomaly_init(&detectors[i]);
+}
 
-// Converts a numeric measurement into a qualitative label.
-// This helper is used for temperature, humidity, and PM values.
-// Input parameter:
-//    v  – integer value representing a sensor reading
+// Pass a new sample through all filter stages of its channel
+static int16_t filter_channel(uint8_t ch, int16_t x)
+{
+    for (uint8_t i = 0; i < FILTER_STAGES; i++)
+    {
+        if (pgm_read_byte(&filter_cfg[i].channel) == ch)
+            x = filter_apply(&filters[i], x);
+    }
+    return x;
+}
+
+// Converts a filtered measurement into a comfort level.
+// Level of the channel changes only when the value crosses a threshold
+// by more than band, so noise around a threshold does not flip the label.
+// Input parameters:
+//    ch – channel index CH_xxx
+//    v  – distance of the value from the comfortable one
+//    th – two thresholds in PROGMEM
+//    band – hysteresis in units of v
 // Returns:
-//    "GOOD", "NORMAL", or "BAD" depending on predefined thresholds.
-static const char *quality_from_value(int v)
+//    LEVEL_GOOD, LEVEL_NORMAL or LEVEL_BAD
+static uint8_t quality_from_value(uint8_t ch, int16_t v, const int16_t *th, int16_t band)
 {
-    if (v < 30)      return "GOOD";
-    else if (v < 60) return "NORMAL";
-    else             return "BAD";
+    if (v < 0) v = -v; // too cold is as bad as too hot
+
+    return filter_hysteresis(&quality_level[ch], v, th, 2, band);
 }
 
+// Store a pollutant with its AQI sub-index and EPA category
+static void sensors_set_aqi(uint8_t id, int16_t value, uint16_t index)
+{
+    sensors_set(id, value, index, aqi_category(index), tick_ms());
+}
 
-// Converts a quality string (GOOD, NORMAL, BAD, ERR) into a numeric score.
-// This is used to compute the overall environment score.
-// Input:
-//    q – pointer to a quality string (may be NULL)
-// Returns:
-//    0 → GOOD
-//    1 → NORMAL
-//    2 → BAD or ERR
-static int quality_to_score(const char *q)
+// Screens shown in rotation:
+// 0 – animated cat screen
+// 1 – temperature/humidity/CO2 values
+// 2 – T/H/CO2 quality levels
+// 3 – PM2.5/PM10 values
+// 4 – PM2.5/PM10 quality levels
+#define SCREEN_COUNT 5
+static const uint8_t screen_seconds[SCREEN_COUNT] PROGMEM = { 3, 5, 2, 5, 2 }; // time on each screen
+
+// Sensor records drawn on each screen, the screen is redrawn only when one of them changed
+#define TOPICS_ENV (NOTIFY_TOPIC(SENSOR_TEMP) | NOTIFY_TOPIC(SENSOR_HUM) | NOTIFY_TOPIC(SENSOR_CO2))
+#define TOPICS_PM  (NOTIFY_TOPIC(SENSOR_PM25) | NOTIFY_TOPIC(SENSOR_PM10))
+#define TOPICS_AQI (NOTIFY_TOPIC(SENSOR_CO2) | TOPICS_PM) // inputs of the overall index
+static const uint8_t screen_topics[SCREEN_COUNT] PROGMEM = { TOPICS_AQI, TOPICS_ENV, TOPICS_ENV, TOPICS_PM, TOPICS_PM };
+
+static uint8_t screen;           // current screen
+static uint8_t screen_dirty;     // screen changed, must be drawn even without new data
+static uint8_t screen_hold;      // rotation stopped by the hold button
+static uint32_t screen_start_ms; // time the current screen was shown first
+static uint8_t render_task;      // id of render task, triggered on screen change
+static uint8_t anim_task;        // id of cat animation task, triggered when next frame is due
+static uint8_t dht_task;         // id of DHT11 task, triggered to read the result of a started measurement
+static uint8_t dht_reading;      // DHT11 measurement was started by the previous run
+static uint32_t snapshot_ms;     // time of last EEPROM snapshot
+static volatile uint16_t splash_ms; // ms from reset to splash on the panel, read by debugger or simulator
+static volatile uint16_t sram_peak_bytes; // static data plus deepest stack so far, read by debugger or simulator
+static uint8_t watchdog_reset;   // last reset was done by the watchdog, told on the splash
+
+// Display power state
+enum {
+    DISPLAY_ON = 0,
+    DISPLAY_DIM,
+    DISPLAY_OFF
+};
+static uint8_t display_state;
+static uint32_t display_event_ms; // last event which woke the display
+
+static uint8_t score_sub;    // overall index subscriber, recomputed only after a pollutant changed
+static uint8_t ui_sub;       // render subscriber
+static uint16_t overall_aqi; // cached worst sub-index
+
+// Show a screen now, used by rotation and by spike detectors
+static void show_screen(uint8_t s)
+{
+    screen = s;
+    screen_dirty = 1;
+    ui_cat_stop(); // cat is started again by the render if s is the cat screen
+    sched_stop(anim_task);
+    screen_start_ms = tick_ms();
+    sched_trigger(render_task, 0);
+}
+
+// Restore full contrast after an event, the display dims again after DISPLAY_DIM_MS
+static void display_wake(void)
 {
-    if (q == NULL) return 1;
+    display_event_ms = tick_ms();
 
-    switch (q[0])
+    if (display_state == DISPLAY_ON)
+        return;
+
+    if (display_state == DISPLAY_OFF)
     {
-        case 'G': // GOOD case
-            return 0;
-        case 'N': // NORMAL cse
-            return 1;
-        case 'B': // BAD case
-            return 2;
-        case 'E': // ERR case same as bad case
-            return 2;
-        default:
-            return 1; //  NORMAL. Any unknown input
+        oled_sleep(0); // panel on
+        screen_dirty = 1; // cat animation was stopped, draw the screen again
+        sched_trigger(render_task, 0);
     }
+    oled_set_contrast(DISPLAY_CONTRAST);
+    display_state = DISPLAY_ON;
 }
 
-// Converts a numeric score (0–2) back into a quality string.
-// Input:
-//    s – integer score produced by quality_to_score():
-//         0 → GOOD
-//         1 → NORMAL
-//         2 → BAD (or higher values)
-// Returns:
-//    A string constant representing the corresponding quality category.
-static const char *score_to_quality(int s)
+// Dim and switch off the display when nothing happened for a while
+static void display_policy(void)
 {
-    if (s <= 0)       return "GOOD";
-    else if (s == 1)  return "NORMAL";
-    else              return "BAD";  // score 2 or any higher value to BAD
+    uint32_t quiet_ms = tick_ms() - display_event_ms;
+
+    if (display_state == DISPLAY_ON && quiet_ms >= DISPLAY_DIM_MS)
+    {
+        oled_set_contrast(DISPLAY_DIM_CONTRAST);
+        display_state = DISPLAY_DIM;
+    }
+#if DISPLAY_OFF_MS
+    else if (display_state == DISPLAY_DIM && quiet_ms >= DISPLAY_OFF_MS)
+    {
+        ui_cat_stop();
+        sched_stop(anim_task);
+        oled_sleep(YES); // panel off, RAM content is kept
+        display_state = DISPLAY_OFF;
+    }
+#endif
 }
 
-int main(void)
+// MQ135, ~1 Hz: gas filter, baseline tracking, ppm and spike detector
+static void task_gas(void)
 {
-    oled_init(OLED_DISP_ON); // initialize the OLED display hardware and turn it on
-    oled_charMode(NORMALSIZE); // set normal character rendering mode for text drawing
+    adc_service(); // runs ADC scan in noise reduction sleep if enabled, otherwise the scan runs in ADC interrupt
 
-    // initialize all sensors
-    dht11_init();
-    mq135_init();
-    sds018_init();
-
-    _delay_ms(2000); // waiting for stabilization all sensors before the first measurement
-
-    int temp = 25; // Initial temperature value in °C (used until the first DHT11 reading succeeds).
-    int hum = 50; // Initial humidity value in percent before real data is available 
-    uint16_t pm25_10 = 150; // Initial PM2.5 concentration in tenths of ug/m3 (150 = 15.0 ug/m3)
-    uint16_t pm10_10 = 200; // Initial PM10 concentration
-    uint16_t mq_raw = 0; //  raw analog value from MQ135 (0–1023), updated in the main loop.
-    const char *mq_quality = "GOOD"; // Initial qualitative air rating from MQ135
-
-    // Qualitative rating for temperature. Updated after each DHT11 reading
-    const char *temp_q = "GOOD";
-    const char *hum_q  = "GOOD";
-    const char *co2_q  = "GOOD";   
-    const char *pm25_q = "GOOD";
-    const char *pm10_q = "GOOD";
-
-    // Current screen index used by the UI state machine:
-    // 0 – animated cat screen
-    // 1 – temperature/humidity/CO2 values
-    // 2 – T/H/CO2 quality levels
-    // 3 – PM2.5/PM10 values
-    // 4 – PM2.5/PM10 quality levels
-    uint8_t screen = 0;
-    uint8_t seconds_in_screen = 0;
+    uint16_t mq_adc = filter_channel(CH_MQ, mq135_read_oversampled()); // median + EWMA of the 12 bit value, does not wait for conversion
+    mq135_baseline_update(mq_adc, tick_ms()); // track clean air R0, checkpointed to EEPROM
+    uint16_t mq_ppm = mq135_get_ppm(mq_adc); // fixed point ppm estimate from lookup table
+    sensors_set_aqi(SENSOR_CO2, mq_ppm, aqi_gas(mq_ppm));
 
-    while (1)
+    if (anomaly_check(CH_MQ, mq_adc, &gas_anomaly))
+    {
+        show_screen(1); // gas leak or smoke, show the CO2 value
+        display_wake();
+    }
+}
+
+// SDS018 duty cycle. Frames are received in background by the UART interrupt,
+// the sampler returns 0 only when a new burst average is ready
+static void task_pm(void)
+{
+    uint16_t pm25_tmp;
+    uint16_t pm10_tmp;
+
+    if (sds018_sampler_update(PM_SENSOR, tick_ms(), &pm25_tmp, &pm10_tmp) == 0)
     {
-        mq_raw     = mq135_read_raw(); // read raw analog value from MQ135
-        mq_quality = mq135_get_quality(mq_raw); // Convert MQ135 raw value into a qualitative label 
-        co2_q      = mq_quality; // Use MQ135 quality as the co2 qualitative indicator  
-
-        // convert all qualitative labels into numeric scores. GOOD=0, NORMAL=1, BAD/ERR = 2
-        int s_temp = quality_to_score(temp_q);
-        int s_hum  = quality_to_score(hum_q);
-        int s_co2  = quality_to_score(co2_q);
-        int s_pm25 = quality_to_score(pm25_q);
-        int s_pm10 = quality_to_score(pm10_q);
-
-        // The goal is to produce a single "overall air quality" rating
-        // We do this by taking the arithmetic mean of all scores
-        // This averaged value is then used on the animated cat screen,
-        // where the cat displays the combined air-quality state
-        int avg_score = (s_temp + s_hum + s_co2 + s_pm25 + s_pm10) / 5;
-        const char *overall_quality = score_to_quality(avg_score); // сonvvert averaged score back into a qualitative word
-
-        switch (screen)
+        uint16_t pm25_10 = filter_channel(CH_PM25, pm25_tmp); // if we got for example 253 value, that means 25.3 ug/m3
+        uint16_t pm10_10 = filter_channel(CH_PM10, pm10_tmp);
+        history_add(HIST_PM25, pm25_10);
+        history_add(HIST_PM10, pm10_10);
+
+        // sub-indices change only with a new burst
+        sensors_set_aqi(SENSOR_PM25, pm25_10, aqi_pm25(pm25_10));
+        sensors_set_aqi(SENSOR_PM10, pm10_10, aqi_pm10(pm10_10));
+
+        // both detectors must see every sample, so no short-circuit here
+        if (anomaly_check(CH_PM25, pm25_10, &pm_anomaly) | anomaly_check(CH_PM10, pm10_10, &pm_anomaly))
         {
+            show_screen(3); // smoke or dust, show PM values
+            display_wake();
+        }
+    }
+    history_update(tick_ms()); // roll 15 minute and 2 hour buckets
+}
+
+// DHT11, every DHT11_INTERVAL_MS: start a measurement, take its result DHT11_READ_MS later
+static void task_dht(void)
+{
+    //temporary variable for raw temp/hum reading from dht11
+    int16_t t_read = 0; 
+    int16_t h_read = 0;
+
+    if (!dht_reading)
+    {
+        dht11_start(TH_SENSOR); // DHT11 needs at least 1 s between measurements, period is 2 s
+        dht_reading = 1;
+        sched_trigger(dht_task, DHT11_READ_MS); // period continues from this release
+        return;
+    }
+    dht_reading = 0;
+
+    // DHT11 is measured in background by timer and pin change interrupts,
+    // status is the final result, DHT11_BUSY only if the sensor is very slow
+    uint8_t dht_status = dht11_poll(TH_SENSOR, &t_read, &h_read);
+
+    if (dht_status == DHT11_OK)
+    {
+        // Update stored temperature/hum with the new reading
+        int16_t temp = filter_channel(CH_TEMP, t_read); 
+        int16_t hum  = filter_channel(CH_HUM, h_read); 
+        mq135_set_env(temp, hum); // MQ135 resistance depends on temperature and humidity
+
+        // Store values with their comfort rating
+        sensors_set(SENSOR_TEMP, temp, 0, quality_from_value(CH_TEMP, temp - COMFORT_TEMP, th_temp, 1), tick_ms());
+        sensors_set(SENSOR_HUM, hum, 0, quality_from_value(CH_HUM, hum - COMFORT_HUM, th_hum, 2), tick_ms());
+    }
+    else if (dht_status == DHT11_ERR_TIMEOUT || dht_status == DHT11_ERR_CRC)
+    {
+        // mark temperature and humidity as error if dht is not working, last values are kept
+        uint8_t err = (dht_status == DHT11_ERR_TIMEOUT) ? SENSOR_ERR_TIMEOUT : SENSOR_ERR_CRC;
+        sensors_set_error(SENSOR_TEMP, err);
+        sensors_set_error(SENSOR_HUM, err);
+    }
+}
+
+// 100 Hz: debounced buttons, the render runs in the same scheduler pass.
+// Latency from press to redraw is in buttons_get_stats()
+static void task_buttons(void)
+{
+    uint8_t pressed = buttons_update(tick_ms());
+
+    if (!pressed)
+        return;
+
+    if (display_state == DISPLAY_OFF)
+    {
+        display_wake(); // first press only switches the panel on
+        return;
+    }
+    display_wake();
+
+    if (pressed & BUTTON_HOLD)
+    {
+        screen_hold = !screen_hold;
+        screen_start_ms = tick_ms(); // rotation continues with full time on this screen
+    }
+
+    if (pressed & BUTTON_NEXT)
+        show_screen(screen + 1 < SCREEN_COUNT ? screen + 1 : 0);
+    else if (pressed & BUTTON_PREV)
+        show_screen(screen ? screen - 1 : SCREEN_COUNT - 1);
+    else
+        buttons_handled(tick_ms()); // hold alone changes nothing on the display
+}
+
+// 1 Hz: staleness of sensor records, display power and screen rotation
+static void task_rotate(void)
+{
+    sensors_update_stale(tick_ms()); // flag sensors which stopped updating
+    display_policy();
+    sram_peak_bytes = sram_peak();
+
+    if (tick_ms() - snapshot_ms >= SNAPSHOT_MS)
+    {
+        snapshot_ms = tick_ms();
+        sensors_snapshot_save(); // restored as stale values after next power on
+    }
+
+    if (!screen_hold && tick_ms() - screen_start_ms >= 1000UL * pgm_read_byte(&screen_seconds[screen]))
+        show_screen(screen + 1 < SCREEN_COUNT ? screen + 1 : 0);
+}
+
+// 1 Hz and on screen change: draw current screen from sensor records
+static void task_render(void)
+{
+    // overall index is the worst sub-index, so one bad pollutant is enough to show a bad rating
+    if (notify_take(score_sub))
+    {
+        uint8_t old = overall_level;
+
+        overall_aqi = sensors_overall_aqi();
+        // hysteresis, so an index wandering around a border does not wake the display again and again
+        if (filter_hysteresis(&overall_level, overall_aqi, th_aqi, AQI_HAZARDOUS, AQI_BAND) > old)
+            display_wake(); // air got worse, worth a look
+    }
 
-            case 0:
-                // Display the animated cat screen and show the combined
-                // air-quality label underneath,
-                // The animation internally flips the tail position each frame.
-                ui_show_cat(overall_quality);   
-                _delay_ms(1000);
-
-                // Increase the time spent on this screen; after 3 seconds total,
-                // then move to the next screen
-                if (++seconds_in_screen >= 3) { 
-                    screen = 1; // go to temp/hum/co2 next screen
-                    seconds_in_screen = 0;
-                }
-                break;
-
-            case 1:
+    if (display_state == DISPLAY_OFF)
+        return; // nothing is visible, display_wake() draws the screen again
+
+    // changes of records not shown on this screen are dropped, a new screen draws them anyway
+    uint8_t changed = notify_take(ui_sub) & pgm_read_byte(&screen_topics[screen]);
+
+    if (!changed && !screen_dirty)
+        return; // nothing on the display would change, skip the redraw
+
+    switch (screen)
+    {
+        case 0:
+            // Animated cat screen with the overall index underneath. Frames are
+            // drawn by the animation task, a new index is shown with the next frame.
+            if (screen_dirty)
             {
-                //temporary variable for raw temp/hum reading from dht11
-                int16_t t_read = 0; 
-                int16_t h_read = 0;
-
-                // Call the DHT11 sensor driver to read temperature and humidity.
-                // status will be DHT11_OK if data is valid, otherwise an error code
-                uint8_t status = dht11_read(&t_read, &h_read);
-
-                if (status == DHT11_OK)
-                {
-                    // Update stored temperature/hum with the new reading
-                    temp = (int)t_read; 
-                    hum  = (int)h_read; 
-
-                    // Convert numeric temp and hum into qualitative rating
-                    temp_q = quality_from_value(temp);
-                    hum_q  = quality_from_value(hum);
-                }
-                else
-                {
-                    // mark temperature and humidity quality as error if dht is not working
-                    temp_q = "ERR";
-                    hum_q  = "ERR";
-                }
-
-                screen_temp_hum_values(temp, hum, co2_q, mq_raw); //draw the environmental screen
-
-                _delay_ms(1000);
-
-                if (++seconds_in_screen >= 5) {
-                    screen = 2; //go to the quality temp/hum levels next screen
-                    seconds_in_screen = 0;// reset counter for the next mode
-                }
+                ui_cat_start(overall_aqi, tick_ms());
+                sched_trigger(anim_task, 0);
+            }
+            else
+            {
+                ui_cat_set_aqi(overall_aqi);
             }
             break;
 
-            case 2:
-                //quality temp/hum levels screen
-                screen_temp_hum_levels(temp_q, hum_q, co2_q);
-                _delay_ms(1000);
+        case 1:
+            screen_temp_hum_values(); //draw the environmental screen
+            break;
 
-                if (++seconds_in_screen >= 2) {
-                    screen = 3; //switch to the PM numeric values screen
-                    seconds_in_screen = 0;// reset counter
-                }
-                break;
+        case 2:
+            screen_temp_hum_levels(); //quality temp/hum levels screen
+            break;
 
-            case 3:
-            {
-                //PM numeric values screen
-
-                // Create temporary variables to hold incoming PM10 and PM2,5 data
-                // We read into temporary buffers first, so in case of a failed read the previous valid measurements remain intact
-                uint16_t pm25_tmp = pm25_10;
-                uint16_t pm10_tmp = pm10_10;
-
-                //Attempt to read particle concentration values from the SDS018 sensor
-                // The function returns 0 when data is valid,on failure, old values are kept
-                uint8_t ok = sds018_read(&pm25_tmp, &pm10_tmp);
-                if (ok == 0)
-                {
-                    //update stored PM values only after a successful read
-                    pm25_10 = pm25_tmp;
-                    pm10_10 = pm10_tmp;
-                }
-
-                int pm25_int = pm25_10 / 10; // if we got for example 253 value, that means 25.3 ug/m3
-                int pm10_int = pm10_10 / 10;
-
-                //convert numeric values into qualitative air-quality labels
-                pm25_q = quality_from_value(pm25_int);
-                pm10_q = quality_from_value(pm10_int);
-
-                screen_pm_values((int)pm25_10, (int)pm10_10);//r ender the PM value screen, showing numeric particulate concentrations.
-
-                _delay_ms(1000);
-
-                // move on to the PM levels screen after 5seconds
-                if (++seconds_in_screen >= 5) {
-                    screen = 4;
-                    seconds_in_screen = 0;
-                }
-            }
+        case 3:
+            screen_pm_values(); // PM numeric values screen
             break;
 
-            case 4:
-            // PM levels screen
-                screen_pm_levels(pm25_q, pm10_q);
-                _delay_ms(1000);
-            // after 2 seconds, we return to screen 0 with cat animation 
-                if (++seconds_in_screen >= 2) {
-                    screen = 0;   
-                    seconds_in_screen = 0;
-                }
-                break;
-
-            default:
-            // Fallback state: if screen index somehow becomes invalid, force the system back to the animation screen
-                screen = 0;
-                seconds_in_screen = 0; //rst the timeout counter to avoid unexpected delays
-                break;
-        }
+        default:
+            screen_pm_levels(); // PM levels screen
+            break;
+    }
+    screen_dirty = 0;
+
+    if (screen != 0)
+        buttons_handled(tick_ms()); // screen after a press is on the panel, cat is drawn by task_anim
+}
+
+// Cat animation frames, re-triggered for the time of the next frame, so the
+// loop is free between the frames. Render cost is in ui_cat_get_stats().
+static void task_anim(void)
+{
+    uint16_t wait = ui_cat_update(tick_ms());
+    buttons_handled(tick_ms()); // first cat frame after a press is on the panel
+
+    if (wait != ANIM_DONE)
+        sched_trigger(anim_task, wait);
+}
+
+// Splash while sensors warm up, only its two text lines are sent to the panel
+static void draw_splash(void)
+{
+    oled_gotoxy(4, 2);
+    oled_puts_p(PSTR("AIR QUALITY"));
+    oled_gotoxy(4, 4);
+    if (watchdog_reset) // tell the user that the loop hung
+        oled_puts_p(PSTR("Watchdog reset"));
+    else
+        oled_puts_p(PSTR("starting..."));
+}
+
+int main(void)
+{
+    sram_paint(); // sram_peak() reports the deepest stack from here on
+
+    // after a watchdog reset the watchdog stays enabled with the shortest period,
+    // so it must be stopped before the slow initialization
+    uint8_t reset_flags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+
+    tick_init(); // millisecond time base for sensor duty cycle and I/O deadlines
+    power_init(tick_ms()); // stop unused peripherals, start active/sleep statistics
+    sei(); // enable interrupts, TWI deadlines need running tick
+
+    oled_init(OLED_DISP_ON); // initialize the OLED display hardware and turn it on
+    oled_charMode(NORMALSIZE); // set normal character rendering mode for text drawing
+
+    watchdog_reset = (reset_flags & (1 << WDRF)) != 0;
+    oled_render(draw_splash);
+    splash_ms = tick_ms();
+
+    // initialize all sensors
+    dht11_init();
+    buttons_init(); // presses are recorded from now, handled after the splash
+    mq135_init();
+    sds018_init(); // sds018 receives frames in background from now
+
+    filters_init(); // reset filter stages of all channels
+    sensors_init(); // no valid value until first measurement of each sensor
+    uint8_t restored = sensors_restore(); // last known values from EEPROM, marked stale
+
+    // Subscribers of sensor record changes, redraw and recompute counts are in notify_get_stats()
+    score_sub = notify_subscribe(TOPICS_AQI);
+    ui_sub = notify_subscribe(TOPICS_ENV | TOPICS_PM);
+
+    sds018_sampler_start(PM_SENSOR, &pm_policy, tick_ms()); // wake the sensor and start first burst
+    mq135_baseline_init(tick_ms()); // restore MQ135 calibration from EEPROM, heater warm-up starts now
+    history_init(tick_ms()); // 1 h / 24 h PM statistics, first bucket starts now
+
+    // Tasks in priority order: period, deadline, first release. Sensor tasks come first,
+    // so they run before the render when released together. Each sensor starts as soon
+    // as it can answer and the UI starts during their warm-up.
+    sched_add(task_pm,     100,               50,   0);
+    sched_add(task_gas,    1000,              100,  STARTUP_MS);
+    dht_task = sched_add(task_dht, DHT11_INTERVAL_MS, 100, DHT11_POWERUP_MS);
+    sched_add(task_buttons, 10,               10,   SPLASH_MS);
+    sched_add(task_rotate, 1000,              100,  SPLASH_MS);
+    render_task = sched_add(task_render, 1000, 500, SPLASH_MS);
+    anim_task = sched_add(task_anim, 0, 100, 0); // one-shot, started by the cat screen
+    sched_stop(anim_task);
+
+    // restored values are shown first, otherwise the cat screen. First real value
+    // of each sensor is in sensors_first_ms()
+    screen = (restored & TOPICS_ENV) ? 1 : 0;
+    screen_start_ms = tick_ms() + SPLASH_MS;
+    screen_dirty = 1;
+    display_event_ms = tick_ms(); // full contrast after power on
+    snapshot_ms = tick_ms();
+
+    wdt_enable(WATCHDOG_TIMEOUT); // from now the main loop must run at least every second
+
+    while (1)
+    {
+        wdt_reset(); // loop is alive
+
+        // run released tasks, sleep until the next interrupt when nothing was due,
+        // active/sleep ratio is in power_active_percent()
+        if (sched_run() == 0)
+            power_idle();
     }
 
     return 0;
@@ -0,0 +1,127 @@
+// Rising-spike detector fed with synthetic sensor signals, and its cycle cost.
+// Run with "pio test -e uno -f test_anomaly".
+
+#include <unity.h>
+#include <util/delay.h>
+#include "anomaly.h"
+#include "test_cycles.h"
+
+static const anomaly_cfg_t cfg = { 6, 4, 80 }; // gas channel in main.c
+
+static anomaly_t d;
+static uint16_t seed;
+
+// repeatable noise in -amp..amp
+static int16_t noise(int16_t amp)
+{
+    seed = seed * 25173 + 13849;
+    return (int16_t)((int32_t)(seed >> 4) * (2 * amp + 1) >> 12) - amp;
+}
+
+// feed n samples of base + noise, count of ANOMALY_START
+static uint16_t feed(uint16_t n, int16_t base, int16_t amp)
+{
+    uint16_t events = 0;
+
+    for (uint16_t i = 0; i < n; i++)
+        events += anomaly_update(&d, &cfg, base + noise(amp)) == ANOMALY_START;
+    return events;
+}
+
+void setUp(void)
+{
+    anomaly_init(&d);
+    seed = 1;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_step_detected(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(0, feed(300, 1000, 10));
+
+    TEST_ASSERT_EQUAL(ANOMALY_START, anomaly_update(&d, &cfg, 1300));
+    TEST_ASSERT_EQUAL(ANOMALY_ACTIVE, anomaly_update(&d, &cfg, 1300));
+    TEST_ASSERT_EQUAL(ANOMALY_ACTIVE, anomaly_update(&d, &cfg, 1300));
+
+    // the mean follows the new level, event ends and is not reported again
+    TEST_ASSERT_EQUAL_UINT16(0, feed(300, 1300, 10));
+    TEST_ASSERT_EQUAL(0, d.active);
+}
+
+static void test_falling_step_ignored(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(0, feed(300, 1000, 10));
+    TEST_ASSERT_EQUAL_UINT16(0, feed(300, 500, 10));
+}
+
+// no events until the spread has settled for one time constant
+static void test_warmup(void)
+{
+    for (uint8_t i = 0; i < (1 << cfg.shift); i++)
+        TEST_ASSERT_EQUAL(ANOMALY_NONE, anomaly_update(&d, &cfg, (i & 1) ? 3000 : 100));
+}
+
+// noise alone never gives an event, the spread follows its amplitude
+static void test_noise_no_events(void)
+{
+    static const int16_t amp[] = { 5, 40, 200, 1000 };
+
+    for (uint8_t i = 0; i < sizeof(amp) / sizeof(amp[0]); i++)
+    {
+        setUp();
+        TEST_ASSERT_EQUAL_UINT16(0, feed(2000, 2000, amp[i]));
+    }
+}
+
+// one huge spike moves the spread only by the clipped deviation
+static void test_deviation_clipped(void)
+{
+    feed(300, 1000, 0);
+    TEST_ASSERT_EQUAL_INT32(0, d.mad);
+
+    TEST_ASSERT_EQUAL(ANOMALY_START, anomaly_update(&d, &cfg, 30000));
+    TEST_ASSERT_EQUAL_INT32(((int32_t)cfg.min_delta << ANOMALY_FRAC) >> cfg.shift, d.mad);
+
+    // once the mean is back, a moderate rise is reported again
+    feed(300, 1000, 0);
+    TEST_ASSERT_EQUAL(ANOMALY_START, anomaly_update(&d, &cfg, 1000 + 4 * cfg.min_delta));
+}
+
+static void test_cycles(void)
+{
+    uint16_t worst = 0;
+    volatile uint8_t r;
+
+    feed(300, 1000, 40);
+    for (uint8_t i = 0; i < 64; i++)
+    {
+        int16_t x = (i & 8) ? 30000 : -30000 + noise(40); // clipped both ways, events start and end
+        cycles_start();
+        r = anomaly_update(&d, &cfg, x);
+        uint16_t c = cycles_stop();
+        if (c > worst)
+            worst = c;
+    }
+    (void)r;
+    cycles_report("anomaly_update worst", worst);
+    TEST_ASSERT_LESS_THAN(1000, worst); // budget for one sample of each of the 3 channels
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_step_detected);
+    RUN_TEST(test_falling_step_ignored);
+    RUN_TEST(test_warmup);
+    RUN_TEST(test_noise_no_events);
+    RUN_TEST(test_deviation_clipped);
+    RUN_TEST(test_cycles);
+    UNITY_END();
+
+    while (1);
+}
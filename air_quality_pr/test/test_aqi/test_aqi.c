@@ -0,0 +1,196 @@
+// AQI engine against the EPA breakpoint tables, every concentration, and its
+// worst-case cycle cost.
+// Run with "pio test -e uno -f test_aqi".
+
+#include <unity.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+#include <util/delay.h>
+#include "aqi.h"
+#include "test_cycles.h"
+
+// EPA breakpoints as published: concentration low/high, index low/high
+typedef struct {
+    uint16_t c_lo, c_hi, i_lo, i_hi;
+} epa_bp_t;
+
+static const epa_bp_t epa_pm25[] PROGMEM = { // 0.1 ug/m3, 2024 revision
+    {    0,   90,   0,  50 }, {   91,  354,  51, 100 }, {  355,  554, 101, 150 },
+    {  555, 1254, 151, 200 }, { 1255, 2254, 201, 300 }, { 2255, 3254, 301, 500 },
+};
+
+static const epa_bp_t epa_pm10[] PROGMEM = { // ug/m3
+    {   0,  54,   0,  50 }, {  55, 154,  51, 100 }, { 155, 254, 101, 150 },
+    { 255, 354, 151, 200 }, { 355, 424, 201, 300 }, { 425, 604, 301, 500 },
+};
+
+#define COUNT(t) (sizeof(t) / sizeof(t[0]))
+
+// EPA equation, rounded to nearest integer
+static uint16_t epa_index(const epa_bp_t *t, uint8_t n, uint16_t c)
+{
+    for (uint8_t i = 0; i < n; i++)
+    {
+        epa_bp_t b;
+        memcpy_P(&b, &t[i], sizeof(b));
+        if (c <= b.c_hi)
+        {
+            uint32_t num = (uint32_t)(b.i_hi - b.i_lo) * (c - b.c_lo) * 2 + (b.c_hi - b.c_lo);
+            return b.i_lo + num / (2UL * (b.c_hi - b.c_lo));
+        }
+    }
+    return AQI_MAX;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_pm25_every_concentration(void)
+{
+    for (uint16_t c = 0; c <= 3400; c++)
+    {
+        if (aqi_pm25(c) != epa_index(epa_pm25, COUNT(epa_pm25), c))
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(epa_index(epa_pm25, COUNT(epa_pm25), c), aqi_pm25(c), "PM2.5*10");
+    }
+}
+
+static void test_pm10_every_concentration(void)
+{
+    for (uint16_t c = 0; c <= 6200; c++)
+    {
+        uint16_t ref = epa_index(epa_pm10, COUNT(epa_pm10), c / 10); // EPA truncates PM10 to 1 ug/m3
+        if (aqi_pm10(c) != ref)
+            TEST_ASSERT_EQUAL_UINT16_MESSAGE(ref, aqi_pm10(c), "PM10*10");
+    }
+}
+
+static void test_breakpoints_exact(void)
+{
+    for (uint8_t i = 0; i < COUNT(epa_pm25); i++)
+    {
+        epa_bp_t b;
+        memcpy_P(&b, &epa_pm25[i], sizeof(b));
+        TEST_ASSERT_EQUAL_UINT16(b.i_lo, aqi_pm25(b.c_lo));
+        TEST_ASSERT_EQUAL_UINT16(b.i_hi, aqi_pm25(b.c_hi));
+
+        memcpy_P(&b, &epa_pm10[i], sizeof(b));
+        TEST_ASSERT_EQUAL_UINT16(b.i_lo, aqi_pm10(b.c_lo * 10));
+        TEST_ASSERT_EQUAL_UINT16(b.i_hi, aqi_pm10(b.c_hi * 10 + 9));
+    }
+}
+
+static void test_gas_bands(void)
+{
+    static const uint16_t ppm[]   = { 0, 800, 801, 1000, 1001, 1500, 1501, 2000, 2001, 5000, 5001, 10000, 10001, 65535 };
+    static const uint16_t index[] = { 0,  50,  51,  100,  101,  150,  151,  200,  201,  300,  301,   500,   500,   500 };
+
+    for (uint8_t i = 0; i < COUNT(ppm); i++)
+        TEST_ASSERT_EQUAL_UINT16(index[i], aqi_gas(ppm[i]));
+
+    uint16_t last = 0;
+    for (uint16_t c = 0; c <= 10000; c++) // never decreases with concentration
+    {
+        uint16_t v = aqi_gas(c);
+        TEST_ASSERT_TRUE(v >= last);
+        last = v;
+    }
+}
+
+static void test_categories(void)
+{
+    static const uint16_t border[] = { 50, 100, 150, 200, 300 };
+
+    TEST_ASSERT_EQUAL_UINT8(AQI_GOOD, aqi_category(0));
+    for (uint8_t i = 0; i < COUNT(border); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(AQI_GOOD + i, aqi_category(border[i]));
+        TEST_ASSERT_EQUAL_UINT8(AQI_GOOD + i + 1, aqi_category(border[i] + 1));
+    }
+    TEST_ASSERT_EQUAL_UINT8(AQI_HAZARDOUS, aqi_category(AQI_MAX));
+    TEST_ASSERT_EQUAL_UINT8(AQI_HAZARDOUS, aqi_category(0xFFFF));
+}
+
+static void assert_label(const char *expected, uint8_t category)
+{
+    char buf[16];
+
+    strcpy_P(buf, aqi_label_P(category));
+    TEST_ASSERT_EQUAL_STRING(expected, buf);
+}
+
+static void test_labels(void)
+{
+    assert_label("GOOD", AQI_GOOD);
+    assert_label("MODERATE", AQI_MODERATE);
+    assert_label("USG", AQI_USG);
+    assert_label("UNHEALTHY", AQI_UNHEALTHY);
+    assert_label("V.UNHEALTHY", AQI_VERY_UNHEALTHY);
+    assert_label("HAZARDOUS", AQI_HAZARDOUS);
+    assert_label("HAZARDOUS", 200);
+}
+
+static void test_overall_is_worst(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(aqi_pm25(400), aqi_overall(400, 100, 400));
+    TEST_ASSERT_EQUAL_UINT16(aqi_pm10(3000), aqi_overall(50, 3000, 400));
+    TEST_ASSERT_EQUAL_UINT16(aqi_gas(1800), aqi_overall(50, 100, 1800));
+}
+
+// every concentration of each sub-index, the slowest is the last segment
+static void test_cycles(void)
+{
+    uint16_t worst25 = 0, worst10 = 0, worst_gas = 0, worst_all = 0;
+    volatile uint16_t r;
+
+    for (uint16_t c = 0; c <= 6200; c++)
+    {
+        cycles_start();
+        r = aqi_pm25(c);
+        uint16_t t = cycles_stop();
+        if (t > worst25) worst25 = t;
+
+        cycles_start();
+        r = aqi_pm10(c);
+        t = cycles_stop();
+        if (t > worst10) worst10 = t;
+
+        cycles_start();
+        r = aqi_gas(c * 2);
+        t = cycles_stop();
+        if (t > worst_gas) worst_gas = t;
+
+        cycles_start();
+        r = aqi_overall(c / 2, c, c * 2);
+        t = cycles_stop();
+        if (t > worst_all) worst_all = t;
+    }
+    (void)r;
+    cycles_report("aqi_pm25 worst", worst25);
+    cycles_report("aqi_pm10 worst", worst10);
+    cycles_report("aqi_gas worst", worst_gas);
+    cycles_report("aqi_overall worst", worst_all);
+    TEST_ASSERT_LESS_THAN(AQI_OVERALL_CYCLES, worst_all);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pm25_every_concentration);
+    RUN_TEST(test_pm10_every_concentration);
+    RUN_TEST(test_breakpoints_exact);
+    RUN_TEST(test_gas_bands);
+    RUN_TEST(test_categories);
+    RUN_TEST(test_labels);
+    RUN_TEST(test_overall_is_worst);
+    RUN_TEST(test_cycles);
+    UNITY_END();
+
+    while (1);
+}
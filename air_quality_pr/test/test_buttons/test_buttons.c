@@ -0,0 +1,156 @@
+// Debouncing and latency statistics of the buttons with injected edges.
+// Run with "pio test -e uno -f test_buttons".
+
+#include <unity.h>
+#include <util/delay.h>
+#include "buttons.h"
+
+#define NEXT 0x01 // row 0 of BUTTONS_CFG_TABLE
+#define PREV 0x02 // row 1
+
+static buttons_stats_t before;
+
+// edges at the given offsets from t, pressed state alternates starting with state
+static void bounce(uint32_t t, uint8_t state, uint8_t other, const uint8_t *offsets, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++)
+        buttons_edge((i & 1) ? other : state, (uint16_t)(t + offsets[i]));
+}
+
+// call buttons_update() every ms from..to, OR of the results
+static uint8_t poll(uint32_t from, uint32_t to)
+{
+    uint8_t pressed = 0;
+
+    for (uint32_t t = from; t <= to; t++)
+        pressed |= buttons_update(t);
+    return pressed;
+}
+
+// release everything so the next test starts from a stable idle state
+static void release(uint32_t t)
+{
+    buttons_edge(0, (uint16_t)t);
+    poll(t, t + BUTTONS_DEBOUNCE_MS);
+}
+
+void setUp(void)
+{
+    buttons_get_stats(&before);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_bounce_reported_once(void)
+{
+    static const uint8_t edges[] = { 0, 2, 4, 5, 7 }; // ends pressed
+
+    bounce(1000, NEXT, 0, edges, sizeof(edges));
+    TEST_ASSERT_EQUAL_HEX8(0, poll(1000, 1007 + BUTTONS_DEBOUNCE_MS - 1));
+    TEST_ASSERT_EQUAL_HEX8(NEXT, buttons_update(1007 + BUTTONS_DEBOUNCE_MS));
+    TEST_ASSERT_EQUAL_HEX8(0, poll(1028, 1100)); // held, not repeated
+
+    buttons_stats_t st;
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(before.presses + 1, st.presses);
+    release(1200);
+}
+
+static void test_release_ignored(void)
+{
+    static const uint8_t press[] = { 0 };
+    static const uint8_t edges[] = { 0, 1, 3, 4, 6 }; // ends released
+
+    bounce(2000, NEXT, 0, press, sizeof(press));
+    TEST_ASSERT_EQUAL_HEX8(NEXT, poll(2000, 2050));
+
+    bounce(2100, 0, NEXT, edges, sizeof(edges));
+    TEST_ASSERT_EQUAL_HEX8(0, poll(2100, 2200));
+
+    buttons_stats_t st;
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(before.presses + 1, st.presses);
+}
+
+// second button pressed while the first one is held
+static void test_second_button(void)
+{
+    buttons_edge(NEXT, 3000);
+    TEST_ASSERT_EQUAL_HEX8(NEXT, poll(3000, 3030));
+    buttons_edge(NEXT | PREV, 3040);
+    TEST_ASSERT_EQUAL_HEX8(PREV, poll(3040, 3070));
+    release(3100);
+}
+
+// an edge from the ISR between reading now_ms and buttons_update() is newer than now
+static void test_edge_after_now(void)
+{
+    buttons_edge(NEXT, 4000);
+    TEST_ASSERT_EQUAL_HEX8(0, buttons_update(3999));
+    TEST_ASSERT_EQUAL_HEX8(NEXT, buttons_update(4000 + BUTTONS_DEBOUNCE_MS));
+    release(4100);
+}
+
+// ISR timestamps are 16 bit, the press crosses their overflow
+static void test_tick_wrap(void)
+{
+    static const uint8_t edges[] = { 0, 3, 8 };
+    uint32_t t = 0x1FFF0UL;
+
+    bounce(t, PREV, 0, edges, sizeof(edges));
+    TEST_ASSERT_EQUAL_HEX8(0, poll(t, t + 8 + BUTTONS_DEBOUNCE_MS - 1));
+    TEST_ASSERT_EQUAL_HEX8(PREV, buttons_update(t + 8 + BUTTONS_DEBOUNCE_MS));
+
+    buttons_handled(t + 40);
+    buttons_stats_t st;
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(40, st.last_ms); // from the first edge
+    release(t + 100);
+}
+
+static void test_latency_stats(void)
+{
+    static const uint8_t edges[] = { 0, 2, 5 };
+    buttons_stats_t st;
+
+    bounce(5000, NEXT, 0, edges, sizeof(edges));
+    TEST_ASSERT_EQUAL_HEX8(NEXT, poll(5000, 5030));
+    buttons_handled(5062);
+    buttons_handled(5100); // only the first call after a press counts
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(62, st.last_ms);
+    TEST_ASSERT_EQUAL_UINT16(before.presses + 1, st.presses);
+    uint16_t max = st.max_ms;
+    release(5200);
+
+    buttons_edge(PREV, 6000);
+    TEST_ASSERT_EQUAL_HEX8(PREV, poll(6000, 6030));
+    buttons_handled(6025);
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(25, st.last_ms);
+    TEST_ASSERT_EQUAL_UINT16(max, st.max_ms); // shorter one does not lower the maximum
+    TEST_ASSERT_GREATER_OR_EQUAL(62, st.max_ms);
+    release(6100);
+
+    buttons_handled(6200); // no press waiting
+    buttons_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(25, st.last_ms);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_bounce_reported_once);
+    RUN_TEST(test_release_ignored);
+    RUN_TEST(test_second_button);
+    RUN_TEST(test_edge_after_now);
+    RUN_TEST(test_tick_wrap);
+    RUN_TEST(test_latency_stats);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,44 @@
+#ifndef TEST_CYCLES_H
+#define TEST_CYCLES_H
+
+// CPU cycle count of a code section for benchmark tests. Timer1 runs
+// at F_CPU, so up to 65535 cycles (4 ms) can be measured. Interrupts
+// must be off while measuring (tests that need them for the display
+// use ATOMIC_BLOCK), the count is exact except for the few cycles of
+// starting and reading the timer.
+
+#include <avr/io.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+static inline void cycles_start(void)
+{
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = (1 << CS10); // no prescaler
+}
+
+static inline uint16_t cycles_stop(void)
+{
+    uint16_t c = TCNT1;
+    TCCR1B = 0;
+    return c;
+}
+
+// "name: n cycles" into the test log, n may be a sum of several measurements
+static inline void cycles_report(const char *name, uint32_t cycles)
+{
+    char buf[64];
+    char num[12];
+
+    strncpy(buf, name, sizeof(buf) - 16);
+    buf[sizeof(buf) - 16] = 0;
+    strcat(buf, ": ");
+    strcat(buf, ultoa(cycles, num, 10));
+    strcat(buf, " cycles");
+    TEST_MESSAGE(buf);
+}
+
+#endif
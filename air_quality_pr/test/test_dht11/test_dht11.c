@@ -0,0 +1,136 @@
+// Edge decoder of the DHT11 driver fed with synthetic responses.
+// Run with "pio test -e uno -f test_dht11".
+
+#include <unity.h>
+#include <util/delay.h>
+#include "dht11.h"
+
+#define TICKS_PER_US 2       // Timer1 with prescaler 8 at 16 MHz
+#define T0           0xFE00  // first edge, the response crosses the 16-bit timer overflow
+#define NO_SKIP      0xFF
+
+static dht11_decoder_t dec;
+static uint16_t end_ticks; // timestamp of the last edge fed
+
+#define US(us) ((us) * TICKS_PER_US)
+
+// Sensor response: LOW 80 us, HIGH 80 us, then per bit LOW 50 us and HIGH
+// zero or one ticks. Edge number skip is lost, DHT11_BUSY if no result came.
+static uint8_t feed(const uint8_t *data, uint16_t zero, uint16_t one, uint8_t skip)
+{
+    uint16_t t = T0;
+    uint8_t edge = 0;
+    uint8_t status = DHT11_BUSY;
+
+#define EDGE(level, after)                                                  \
+    do {                                                                    \
+        t += (after);                                                       \
+        if (edge++ != skip && status == DHT11_BUSY)                         \
+            status = dht11_decode_edge(&dec, level, t, TICKS_PER_US);       \
+    } while (0)
+
+    dht11_decoder_reset(&dec);
+    EDGE(0, 0);
+    EDGE(1, US(80));
+    uint16_t high = US(80);
+    for (uint8_t i = 0; i < 40; i++)
+    {
+        EDGE(0, high);
+        EDGE(1, US(50));
+        high = (data[i >> 3] & (0x80 >> (i & 7))) ? one : zero;
+    }
+    EDGE(0, high);
+    EDGE(1, US(50)); // sensor releases the line, edge 83
+#undef EDGE
+
+    end_ticks = t;
+    return status;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_good_frame(void)
+{
+    static const uint8_t data[5] = { 45, 0, 23, 0, 68 };
+
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(data, US(27), US(70), NO_SKIP));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, dec.data, 5);
+}
+
+static void test_all_bits(void)
+{
+    static const uint8_t data[5] = { 0xFF, 0x00, 0xAA, 0x55, 0xFE };
+
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(data, US(27), US(70), NO_SKIP));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, dec.data, 5);
+}
+
+static void test_bad_checksum(void)
+{
+    static const uint8_t data[5] = { 45, 0, 23, 0, 69 };
+
+    TEST_ASSERT_EQUAL(DHT11_ERR_CRC, feed(data, US(27), US(70), NO_SKIP));
+}
+
+// every lost edge leaves the decoder waiting, the compare match timeout ends it
+static void test_missing_edge(void)
+{
+    static const uint8_t data[5] = { 45, 0, 23, 0, 68 };
+
+    for (uint8_t skip = 0; skip < 83; skip++)
+        TEST_ASSERT_EQUAL_MESSAGE(DHT11_BUSY, feed(data, US(27), US(70), skip), "edge lost");
+
+    // slowest valid response (all ones) ends well before the timeout
+    static const uint8_t ones[5] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFC };
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(ones, US(27), US(70), NO_SKIP));
+    TEST_ASSERT((uint16_t)(end_ticks - T0) < (uint16_t)(DHT11_TIMEOUT_US * TICKS_PER_US));
+}
+
+// HIGH pulse of exactly DHT11_BIT1_US is still 0, one timer tick longer is 1
+static void test_bit_threshold(void)
+{
+    static const uint8_t data[5] = { 0x0F, 0x33, 0x01, 0x80, 0xC3 };
+    static const uint8_t ones[5] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(data, US(DHT11_BIT1_US), US(70), NO_SKIP));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, dec.data, 5);
+
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(data, US(26), US(DHT11_BIT1_US) + 1, NO_SKIP));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, dec.data, 5);
+
+    TEST_ASSERT_EQUAL(DHT11_ERR_CRC, feed(data, US(DHT11_BIT1_US) + 1, US(70), NO_SKIP));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(ones, dec.data, 5);
+}
+
+// edges of other pins in the same pin change group repeat the current level
+static void test_repeated_level_ignored(void)
+{
+    static const uint8_t data[5] = { 45, 0, 23, 0, 68 };
+
+    dht11_decoder_reset(&dec);
+    TEST_ASSERT_EQUAL(DHT11_BUSY, dht11_decode_edge(&dec, 1, 0, TICKS_PER_US));
+    TEST_ASSERT_EQUAL(0, dec.falls);
+    TEST_ASSERT_EQUAL(DHT11_OK, feed(data, US(27), US(70), NO_SKIP));
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_good_frame);
+    RUN_TEST(test_all_bits);
+    RUN_TEST(test_bad_checksum);
+    RUN_TEST(test_missing_edge);
+    RUN_TEST(test_bit_threshold);
+    RUN_TEST(test_repeated_level_ignored);
+    UNITY_END();
+
+    while (1);
+}
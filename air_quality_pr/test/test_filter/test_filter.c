@@ -0,0 +1,196 @@
+// Step responses of the filter stages and hysteresis classifier.
+// Run with "pio test -e uno -f test_filter".
+
+#include <unity.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include "filter.h"
+#include "test_cycles.h"
+
+static const int16_t thresholds[] PROGMEM = { 100, 200 };
+
+static filter_t f;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_none_passes_through(void)
+{
+    filter_init(&f, FILTER_NONE, 0);
+    TEST_ASSERT_EQUAL_INT16(-123, filter_apply(&f, -123));
+    TEST_ASSERT_EQUAL_INT16(4000, filter_apply(&f, 4000));
+}
+
+static void test_median_removes_spike(void)
+{
+    static const int16_t in[]  = { 10, 10, 900, 10, 10, -900, 10 };
+
+    filter_init(&f, FILTER_MEDIAN, 3);
+    for (uint8_t i = 0; i < sizeof(in) / sizeof(in[0]); i++)
+        TEST_ASSERT_EQUAL_INT16(10, filter_apply(&f, in[i]));
+}
+
+static void test_median_step(void)
+{
+    // window 5: step shows when 3 of 5 samples are new
+    static const int16_t out[] = { 0, 0, 100, 100, 100 };
+
+    filter_init(&f, FILTER_MEDIAN, 5);
+    for (uint8_t i = 0; i < 5; i++)
+        filter_apply(&f, 0);
+    for (uint8_t i = 0; i < sizeof(out) / sizeof(out[0]); i++)
+        TEST_ASSERT_EQUAL_INT16(out[i], filter_apply(&f, 100));
+}
+
+static void test_median_duplicates(void)
+{
+    static const int16_t in[]  = { 5, 5, 7, 5, 7, 7, 7 };
+    static const int16_t out[] = { 5, 5, 5, 5, 7, 7, 7 };
+
+    filter_init(&f, FILTER_MEDIAN, 3);
+    for (uint8_t i = 0; i < sizeof(in) / sizeof(in[0]); i++)
+        TEST_ASSERT_EQUAL_INT16(out[i], filter_apply(&f, in[i]));
+}
+
+static void test_ewma_step(void)
+{
+    // alpha = 1/4: 0, 250, 438, 578, ... rounded to nearest
+    static const int16_t out[] = { 250, 438, 578, 684, 763, 822 };
+
+    filter_init(&f, FILTER_EWMA, 2);
+    TEST_ASSERT_EQUAL_INT16(0, filter_apply(&f, 0));
+    for (uint8_t i = 0; i < sizeof(out) / sizeof(out[0]); i++)
+        TEST_ASSERT_EQUAL_INT16(out[i], filter_apply(&f, 1000));
+
+    int16_t y = 0;
+    for (uint8_t i = 0; i < 40; i++)
+        y = filter_apply(&f, 1000);
+    TEST_ASSERT_EQUAL_INT16(1000, y); // no truncation offset in steady state
+
+    for (uint8_t i = 0; i < 60; i++)
+        y = filter_apply(&f, -1000);
+    TEST_ASSERT_EQUAL_INT16(-1000, y);
+}
+
+static void test_ewma_first_sample(void)
+{
+    filter_init(&f, FILTER_EWMA, 8);
+    TEST_ASSERT_EQUAL_INT16(3000, filter_apply(&f, 3000));
+    TEST_ASSERT_EQUAL_INT16(3000, filter_apply(&f, 3000));
+}
+
+static void test_avg_step(void)
+{
+    static const int16_t out[] = { 25, 50, 75, 100, 100 };
+
+    filter_init(&f, FILTER_AVG, 4);
+    for (uint8_t i = 0; i < 4; i++)
+        TEST_ASSERT_EQUAL_INT16(0, filter_apply(&f, 0));
+    for (uint8_t i = 0; i < sizeof(out) / sizeof(out[0]); i++)
+        TEST_ASSERT_EQUAL_INT16(out[i], filter_apply(&f, 100));
+}
+
+static void test_avg_short_window_after_reinit(void)
+{
+    filter_init(&f, FILTER_AVG, 8);
+    for (uint8_t i = 0; i < 8; i++)
+        filter_apply(&f, 4000);
+
+    filter_init(&f, FILTER_AVG, 8); // window restarts empty
+    TEST_ASSERT_EQUAL_INT16(10, filter_apply(&f, 10));
+    TEST_ASSERT_EQUAL_INT16(15, filter_apply(&f, 20));
+}
+
+static void test_param_clamped(void)
+{
+    filter_init(&f, FILTER_MEDIAN, 9);
+    TEST_ASSERT_EQUAL_UINT8(FILTER_MEDIAN_MAX, f.param);
+    filter_init(&f, FILTER_AVG, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, f.param);
+    filter_init(&f, FILTER_EWMA, 12);
+    TEST_ASSERT_EQUAL_UINT8(8, f.param);
+}
+
+static void test_hysteresis_steps(void)
+{
+    // thresholds 100, 200 with band 10
+    static const int16_t in[]  = { 0, 105, 110, 95, 90, 89, 210, 195, 500, -5 };
+    static const uint8_t out[] = { 0, 0,   1,   1,  1,  0,  2,   2,   2,   0 };
+    uint8_t level = 0;
+
+    for (uint8_t i = 0; i < sizeof(in) / sizeof(in[0]); i++)
+        TEST_ASSERT_EQUAL_UINT8(out[i], filter_hysteresis(&level, in[i], thresholds, 2, 10));
+}
+
+static void test_hysteresis_no_chatter(void)
+{
+    uint8_t level = 1;
+    uint8_t changes = 0;
+
+    // noise of +-9 around a threshold never changes the level
+    for (int16_t i = 0; i < 100; i++)
+    {
+        uint8_t old = level;
+        filter_hysteresis(&level, 100 + ((i & 1) ? 9 : -9), thresholds, 2, 10);
+        changes += old != level;
+    }
+    TEST_ASSERT_EQUAL_UINT8(0, changes);
+}
+
+static void test_cycles(void)
+{
+    static const uint8_t types[]  = { FILTER_MEDIAN, FILTER_MEDIAN, FILTER_EWMA, FILTER_AVG };
+    static const uint8_t params[] = { 3, 5, 3, 8 };
+    static const char * const names[] = { "median 3", "median 5", "ewma 1/8", "avg 8" };
+    volatile int16_t y;
+
+    for (uint8_t t = 0; t < sizeof(types); t++)
+    {
+        uint16_t worst = 0;
+
+        filter_init(&f, types[t], params[t]);
+        for (int16_t i = 0; i < 32; i++)
+        {
+            int16_t x = (i * 37) & 0x3FF; // unsorted input, worst case for median
+            cycles_start();
+            y = filter_apply(&f, x);
+            uint16_t c = cycles_stop();
+            if (c > worst)
+                worst = c;
+        }
+        cycles_report(names[t], worst);
+    }
+
+    uint8_t level = 0;
+    cycles_start();
+    y = filter_hysteresis(&level, 500, thresholds, 2, 10);
+    cycles_report("hysteresis 2 steps", cycles_stop());
+    (void)y;
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_none_passes_through);
+    RUN_TEST(test_median_removes_spike);
+    RUN_TEST(test_median_step);
+    RUN_TEST(test_median_duplicates);
+    RUN_TEST(test_ewma_step);
+    RUN_TEST(test_ewma_first_sample);
+    RUN_TEST(test_avg_step);
+    RUN_TEST(test_avg_short_window_after_reinit);
+    RUN_TEST(test_param_clamped);
+    RUN_TEST(test_hysteresis_steps);
+    RUN_TEST(test_hysteresis_no_chatter);
+    RUN_TEST(test_cycles);
+    UNITY_END();
+
+    while (1);
+}
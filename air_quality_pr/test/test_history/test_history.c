@@ -0,0 +1,160 @@
+// 1 h and 24 h windows of the PM history.
+// Run with "pio test -e uno -f test_history".
+
+#include <unity.h>
+#include <util/delay.h>
+#include "history.h"
+
+#define BUCKET HISTORY_BUCKET_MS
+
+static uint32_t now;
+
+// add one sample per minute for one bucket, then close it
+static void fill_bucket(int16_t value)
+{
+    for (uint8_t i = 0; i < 15; i++)
+    {
+        history_add(HIST_PM25, value);
+        now += 60000UL;
+        history_update(now);
+    }
+}
+
+void setUp(void)
+{
+    now = 0;
+    history_init(now);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_empty(void)
+{
+    history_stat_t s;
+
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HIST_PM25, HISTORY_24H, &s));
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HISTORY_METRICS, HISTORY_1H, &s));
+}
+
+static void test_running_bucket_not_in_window(void)
+{
+    history_stat_t s;
+
+    history_add(HIST_PM25, 100);
+    history_update(BUCKET - 1);
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HIST_PM25, HISTORY_1H, &s));
+
+    history_update(BUCKET);
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(100, s.mean);
+
+    // samples of the running bucket show only after it closed
+    history_add(HIST_PM25, 900);
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(100, s.max);
+}
+
+static void test_1h_covers_four_buckets(void)
+{
+    history_stat_t s;
+
+    fill_bucket(500); // falls out of the window below
+    fill_bucket(10);
+    fill_bucket(20);
+    fill_bucket(30);
+    fill_bucket(40);
+
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(10, s.min);
+    TEST_ASSERT_EQUAL_INT16(40, s.max);
+    TEST_ASSERT_EQUAL_INT16(25, s.mean);
+}
+
+static void test_min_max_within_bucket(void)
+{
+    history_stat_t s;
+
+    history_add(HIST_PM25, 70);
+    history_add(HIST_PM25, -5);
+    history_add(HIST_PM25, 30);
+    history_update(BUCKET);
+
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(-5, s.min);
+    TEST_ASSERT_EQUAL_INT16(70, s.max);
+    TEST_ASSERT_EQUAL_INT16(31, s.mean);
+}
+
+static void test_empty_bucket_skipped(void)
+{
+    history_stat_t s;
+
+    fill_bucket(60);
+    now += BUCKET; // sensor asleep for one bucket
+    history_update(now);
+
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(60, s.mean); // mean of non-empty buckets only
+}
+
+static void test_24h_after_two_hours(void)
+{
+    history_stat_t s;
+
+    for (uint8_t i = 0; i < HISTORY_L2_MERGE - 1; i++)
+        fill_bucket(80);
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HIST_PM25, HISTORY_24H, &s));
+
+    fill_bucket(160);
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_24H, &s));
+    TEST_ASSERT_EQUAL_INT16(80, s.min);
+    TEST_ASSERT_EQUAL_INT16(160, s.max);
+    TEST_ASSERT_EQUAL_INT16(90, s.mean);
+}
+
+static void test_24h_ring_wraps(void)
+{
+    history_stat_t s;
+
+    // 13 two hour buckets, the first one leaves the 24 h window
+    for (uint8_t b = 0; b < HISTORY_L2_BUCKETS + 1; b++)
+        for (uint8_t i = 0; i < HISTORY_L2_MERGE; i++)
+            fill_bucket(b == 0 ? 1000 : 50);
+
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM25, HISTORY_24H, &s));
+    TEST_ASSERT_EQUAL_INT16(50, s.max);
+    TEST_ASSERT_EQUAL_INT16(50, s.mean);
+}
+
+static void test_metrics_independent(void)
+{
+    history_stat_t s;
+
+    history_add(HIST_PM10, 42);
+    history_update(BUCKET);
+
+    TEST_ASSERT_EQUAL_UINT8(1, history_get(HIST_PM25, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_UINT8(0, history_get(HIST_PM10, HISTORY_1H, &s));
+    TEST_ASSERT_EQUAL_INT16(42, s.mean);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_running_bucket_not_in_window);
+    RUN_TEST(test_1h_covers_four_buckets);
+    RUN_TEST(test_min_max_within_bucket);
+    RUN_TEST(test_empty_bucket_skipped);
+    RUN_TEST(test_24h_after_two_hours);
+    RUN_TEST(test_24h_ring_wraps);
+    RUN_TEST(test_metrics_independent);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,151 @@
+// Fixed-point MQ135 estimator against the float formula of mq135_table.py.
+// Run with "pio test -e uno -f test_mq135".
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <util/delay.h>
+#include "mq135.h"
+#include "adc.h"
+#include "test_cycles.h"
+
+// constants of mq135_table.py
+#define PARA 116.6020682
+#define PARB (-2.769034857)
+#define CORA 0.00035
+#define CORB 0.02718
+#define CORC 1.39538
+#define CORD 0.0018
+
+#define PPM_ERROR_PERCENT 7 // interpolation chord at Rs/R0 < 0.2, Q8 resolution of small Rs
+
+static double rs_t(double t, double h)
+{
+    return CORA * t * t - CORB * t + CORC - CORD * (h - 33);
+}
+
+// float reference: ratio Rs/R0 corrected to 20 0C / 33 %RH, 0 outside of ppm table
+static double ref_ratio(uint16_t adc, int16_t t, int16_t h)
+{
+    double rs = (double)(ADC_RESULT_MAX - adc) / adc; // Rs/RL
+    double corr = rs_t(t, h) / rs_t(20, 33);
+
+    return rs / corr / (MQ135_R0_DEFAULT / 256.0);
+}
+
+static double ref_ppm(double ratio)
+{
+    return PARA * pow(ratio, PARB);
+}
+
+void setUp(void)
+{
+    mq135_set_r0(MQ135_R0_DEFAULT);
+    mq135_set_env(20, 33);
+}
+
+void tearDown(void)
+{
+}
+
+// correction table is normalized to 1024 at 20 0C / 33 %RH
+static void test_reference_point(void)
+{
+    for (uint16_t adc = 64; adc < ADC_RESULT_MAX; adc += 64)
+    {
+        uint32_t rs = mq135_rs_q8(adc);
+        TEST_ASSERT_UINT16_WITHIN(1, (rs << 10) / MQ135_R0_DEFAULT, mq135_ratio_q10(adc));
+    }
+}
+
+static void test_sweep_against_float(void)
+{
+    uint16_t worst = 0; // error in 0.1 %
+    uint32_t points = 0;
+
+    for (int16_t t = -10; t <= 50; t += 3)
+    {
+        for (int16_t h = 20; h <= 90; h += 10)
+        {
+            mq135_set_env(t, h);
+            for (uint16_t adc = 8; adc < ADC_RESULT_MAX; adc += 16)
+            {
+                double ratio = ref_ratio(adc, t, h);
+                if (ratio < 0.13 || ratio > 1.99) // ppm saturates outside of the table
+                    continue;
+
+                double ref = ref_ppm(ratio);
+                double got = mq135_get_ppm(adc);
+                uint16_t err = (uint16_t)(fabs(got - ref) * 1000 / ref);
+
+                if (err > worst)
+                    worst = err;
+                points++;
+                if (err > PPM_ERROR_PERCENT * 10)
+                {
+                    char msg[48];
+                    sprintf(msg, "adc %u t %d h %d: %u ppm, float %u", adc, t, h,
+                            (unsigned)got, (unsigned)ref);
+                    TEST_FAIL_MESSAGE(msg);
+                }
+            }
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(1000, points);
+
+    char msg[48];
+    sprintf(msg, "%lu points, worst error %u.%u %%", (unsigned long)points, worst / 10, worst % 10);
+    TEST_MESSAGE(msg);
+}
+
+static void test_saturation(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(mq135_ppm_from_ratio(0), mq135_ppm_from_ratio(128));
+    TEST_ASSERT_EQUAL_UINT16(mq135_ppm_from_ratio(2048), mq135_ppm_from_ratio(0xFFFF));
+    TEST_ASSERT_EQUAL_UINT16(mq135_rs_q8(1), mq135_rs_q8(0)); // open sensor
+    TEST_ASSERT_EQUAL_UINT16(0, mq135_rs_q8(ADC_RESULT_MAX + 1));
+}
+
+static void test_cycles(void)
+{
+    static const uint16_t adcs[] = { 400, 800, 1600, 3200 };
+    uint16_t fixed_max = 0;
+    uint16_t float_max = 0;
+    volatile uint16_t ppm;
+    volatile double ref;
+
+    mq135_set_env(27, 61); // interpolated correction
+    for (uint8_t i = 0; i < sizeof(adcs) / sizeof(adcs[0]); i++)
+    {
+        cycles_start();
+        ppm = mq135_get_ppm(adcs[i]);
+        uint16_t c = cycles_stop();
+        if (c > fixed_max)
+            fixed_max = c;
+
+        cycles_start();
+        ref = ref_ppm(ref_ratio(adcs[i], 27, 61));
+        c = cycles_stop();
+        if (c > float_max)
+            float_max = c;
+    }
+    (void)ppm;
+    (void)ref;
+    cycles_report("mq135_get_ppm", fixed_max);
+    cycles_report("float pow() reference", float_max);
+    TEST_ASSERT_LESS_THAN(float_max, fixed_max);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_reference_point);
+    RUN_TEST(test_sweep_against_float);
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_cycles);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,420 @@
+// Cycles of lines, rect fills and circle fills drawn as page byte spans,
+// and their pixels against the per pixel primitives they replaced.
+// Needs the panel on the TWI bus. Run both builds:
+//   pio test -e uno -f test_oled_draw
+//   PLATFORMIO_BUILD_FLAGS=-DOLED_FRAMEBUFFER pio test -e uno -f test_oled_draw
+// The per pixel primitives are reported by the frame buffer build only,
+// in page mode they returned early for other pages and the copies here don't.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "oled.h"
+#include "tick.h"
+#include "test_cycles.h"
+
+#if defined PAGEMODE
+# define MODE "page mode"
+#else
+# define MODE "frame buffer"
+#endif
+
+enum { LINE, RECT, CIRCLE };
+
+typedef struct {
+    const char *name;
+    uint8_t kind;
+    uint8_t x1, y1, x2, y2; // CIRCLE: center x1, y1 and radius x2
+} shape_t;
+
+// sizes of the host benchmark the spans were chosen by
+static const shape_t bench[] = {
+    { "hline 128",       LINE,   0,  20, 127, 20 },
+    { "hline 16",        LINE,   40, 20, 55,  20 },
+    { "vline 64",        LINE,   60, 0,  60,  63 },
+    { "vline 9",         LINE,   60, 5,  60,  13 }, // crosses a page
+    { "fillRect 3x3",    RECT,   10, 10, 12,  12 },
+    { "fillRect 41x31",  RECT,   20, 17, 60,  47 },
+    { "fillRect 128x64", RECT,   0,  0,  127, 63 },
+    { "fillCircle r5",   CIRCLE, 20, 20, 5,   0 },
+    { "fillCircle r30",  CIRCLE, 64, 32, 30,  0 },
+};
+
+static const shape_t edge[] = {
+    { "hline reversed",     LINE, 90,  33, 12,  33 },
+    { "vline reversed",     LINE, 7,   50, 7,   3 },
+    { "hline clipped",      LINE, 100, 5,  200, 5 },
+    { "vline clipped",      LINE, 3,   58, 3,   70 },
+    { "single pixel",       LINE, 9,   9,  9,   9 },
+    { "fillRect one page",  RECT, 0,   8,  127, 15 },
+    { "fillRect swapped",   RECT, 60,  40, 10,  8 },  // x swaps and takes y along
+    { "fillRect empty",     RECT, 60,  8,  10,  40 }, // y reversed after the swap
+    { "fillRect clipped",   RECT, 120, 60, 140, 70 },
+    { "fillRect one row",   RECT, 5,   31, 70,  31 },
+};
+
+#define COUNT(a) ((uint8_t)(sizeof(a) / sizeof(a[0])))
+
+// timed parts: composite shapes of the old path are timed part by part,
+// each part has to fit the 16 bit timer
+static uint8_t timing;
+static uint8_t part_sreg;
+static uint32_t sum;
+
+static void part_start(void)
+{
+    if (!timing) return;
+    part_sreg = SREG;
+    cli(); // tick and TWI interrupts
+    cycles_start();
+}
+
+static void part_stop(void)
+{
+    if (!timing) return;
+    sum += cycles_stop();
+    SREG = part_sreg;
+}
+
+static void draw_new(const shape_t *s, uint8_t color)
+{
+    part_start();
+    if (s->kind == LINE)
+    {
+        oled_drawLine(s->x1, s->y1, s->x2, s->y2, color);
+    }
+    else if (s->kind == RECT)
+    {
+        oled_fillRect(s->x1, s->y1, s->x2, s->y2, color);
+    }
+    else
+    {
+        oled_fillCircle(s->x1, s->y1, s->x2, color);
+    }
+    part_stop();
+}
+
+// oled_drawLine() before the spans: Bresenham for every line
+static void old_line(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
+{
+    int dx =  abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+    int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy, e2;
+
+    while (1)
+    {
+        oled_drawPixel(x1, y1, color);
+        if (x1 == x2 && y1 == y2) break;
+        e2 = 2 * err;
+        if (e2 > dy) { err += dy; x1 += sx; }
+        if (e2 < dx) { err += dx; y1 += sy; }
+    }
+}
+
+// oled_drawLine(), oled_fillRect() line by line and oled_fillCircle()
+// as circles of every radius, which left holes
+static void draw_old(const shape_t *s, uint8_t color)
+{
+    if (s->kind == LINE)
+    {
+        part_start();
+        old_line(s->x1, s->y1, s->x2, s->y2, color);
+        part_stop();
+    }
+    else if (s->kind == RECT)
+    {
+        uint8_t px1 = s->x1, py1 = s->y1, px2 = s->x2, py2 = s->y2;
+
+        if (px1 > px2)
+        {
+            px1 = s->x2;
+            px2 = s->x1;
+            py1 = s->y2;
+            py2 = s->y1;
+        }
+        for (uint8_t i = 0; i <= py2 - py1; i++)
+        {
+            part_start();
+            old_line(px1, py1 + i, px2, py1 + i, color);
+            part_stop();
+        }
+    }
+    else
+    {
+        for (uint8_t r = 0; r <= s->x2; r++)
+        {
+            part_start();
+            oled_drawCircle(s->x1, s->y1, r, color);
+            part_stop();
+        }
+    }
+}
+
+// filled circle by definition: every row from the leftmost to the rightmost
+// point of the midpoint outline oled_drawCircle() draws, clipped pixel by pixel
+static int8_t span_lo[DISPLAY_HEIGHT];
+static int8_t span_hi[DISPLAY_HEIGHT];
+
+static void outline_point(int8_t x, int8_t y, uint8_t r)
+{
+    uint8_t i = y + r;
+
+    if (x < span_lo[i]) span_lo[i] = x;
+    if (x > span_hi[i]) span_hi[i] = x;
+}
+
+static void draw_outline_spans(const shape_t *s, uint8_t color)
+{
+    uint8_t r = s->x2;
+    int16_t f = 1 - r;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * r;
+    int8_t x = 0;
+    int8_t y = r;
+
+    for (uint8_t i = 0; i <= 2 * r; i++)
+    {
+        span_lo[i] = INT8_MAX;
+        span_hi[i] = INT8_MIN;
+    }
+    outline_point(0, r, r);
+    outline_point(0, -r, r);
+    outline_point(r, 0, r);
+    outline_point(-r, 0, r);
+    while (x < y)
+    {
+        if (f >= 0)
+        {
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        outline_point(x, y, r);
+        outline_point(-x, y, r);
+        outline_point(x, -y, r);
+        outline_point(-x, -y, r);
+        outline_point(y, x, r);
+        outline_point(-y, x, r);
+        outline_point(y, -x, r);
+        outline_point(-y, -x, r);
+    }
+    for (uint8_t i = 0; i <= 2 * r; i++)
+    {
+        int16_t py = s->y1 + i - r;
+
+        for (int16_t px = s->x1 + span_lo[i]; px <= s->x1 + span_hi[i]; px++)
+        {
+            if (px >= 0 && px < DISPLAY_WIDTH && py >= 0 && py < DISPLAY_HEIGHT)
+            {
+                oled_drawPixel(px, py, color);
+            }
+        }
+    }
+}
+
+// -- cycles ---------------------------------------------------------
+static const shape_t *bench_shape;
+static uint8_t bench_old;
+static uint16_t most; // draw call of the page with most of the shape
+
+static void draw_bench(void)
+{
+    uint32_t before = sum;
+
+    if (bench_old)
+    {
+        draw_old(bench_shape, WHITE);
+    }
+    else
+    {
+        draw_new(bench_shape, WHITE);
+    }
+    if (sum - before > most)
+    {
+        most = sum - before;
+    }
+}
+
+static uint32_t measure(const shape_t *s, uint8_t old)
+{
+    bench_shape = s;
+    bench_old = old;
+    sum = 0;
+    most = 0;
+    timing = 1;
+    oled_render(draw_bench);
+    timing = 0;
+    return sum;
+}
+
+static void test_cycles(void)
+{
+    char name[64];
+
+    for (uint8_t i = 0; i < COUNT(bench); i++)
+    {
+        uint32_t spans = measure(&bench[i], 0);
+
+        sprintf(name, MODE ", %s", bench[i].name);
+        cycles_report(name, spans);
+#if defined PAGEMODE
+        sprintf(name, MODE ", %s, on its page", bench[i].name);
+        cycles_report(name, most);
+#else
+        uint32_t pixels = measure(&bench[i], 1);
+
+        sprintf(name, MODE ", %s, per pixel before", bench[i].name);
+        cycles_report(name, pixels);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(pixels, spans);
+#endif
+    }
+}
+
+// -- pixels ---------------------------------------------------------
+typedef void (*draw_shape_fn_t)(const shape_t *s, uint8_t color);
+
+static const shape_t *sub_shape;
+static draw_shape_fn_t sub_a, sub_b;
+static uint8_t sub_color;
+static uint16_t sub_left;
+static uint8_t sub_pages;
+
+// a in color on the other color, then b in the other color: every pixel of
+// a that b does not cover is left
+static void draw_subset(void)
+{
+    uint8_t back = (sub_color == WHITE) ? BLACK : WHITE;
+    uint8_t live = 0xff; // pages that can be read, page mode reads black outside of the page drawn now
+
+    if (back == WHITE)
+    {
+        oled_fillRect(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1, WHITE);
+        live = 0;
+        for (uint8_t p = 0; p < DISPLAY_HEIGHT / 8; p++)
+        {
+            if (oled_check_buffer(0, p * 8))
+            {
+                live |= 1 << p;
+            }
+        }
+    }
+    sub_pages |= live;
+    sub_a(sub_shape, sub_color);
+    sub_b(sub_shape, back);
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++)
+    {
+        if (!(live & (1 << (y / 8))))
+        {
+            continue;
+        }
+        for (uint8_t x = 0; x < DISPLAY_WIDTH; x++)
+        {
+            if ((oled_check_buffer(x, y) ? WHITE : BLACK) != back)
+            {
+                sub_left++;
+            }
+        }
+    }
+}
+
+// pixels of a not drawn by b, in both colors
+static uint16_t not_covered(const shape_t *s, draw_shape_fn_t a, draw_shape_fn_t b)
+{
+    uint16_t left = 0;
+
+    sub_shape = s;
+    sub_a = a;
+    sub_b = b;
+    for (uint8_t c = 0; c < 2; c++)
+    {
+        sub_color = c ? BLACK : WHITE;
+        sub_left = 0;
+        sub_pages = 0;
+        oled_render(draw_subset);
+        TEST_ASSERT_EQUAL_HEX8(0xff, sub_pages); // every page was checked
+        left += sub_left;
+    }
+    return left;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void check_same_as_old(const shape_t *s)
+{
+    TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, not_covered(s, draw_old, draw_new), s->name);
+    TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, not_covered(s, draw_new, draw_old), s->name);
+}
+
+static void test_lines_and_rects_same_as_old(void)
+{
+    for (uint8_t i = 0; i < COUNT(bench); i++)
+    {
+        if (bench[i].kind != CIRCLE)
+        {
+            check_same_as_old(&bench[i]);
+        }
+    }
+    for (uint8_t i = 0; i < COUNT(edge); i++)
+    {
+        check_same_as_old(&edge[i]);
+    }
+}
+
+static const shape_t circles[] = {
+    { "r0",          CIRCLE, 64,  32, 0,  0 },
+    { "r1",          CIRCLE, 64,  32, 1,  0 },
+    { "r2",          CIRCLE, 64,  32, 2,  0 },
+    { "r3",          CIRCLE, 64,  32, 3,  0 },
+    { "r4",          CIRCLE, 64,  32, 4,  0 },
+    { "r5",          CIRCLE, 20,  20, 5,  0 },
+    { "r7",          CIRCLE, 64,  32, 7,  0 },
+    { "r10",         CIRCLE, 64,  32, 10, 0 },
+    { "r15",         CIRCLE, 64,  32, 15, 0 },
+    { "r20",         CIRCLE, 64,  32, 20, 0 },
+    { "r30",         CIRCLE, 64,  32, 30, 0 },
+    { "r31",         CIRCLE, 64,  32, 31, 0 },
+    { "clipped top left",     CIRCLE, 5,   3,  12, 0 },
+    { "clipped bottom right", CIRCLE, 125, 60, 9,  0 },
+};
+
+// the spans fill the outline without holes, the old fill is covered
+static void test_circles_fill_outline(void)
+{
+    for (uint8_t i = 0; i < COUNT(circles); i++)
+    {
+        const shape_t *s = &circles[i];
+
+        TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, not_covered(s, draw_outline_spans, draw_new), s->name);
+        TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, not_covered(s, draw_new, draw_outline_spans), s->name);
+        TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, not_covered(s, draw_old, draw_new), s->name);
+    }
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    tick_init();
+    sei(); // TWI runs in interrupt, deadlines need the tick
+    oled_init(OLED_DISP_ON);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cycles);
+    RUN_TEST(test_lines_and_rects_same_as_old);
+    RUN_TEST(test_circles_fill_outline);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,210 @@
+// Bytes and transfers the screens send to the display, with the panel
+// connected to the TWI bus. Run with "pio test -e uno -f test_oled_flush".
+// Full-frame CPU time of the interrupt driven and the polled TWI path,
+// run both builds and compare the reports:
+//   pio test -e uno -f test_oled_flush
+//   PLATFORMIO_BUILD_FLAGS=-DOLED_TWI_ASYNC=0 pio test -e uno -f test_oled_flush
+
+#include <unity.h>
+#include <stdio.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "oled.h"
+#include "twi.h"
+#include "tick.h"
+#include "ui.h"
+#include "sensors.h"
+#include "history.h"
+#include "aqi.h"
+
+#define PAGE_BYTES (DISPLAY_WIDTH + 16) // one page of data and its address commands
+
+#if OLED_TWI_ASYNC
+# define TWI_MODE "TWI interrupt"
+#else
+# define TWI_MODE "TWI polled"
+#endif
+
+static void draw_cat(void)
+{
+    ui_cat_start(57, tick_ms());
+    ui_cat_update(tick_ms()); // first frame is due at once
+    ui_cat_stop();
+}
+
+typedef struct {
+    const char *name;
+    void (*draw)(void);
+} screen_t;
+
+static const screen_t screens[] = {
+    { "cat",          draw_cat },
+    { "T/H values",   screen_temp_hum_values },
+    { "T/H levels",   screen_temp_hum_levels },
+    { "PM values",    screen_pm_values },
+    { "PM levels",    screen_pm_levels },
+};
+
+#define SCREENS ((uint8_t)(sizeof(screens) / sizeof(screens[0])))
+
+static twi_stats_t twi_before;
+static uint32_t start_us;
+
+static void measure_start(void)
+{
+    twi_get_stats(&twi_before);
+    start_us = tick_us();
+}
+
+// "name: xfers, bytes counted by oled, bytes on the wire, time of draw and flush"
+static void measure_report(const char *name)
+{
+    uint32_t us = tick_us() - start_us;
+    twi_stats_t twi;
+    char msg[80];
+
+    _delay_ms(20); // last page leaves the bus in background
+    twi_get_stats(&twi);
+    sprintf(msg, "%s: %u xfers, %u bytes, %lu on the wire, %lu us", name,
+            oled_flush_xfers(), oled_flush_bytes(), (unsigned long)(twi.bytes - twi_before.bytes),
+            (unsigned long)us);
+    TEST_MESSAGE(msg);
+}
+
+static void set_values(int16_t temp)
+{
+    sensors_set(SENSOR_TEMP, temp, 0, LEVEL_GOOD, tick_ms());
+    sensors_set(SENSOR_HUM, 45, 0, LEVEL_GOOD, tick_ms());
+    sensors_set(SENSOR_CO2, 612, aqi_gas(612), AQI_GOOD, tick_ms());
+    sensors_set(SENSOR_PM25, 123, aqi_pm25(123), AQI_MODERATE, tick_ms());
+    sensors_set(SENSOR_PM10, 456, aqi_pm10(456), AQI_MODERATE, tick_ms());
+}
+
+void setUp(void)
+{
+    set_values(23);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_first_draw(void)
+{
+    for (uint8_t i = 0; i < SCREENS; i++)
+    {
+        oled_clrscr(); // panel is empty, empty pages are not sent
+        measure_start();
+        screens[i].draw();
+        measure_report(screens[i].name);
+        TEST_ASSERT_GREATER_THAN(0, oled_flush_bytes());
+        TEST_ASSERT_LESS_OR_EQUAL(DISPLAY_HEIGHT / 8 * PAGE_BYTES, oled_flush_bytes());
+    }
+}
+
+static void test_unchanged_redraw_sends_nothing(void)
+{
+    for (uint8_t i = 0; i < SCREENS; i++)
+    {
+        screens[i].draw();
+        screens[i].draw();
+        TEST_ASSERT_EQUAL_UINT16(0, oled_flush_bytes());
+        TEST_ASSERT_EQUAL_UINT8(0, oled_flush_xfers());
+    }
+}
+
+static void test_value_change_sends_one_page(void)
+{
+    screen_temp_hum_values();
+    set_values(24);
+    measure_start();
+    screen_temp_hum_values();
+    measure_report("T/H values, temperature 23 -> 24");
+    TEST_ASSERT_GREATER_THAN(0, oled_flush_bytes());
+    TEST_ASSERT_LESS_OR_EQUAL(PAGE_BYTES, oled_flush_bytes());
+}
+
+// page sums must tell swapped digits apart, a 16 bit sum did not
+static void test_swapped_digits_are_sent(void)
+{
+    static const int16_t values[][2] = { { 27, 72 }, { 427, 472 }, { 527, 572 }, { 119, 255 } };
+
+    for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        sensors_set(SENSOR_CO2, values[i][0], 0, AQI_GOOD, tick_ms());
+        screen_temp_hum_values();
+        sensors_set(SENSOR_CO2, values[i][1], 0, AQI_GOOD, tick_ms());
+        screen_temp_hum_values();
+        TEST_ASSERT_GREATER_THAN(0, oled_flush_bytes());
+    }
+}
+
+static void test_screen_change(void)
+{
+    for (uint8_t i = 0; i < SCREENS; i++)
+    {
+        uint8_t next = i + 1 < SCREENS ? i + 1 : 0;
+        char name[40];
+
+        screens[i].draw();
+        measure_start();
+        screens[next].draw();
+        sprintf(name, "%s -> %s", screens[i].name, screens[next].name);
+        measure_report(name);
+    }
+}
+
+static uint8_t frame_color;
+
+static void draw_full(void)
+{
+    oled_fillRect(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1, frame_color);
+}
+
+// every page changes: CPU time until oled_render() returns, and until the
+// last byte left the bus. The difference is free for other tasks.
+static void test_full_frame_cpu_time(void)
+{
+    char msg[80];
+
+    oled_clrscr();
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        frame_color = i ? BLACK : WHITE;
+        uint32_t start = tick_us();
+        oled_render(draw_full);
+        uint32_t cpu = tick_us() - start;
+        while (!twi_idle());
+        uint32_t wire = tick_us() - start;
+
+        TEST_ASSERT_GREATER_OR_EQUAL(DISPLAY_HEIGHT / 8 * DISPLAY_WIDTH, oled_flush_bytes()); // all pages sent
+        sprintf(msg, TWI_MODE ", full frame %s: %lu us CPU, %lu us until the bus is idle",
+                i ? "black" : "white", (unsigned long)cpu, (unsigned long)wire);
+        TEST_MESSAGE(msg);
+#if OLED_TWI_ASYNC && !defined PAGEMODE
+        TEST_ASSERT_LESS_THAN(wire / 4, cpu); // flush runs in background
+#endif
+    }
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    tick_init();
+    sei(); // TWI runs in interrupt, deadlines need the tick
+    oled_init(OLED_DISP_ON);
+    sensors_init();
+    history_init(tick_ms());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_first_draw);
+    RUN_TEST(test_unchanged_redraw_sends_nothing);
+    RUN_TEST(test_value_change_sends_one_page);
+    RUN_TEST(test_swapped_digits_are_sent);
+    RUN_TEST(test_screen_change);
+    RUN_TEST(test_full_frame_cpu_time);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,199 @@
+// Cycles per char of oled_puts() in both char sizes, and the glyphs of
+// special chars. Needs the panel on the TWI bus. Run both builds:
+//   pio test -e uno -f test_oled_text
+//   PLATFORMIO_BUILD_FLAGS=-DOLED_FRAMEBUFFER pio test -e uno -f test_oled_text
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+#include "oled.h"
+#include "tick.h"
+#include "test_cycles.h"
+
+#define TEXT "AQI 123 ok" // fits one line in both sizes
+#define TEXT_LEN ((uint8_t)(sizeof(TEXT) - 1))
+#define TEXT_PAGE 2
+
+#if defined PAGEMODE
+# define MODE "page mode"
+#else
+# define MODE "frame buffer"
+#endif
+
+static uint8_t use_putc;  // char by char as oled_puts() did before
+static uint32_t sum;      // cycles of all draw calls of the frame
+static uint16_t most;     // cycles of the draw call of the page with most of the text
+
+static void draw_text(void)
+{
+    uint16_t c = 0;
+
+    oled_gotoxy(0, TEXT_PAGE);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) // tick and TWI interrupts
+    {
+        cycles_start();
+        if (use_putc)
+        {
+            for (const char *s = TEXT; *s; s++)
+            {
+                oled_putc(*s);
+            }
+        }
+        else
+        {
+            oled_puts(TEXT);
+        }
+        c = cycles_stop();
+    }
+    sum += c;
+    if (c > most)
+    {
+        most = c;
+    }
+}
+
+// cycles per char of the whole frame, page mode also reports the drawn page
+static uint32_t measure(uint8_t size, uint8_t putc_path)
+{
+    char name[64];
+    const char *fn = putc_path ? "oled_putc" : "oled_puts";
+    const char *sz = size == DOUBLESIZE ? "DOUBLESIZE" : "NORMALSIZE";
+
+    use_putc = putc_path;
+    sum = 0;
+    most = 0;
+    oled_charMode(size);
+    oled_render(draw_text);
+    oled_charMode(NORMALSIZE);
+
+    sprintf(name, MODE ", %s %s, per char", sz, fn);
+    cycles_report(name, sum / TEXT_LEN);
+#if defined PAGEMODE
+    sprintf(name, MODE ", %s %s, per char on its page", sz, fn);
+    cycles_report(name, most / TEXT_LEN);
+#endif
+    return sum;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_cycles_normalsize(void)
+{
+    uint32_t by_puts = measure(NORMALSIZE, 0);
+    uint32_t by_putc = measure(NORMALSIZE, 1);
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(by_putc, by_puts);
+}
+
+static void test_cycles_doublesize(void)
+{
+    uint32_t by_puts = measure(DOUBLESIZE, 0);
+    uint32_t by_putc = measure(DOUBLESIZE, 1);
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(by_putc, by_puts);
+}
+
+static const char *glyph_text;
+static uint8_t got[2][18]; // columns of the text page and the page below
+
+// print and read the columns back, in page mode only the page drawn now
+// can be read, the others read 0
+static void draw_glyphs(void)
+{
+    oled_gotoxy(0, TEXT_PAGE);
+    oled_puts(glyph_text);
+    for (uint8_t p = 0; p < 2; p++)
+    {
+        for (uint8_t x = 0; x < sizeof(got[0]); x++)
+        {
+            for (uint8_t b = 0; b < 8; b++)
+            {
+                if (oled_check_buffer(x, (TEXT_PAGE + p) * 8 + b))
+                {
+                    got[p][x] |= 1 << b;
+                }
+            }
+        }
+    }
+}
+
+static void render_glyphs(const char *s, uint8_t size)
+{
+    glyph_text = s;
+    memset(got, 0, sizeof(got));
+    oled_charMode(size);
+    oled_render(draw_glyphs);
+    oled_charMode(NORMALSIZE);
+}
+
+// chars from 0x80 are the last byte of UTF-8, the lead bytes print nothing
+static void test_special_chars_normalsize(void)
+{
+    static const uint8_t expected[sizeof(got[0])] = {
+        0x00, 0x02, 0x05, 0x02, 0x00, 0x00, // °
+        0x00, 0x3A, 0x40, 0x40, 0x20, 0x7A, // ü
+    };
+    static const uint8_t empty[sizeof(got[0])];
+
+    render_glyphs("°ü", NORMALSIZE);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, got[0], sizeof(expected));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(empty, got[1], sizeof(empty));
+}
+
+static void test_special_chars_doublesize(void)
+{
+    static const uint8_t expected[2][sizeof(got[0])] = {
+        { 0x00, 0x00, 0xCC, 0xCC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xCC, 0xCC }, // ü, low nibbles
+        { 0x00, 0x00, 0x0F, 0x0F, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x3F, 0x3F }, // ü, high nibbles
+    };
+
+    render_glyphs("ü", DOUBLESIZE);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[0], got[0], sizeof(expected[0]));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[1], got[1], sizeof(expected[1]));
+}
+
+// every special char has a glyph, and it differs from the blank of no glyph
+static void test_special_chars_all_print(void)
+{
+    static const char *const chars[] = { "ü", "Ü", "ä", "Ä", "ö", "Ö", "°", "ß", "µ", "ω", "Ω" };
+
+    for (uint8_t i = 0; i < sizeof(chars) / sizeof(chars[0]); i++)
+    {
+        uint8_t ink = 0;
+
+        render_glyphs(chars[i], NORMALSIZE);
+        for (uint8_t x = 0; x < 6; x++)
+        {
+            ink |= got[0][x];
+        }
+        TEST_ASSERT_TRUE_MESSAGE(ink, chars[i]);
+    }
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    tick_init();
+    sei(); // TWI runs in interrupt, deadlines need the tick
+    oled_init(OLED_DISP_ON);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cycles_normalsize);
+    RUN_TEST(test_cycles_doublesize);
+    RUN_TEST(test_special_chars_normalsize);
+    RUN_TEST(test_special_chars_doublesize);
+    RUN_TEST(test_special_chars_all_print);
+    UNITY_END();
+
+    while (1);
+}
@@ -0,0 +1,174 @@
+// Release order, overruns, deadline misses and run time statistics of the
+// scheduler on a fake clock. Run with "pio test -e uno -f test_sched".
+
+#include <unity.h>
+#include <util/delay.h>
+#include "sched.h"
+#include "tick.h"
+
+// Fake clock in place of lib/tick: the linker takes these two from the test
+// object and does not pull tick.o out of the library archive.
+static uint32_t now_us;
+
+uint32_t tick_ms(void)
+{
+    return now_us / 1000;
+}
+
+uint32_t tick_us(void)
+{
+    return now_us;
+}
+
+// tasks order their letter and take cost_us of the fake clock
+static char order[16];
+static uint8_t log_len;
+static uint32_t cost_us[4];
+
+static void task(uint8_t i)
+{
+    if (log_len < sizeof(order) - 1)
+        order[log_len++] = 'A' + i;
+    order[log_len] = 0;
+    now_us += cost_us[i];
+}
+
+static void task_a(void) { task(0); }
+static void task_b(void) { task(1); }
+static void task_c(void) { task(2); }
+static void task_d(void) { task(3); }
+
+static uint8_t ids[SCHED_MAX_TASKS];
+static uint8_t id_count;
+
+static uint8_t add(sched_fn_t fn, uint16_t period_ms, uint16_t deadline_ms, uint16_t delay_ms)
+{
+    uint8_t id = sched_add(fn, period_ms, deadline_ms, delay_ms);
+
+    TEST_ASSERT_NOT_EQUAL(SCHED_NO_TASK, id);
+    ids[id_count++] = id;
+    return id;
+}
+
+// run the scheduler every ms up to and including end_ms, number of task runs
+static uint16_t run_until(uint32_t end_ms)
+{
+    uint16_t runs = 0;
+
+    while (tick_ms() <= end_ms)
+    {
+        runs += sched_run();
+        now_us = (tick_ms() + 1) * 1000;
+    }
+    return runs;
+}
+
+void setUp(void)
+{
+    log_len = 0;
+    order[0] = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        cost_us[i] = 100;
+}
+
+void tearDown(void)
+{
+    // the table cannot shrink, tasks of finished tests stay stopped
+    while (id_count)
+        sched_stop(ids[--id_count]);
+}
+
+// tasks released together run in the order they were added
+static void test_table_order(void)
+{
+    add(task_c, 10, 10, 5); // released first, added first
+    add(task_a, 10, 10, 0);
+    add(task_b, 10, 10, 0);
+
+    TEST_ASSERT_EQUAL_UINT8(2, sched_run());
+    TEST_ASSERT_EQUAL_STRING("AB", order);
+
+    run_until(tick_ms() + 5);
+    TEST_ASSERT_EQUAL_STRING("ABC", order);
+
+    log_len = 0;
+    run_until(tick_ms() + 11);
+    TEST_ASSERT_EQUAL_STRING("ABC", order); // each once per period
+}
+
+// a run longer than several periods does not cause a burst of catch-up runs
+static void test_overrun_skips_releases(void)
+{
+    uint8_t id = add(task_a, 10, 10, 0);
+    sched_stats_t st;
+
+    cost_us[0] = 35000;
+    TEST_ASSERT_EQUAL_UINT8(1, sched_run());
+    uint32_t end = tick_ms();
+
+    cost_us[0] = 100;
+    TEST_ASSERT_EQUAL_UINT8(0, sched_run()); // releases at +10, +20, +30 are dropped
+    TEST_ASSERT_EQUAL_UINT16(0, run_until(end + 9));
+    TEST_ASSERT_EQUAL_UINT16(1, run_until(end + 10)); // next release one period after the overrun
+    TEST_ASSERT_EQUAL_UINT16(5, run_until(end + 60)); // then back to the period
+
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT16(7, st.runs);
+    TEST_ASSERT_EQUAL_UINT16(1, st.misses);
+}
+
+static void test_deadline_misses(void)
+{
+    uint8_t id = add(task_a, 100, 5, 0);
+    uint32_t t0 = tick_ms();
+    sched_stats_t st;
+
+    cost_us[0] = 4000; // in time
+    sched_run();
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT16(0, st.misses);
+
+    cost_us[0] = 6000; // run itself too long
+    run_until(t0 + 100);
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT16(1, st.misses);
+
+    cost_us[0] = 2000; // short run, but started 4 ms late
+    now_us = (t0 + 204) * 1000;
+    sched_run();
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT16(2, st.misses);
+    TEST_ASSERT_EQUAL_UINT16(3, st.runs);
+}
+
+// a page-streamed frame takes ~100 ms, more than 16 bits of us
+static void test_max_run_time_32_bit(void)
+{
+    uint8_t id = add(task_d, 1000, 1000, 0);
+    sched_stats_t st;
+
+    cost_us[3] = 100000;
+    sched_run();
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT32(100000, st.max_us);
+
+    cost_us[3] = 70000; // max is kept
+    run_until(tick_ms() + 1000);
+    sched_get_stats(id, &st);
+    TEST_ASSERT_EQUAL_UINT32(100000, st.max_us);
+    TEST_ASSERT_EQUAL_UINT16(2, st.runs);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_table_order);
+    RUN_TEST(test_overrun_skips_releases);
+    RUN_TEST(test_deadline_misses);
+    RUN_TEST(test_max_run_time_32_bit);
+    UNITY_END();
+
+    while (1);
+}
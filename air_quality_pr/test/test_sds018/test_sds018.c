@@ -0,0 +1,390 @@
+// Frame parser of the SDS018 driver fed with recorded byte streams, and the
+// sampler run against a simulated sensor with a fake clock.
+// Run with "pio test -e uno -f test_sds018".
+
+#include <unity.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include "sds018.h"
+
+// frames as received from the sensor, device ID A1 60
+#define FRAME_123_456 0xAA, 0xC0, 0x7B, 0x00, 0xC8, 0x01, 0xA1, 0x60, 0x45, 0xAB // PM2.5 12.3, PM10 45.6
+#define FRAME_87_210  0xAA, 0xC0, 0x57, 0x00, 0xD2, 0x00, 0xA1, 0x60, 0x2A, 0xAB // PM2.5 8.7, PM10 21.0
+#define FRAME_50_60   0xAA, 0xC0, 0x32, 0x00, 0x3C, 0x00, 0xA1, 0x60, 0x6F, 0xAB // PM2.5 5.0, PM10 6.0
+#define REPLY_WORK    0xAA, 0xC5, 0x06, 0x01, 0x01, 0x00, 0xA1, 0x60, 0x09, 0xAB // reply to "work"
+
+static sds018_parser_t parser;
+static uint8_t results[5]; // count of each SDS018_PARSE_xxx
+
+static void feed_P(const uint8_t *stream, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+        results[sds018_parse_byte(&parser, pgm_read_byte(&stream[i]))]++;
+}
+
+void setUp(void)
+{
+    sds018_parser_reset(&parser);
+    for (uint8_t i = 0; i < sizeof(results); i++)
+        results[i] = 0;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_single_frame(void)
+{
+    static const uint8_t stream[] PROGMEM = { FRAME_123_456 };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL(9, results[SDS018_PARSE_BUSY]);
+    TEST_ASSERT_EQUAL_UINT16(123, parser.pm25_10);
+    TEST_ASSERT_EQUAL_UINT16(456, parser.pm10_10);
+}
+
+// frames split at every position between two reads of the ring buffer
+static void test_split_frames(void)
+{
+    static const uint8_t stream[] PROGMEM = { FRAME_123_456, FRAME_87_210 };
+
+    for (uint8_t split = 1; split < sizeof(stream); split++)
+    {
+        setUp();
+        feed_P(stream, split);
+        TEST_ASSERT_EQUAL(split >= SDS018_FRAME_LEN ? 1 : 0, results[SDS018_PARSE_FRAME]);
+        feed_P(stream + split, sizeof(stream) - split);
+        TEST_ASSERT_EQUAL(2, results[SDS018_PARSE_FRAME]);
+        TEST_ASSERT_EQUAL(0, results[SDS018_PARSE_RESYNC]);
+        TEST_ASSERT_EQUAL_UINT16(87, parser.pm25_10);
+        TEST_ASSERT_EQUAL_UINT16(210, parser.pm10_10);
+    }
+}
+
+// receiver started in the middle of a frame
+static void test_start_inside_frame(void)
+{
+    static const uint8_t stream[] PROGMEM = { 0xC8, 0x01, 0xA1, 0x60, 0x45, 0xAB, FRAME_87_210 };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL(0, results[SDS018_PARSE_RESYNC]);
+    TEST_ASSERT_EQUAL_UINT16(87, parser.pm25_10);
+}
+
+// 0xAA in the data of a partial frame is taken as header first
+static void test_resync_false_header(void)
+{
+    static const uint8_t stream[] PROGMEM = { 0x60, 0xAA, 0x01, FRAME_123_456 };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_RESYNC]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL_UINT16(123, parser.pm25_10);
+}
+
+// byte lost in a frame, the next header lands where the tail is expected
+static void test_resync_lost_byte(void)
+{
+    static const uint8_t stream[] PROGMEM = {
+        0xAA, 0xC0, 0x7B, 0x00, 0xC8, 0x01, 0xA1, 0x60, 0x45, // tail lost
+        FRAME_87_210,
+    };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_RESYNC]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL_UINT16(87, parser.pm25_10);
+    TEST_ASSERT_EQUAL_UINT16(210, parser.pm10_10);
+}
+
+// the next frame starts inside the bytes of a broken one
+static void test_resync_frame_inside_broken(void)
+{
+    static const uint8_t stream[] PROGMEM = { 0xAA, 0xC0, FRAME_50_60 };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_RESYNC]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL_UINT16(50, parser.pm25_10);
+    TEST_ASSERT_EQUAL_UINT16(60, parser.pm10_10);
+}
+
+static void test_bad_checksum(void)
+{
+    static const uint8_t stream[] PROGMEM = {
+        FRAME_123_456,
+        0xAA, 0xC0, 0x57, 0x00, 0xD3, 0x00, 0xA1, 0x60, 0x2A, 0xAB, // bit error in PM10
+        FRAME_50_60,
+    };
+
+    feed_P(stream, SDS018_FRAME_LEN * 2);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_BAD_CHECKSUM]);
+    TEST_ASSERT_EQUAL_UINT16(123, parser.pm25_10); // values of the corrupted frame are not taken
+    TEST_ASSERT_EQUAL_UINT16(456, parser.pm10_10);
+
+    feed_P(stream + SDS018_FRAME_LEN * 2, SDS018_FRAME_LEN);
+    TEST_ASSERT_EQUAL(2, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL_UINT16(50, parser.pm25_10);
+}
+
+static void test_reply(void)
+{
+    static const uint8_t stream[] PROGMEM = { FRAME_123_456, REPLY_WORK };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_REPLY]);
+    TEST_ASSERT_EQUAL(SDS018_CMD_SLEEP_WORK, parser.reply[0]);
+    TEST_ASSERT_EQUAL(1, parser.reply[1]); // set
+    TEST_ASSERT_EQUAL(1, parser.reply[2]); // work
+    TEST_ASSERT_EQUAL_UINT16(123, parser.pm25_10);
+}
+
+// sensor log: wake-up reply, noise while the fan starts, frames, one
+// corrupted and one truncated frame
+static void test_recorded_stream(void)
+{
+    static const uint8_t stream[] PROGMEM = {
+        REPLY_WORK,
+        0x00, 0xFF, 0xAA, 0x00, 0x13,
+        FRAME_123_456,
+        FRAME_87_210,
+        0xAA, 0xC0, 0x7B, 0x00, 0xC8, 0x01, 0xA1, 0x60, 0x44, 0xAB,
+        0xAA, 0xC0, 0x57, 0x00, 0xD2,
+        FRAME_50_60,
+        FRAME_123_456,
+    };
+
+    feed_P(stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_REPLY]);
+    TEST_ASSERT_EQUAL(4, results[SDS018_PARSE_FRAME]);
+    TEST_ASSERT_EQUAL(1, results[SDS018_PARSE_BAD_CHECKSUM]);
+    TEST_ASSERT_EQUAL(2, results[SDS018_PARSE_RESYNC]);
+    TEST_ASSERT_EQUAL_UINT16(123, parser.pm25_10);
+    TEST_ASSERT_EQUAL_UINT16(456, parser.pm10_10);
+}
+
+// simulated sensor behind the driver ring buffers, interrupts stay disabled so
+// sds018_init() is not called and USART0 keeps sending the test output
+#define SIM_STEP_MS 100 // fake clock step between two sampler updates
+
+static const sds018_policy_t policy = {
+    .interval_ms = 60000, .min_interval_ms = 15000, .spinup_ms = 5000,
+    .frames = 3, .adaptive = 1, .rise_10 = 50,
+};
+
+static struct {
+    uint8_t  cmd[SDS018_CMD_LEN]; // command being received from the driver
+    uint8_t  pos;
+    uint8_t  lose;     // number of next commands lost on the line
+    uint8_t  working;  // fan and laser on, a frame every second
+    uint32_t frame_ms; // time of last frame
+    uint16_t pm25_10;  // value reported in frames
+} sim;
+
+static uint32_t now;
+
+static void sim_send(uint8_t type, const uint8_t *data)
+{
+    uint8_t frame[SDS018_FRAME_LEN] = { 0xAA, type, data[0], data[1], data[2], data[3], 0xA1, 0x60, 0, 0xAB };
+
+    for (uint8_t i = 2; i < 8; i++)
+        frame[8] += frame[i];
+    for (uint8_t i = 0; i < SDS018_FRAME_LEN; i++)
+        sds018_rx_byte(0, frame[i]);
+}
+
+// take commands sent by the driver, answer them and send frames while working
+static void sim_poll(void)
+{
+    uint8_t b;
+
+    while (sds018_tx_byte(0, &b) == 0)
+    {
+        if (sim.pos == 0 && b != 0xAA)
+            continue;
+        sim.cmd[sim.pos++] = b;
+        if (sim.pos < SDS018_CMD_LEN)
+            continue;
+        sim.pos = 0;
+        if (sim.lose)
+        {
+            sim.lose--;
+            continue;
+        }
+        if (sim.cmd[2] == SDS018_CMD_SLEEP_WORK && sim.cmd[3] == 1)
+        {
+            if (sim.cmd[4] && !sim.working)
+                sim.frame_ms = now;
+            sim.working = sim.cmd[4];
+        }
+        sim_send(0xC5, &sim.cmd[2]);
+    }
+
+    if (sim.working && now - sim.frame_ms >= 1000)
+    {
+        uint8_t data[4] = { sim.pm25_10 & 0xFF, sim.pm25_10 >> 8, 0x2C, 0x01 }; // PM10 30.0
+
+        sim.frame_ms = now;
+        sim_send(0xC0, data);
+    }
+}
+
+// advance the fake clock until the sampler returns a value or limit_ms passed, 0 on value
+static uint8_t run(uint32_t limit_ms, uint16_t *pm25_10)
+{
+    uint16_t pm10_10;
+
+    for (uint32_t end = now + limit_ms; now != end; now += SIM_STEP_MS)
+    {
+        sim_poll();
+        if (sds018_sampler_update(0, now, pm25_10, &pm10_10) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+// advance the fake clock until the sampler enters state, elapsed ms
+static uint32_t run_to_state(uint8_t state)
+{
+    uint32_t start = now;
+    uint16_t pm25_10, pm10_10;
+
+    while (sds018_sampler_state(0) != state && now - start < 600000UL)
+    {
+        now += SIM_STEP_MS;
+        sim_poll();
+        sds018_sampler_update(0, now, &pm25_10, &pm10_10);
+    }
+    return now - start;
+}
+
+static void sampler_start(uint16_t pm25_10)
+{
+    sds018_stats_t stats;
+    uint8_t b;
+
+    while (sds018_tx_byte(0, &b) == 0); // commands left by the previous test
+    sds018_get_stats(0, &stats);        // and received bytes
+    sim.pos = 0;
+    sim.lose = 0;
+    sim.working = 0;
+    sim.pm25_10 = pm25_10;
+    sds018_sampler_start(0, &policy, now);
+}
+
+static void test_sampler_cycle(void)
+{
+    sds018_stats_t before, after;
+    uint16_t pm25_10;
+
+    sampler_start(123);
+    sds018_get_stats(0, &before);
+    TEST_ASSERT_EQUAL(SDS018_STATE_SPINUP, sds018_sampler_state(0));
+
+    TEST_ASSERT_EQUAL_UINT32(policy.spinup_ms, run_to_state(SDS018_STATE_SAMPLING));
+    TEST_ASSERT_EQUAL(1, sim.working);
+
+    TEST_ASSERT_EQUAL(0, run(10000, &pm25_10));
+    TEST_ASSERT_EQUAL_UINT16(123, pm25_10);
+    TEST_ASSERT_EQUAL(SDS018_STATE_SLEEP, sds018_sampler_state(0));
+    sim_poll();
+    TEST_ASSERT_EQUAL(0, sim.working); // sleep command arrived
+
+    sds018_get_stats(0, &after);
+    TEST_ASSERT_EQUAL_UINT16(4, after.replies - before.replies); // report mode, period, work, sleep
+    TEST_ASSERT(after.frames - before.frames >= policy.frames); // frames during spin-up are not averaged
+    TEST_ASSERT_EQUAL_UINT16(0, after.no_data - before.no_data);
+    TEST_ASSERT_EQUAL_UINT16(0, after.tx_dropped - before.tx_dropped);
+
+    TEST_ASSERT_EQUAL_UINT32(policy.interval_ms, run_to_state(SDS018_STATE_SPINUP));
+    sim_poll();
+    TEST_ASSERT_EQUAL(1, sim.working);
+}
+
+// sleep interval halves while PM2.5 climbs and doubles back once it is stable
+static void test_sampler_adaptive(void)
+{
+    static const uint16_t pm[] = { 100, 200, 300, 400, 400, 400, 400 };
+    static const uint32_t interval[] = { 60000, 30000, 15000, 15000, 30000, 60000, 60000 };
+    uint16_t pm25_10;
+
+    sampler_start(pm[0]);
+    for (uint8_t i = 0; i < sizeof(pm) / sizeof(pm[0]); i++)
+    {
+        sim.pm25_10 = pm[i];
+        TEST_ASSERT_EQUAL(0, run(600000UL, &pm25_10));
+        TEST_ASSERT_EQUAL_UINT16(pm[i], pm25_10);
+        TEST_ASSERT_EQUAL_UINT32(interval[i], sds018_sampler_interval(0));
+        TEST_ASSERT_EQUAL_UINT32(interval[i], run_to_state(SDS018_STATE_SPINUP));
+    }
+}
+
+// wake command lost, the sensor stays asleep and never answers
+static void test_sampler_missing_reply(void)
+{
+    sds018_stats_t before, after;
+    uint16_t pm25_10;
+
+    sampler_start(87);
+    TEST_ASSERT_EQUAL(0, run(10000, &pm25_10));
+    sim_poll(); // sensor takes the sleep command
+    sds018_get_stats(0, &before);
+
+    sim.lose = 1;
+    run_to_state(SDS018_STATE_SPINUP);
+    sim_poll();
+    TEST_ASSERT_EQUAL(0, sim.working);
+
+    // no frame within twice the burst time, the wake command is sent again
+    TEST_ASSERT_EQUAL_UINT32(policy.spinup_ms, run_to_state(SDS018_STATE_SAMPLING));
+    TEST_ASSERT_EQUAL_UINT32(2000UL * (policy.frames + 1), run_to_state(SDS018_STATE_SPINUP));
+    sds018_get_stats(0, &after);
+    TEST_ASSERT_EQUAL_UINT16(1, after.no_data - before.no_data);
+    TEST_ASSERT_EQUAL_UINT16(0, after.replies - before.replies);
+
+    TEST_ASSERT_EQUAL(0, run(20000, &pm25_10));
+    TEST_ASSERT_EQUAL_UINT16(87, pm25_10);
+    sim_poll();
+    sds018_get_stats(0, &after);
+    TEST_ASSERT_EQUAL_UINT16(2, after.replies - before.replies); // work, sleep
+}
+
+// sleep command from the datasheet
+static void test_encode_sleep(void)
+{
+    static const uint8_t expected[SDS018_CMD_LEN] = {
+        0xAA, 0xB4, 0x06, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x05, 0xAB,
+    };
+    uint8_t frame[SDS018_CMD_LEN];
+
+    sds018_encode_cmd(frame, SDS018_CMD_SLEEP_WORK, 1, 0);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, frame, SDS018_CMD_LEN);
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    UNITY_BEGIN();
+    RUN_TEST(test_single_frame);
+    RUN_TEST(test_split_frames);
+    RUN_TEST(test_start_inside_frame);
+    RUN_TEST(test_resync_false_header);
+    RUN_TEST(test_resync_lost_byte);
+    RUN_TEST(test_resync_frame_inside_broken);
+    RUN_TEST(test_bad_checksum);
+    RUN_TEST(test_reply);
+    RUN_TEST(test_recorded_stream);
+    RUN_TEST(test_encode_sleep);
+    RUN_TEST(test_sampler_cycle);
+    RUN_TEST(test_sampler_adaptive);
+    RUN_TEST(test_sampler_missing_reply);
+    UNITY_END();
+
+    while (1);
+}
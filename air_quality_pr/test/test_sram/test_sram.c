@@ -0,0 +1,83 @@
+// Peak SRAM of drawing all screens, page mode against the frame buffer.
+// Needs the panel on the TWI bus. Run both builds and compare the reports:
+//   pio test -e uno -f test_sram
+//   PLATFORMIO_BUILD_FLAGS=-DOLED_FRAMEBUFFER pio test -e uno -f test_sram
+
+#include <unity.h>
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "sram.h"
+#include "oled.h"
+#include "tick.h"
+#include "ui.h"
+#include "sensors.h"
+#include "history.h"
+#include "aqi.h"
+
+#if defined PAGEMODE
+# define MODE "page mode"
+#else
+# define MODE "frame buffer"
+#endif
+
+#define SRAM_SIZE (RAMEND + 1 - RAMSTART)
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void draw_all_screens(void)
+{
+    sensors_set(SENSOR_TEMP, 23, 0, LEVEL_GOOD, tick_ms());
+    sensors_set(SENSOR_HUM, 45, 0, LEVEL_GOOD, tick_ms());
+    sensors_set(SENSOR_CO2, 612, aqi_gas(612), AQI_GOOD, tick_ms());
+    sensors_set(SENSOR_PM25, 123, aqi_pm25(123), AQI_MODERATE, tick_ms());
+    sensors_set(SENSOR_PM10, 456, aqi_pm10(456), AQI_MODERATE, tick_ms());
+
+    ui_cat_start(57, tick_ms());
+    ui_cat_update(tick_ms());
+    ui_cat_stop();
+    screen_temp_hum_values();
+    screen_temp_hum_levels();
+    screen_pm_values();
+    screen_pm_levels();
+}
+
+static void test_peak_sram(void)
+{
+    uint16_t before = sram_peak();
+    draw_all_screens();
+    uint16_t peak = sram_peak();
+    char msg[80];
+
+    sprintf(msg, MODE ": static %u, peak %u before drawing, %u after, %u of %u free",
+            sram_static(), before, peak, SRAM_SIZE - peak, SRAM_SIZE);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(SRAM_SIZE, peak);
+    TEST_ASSERT_GREATER_OR_EQUAL(sram_static(), before);
+}
+
+int main(void)
+{
+    sram_paint(); // before anything uses the stack
+
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    tick_init();
+    sei(); // TWI runs in interrupt, deadlines need the tick
+    oled_init(OLED_DISP_ON);
+    sensors_init();
+    history_init(tick_ms());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_peak_sram);
+    UNITY_END();
+
+    while (1);
+}
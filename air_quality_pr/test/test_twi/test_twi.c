@@ -0,0 +1,208 @@
+// Deadlines and bus recovery of the polled TWI functions, and faults of the
+// interrupt driven engine. Needs the panel on the TWI bus. Arbitration loss
+// needs a second master and is not covered here.
+// Run with "pio test -e uno -f test_twi".
+
+#include <unity.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "twi.h"
+#include "tick.h"
+#include "oled.h"
+
+#define NO_SLAVE 0x55 // free address on the board
+#define RECOVER_US 150 // twi_recover(): up to 9 GPIO clocks, Stop and init
+
+// Slowest bit rate, about 490 Hz, one byte takes 18 ms. Looks like a slave
+// stretching the clock, TWINT does not come before the deadline.
+static void twi_slow(void)
+{
+    TWBR = 0xff;
+    TWSR |= (1<<TWPS1) | (1<<TWPS0); // prescaler 64
+}
+
+void setUp(void)
+{
+    twi_init();
+    twi_get_error();
+}
+
+void tearDown(void)
+{
+    twi_stop();
+    _delay_us(100); // Stop leaves the bus
+}
+
+static void test_panel_acks(void)
+{
+    TEST_ASSERT_EQUAL(TWI_OK, twi_start());
+    TEST_ASSERT_EQUAL(0, twi_write((OLED_I2C_ADR<<1) | TWI_WRITE));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_get_error());
+}
+
+// nobody answers, NACK comes within one byte and the bus needs no recovery
+static void test_no_slave_nacks(void)
+{
+    uint16_t recoveries = twi_get_recoveries();
+    uint32_t start = tick_us();
+
+    TEST_ASSERT_EQUAL(TWI_OK, twi_start());
+    TEST_ASSERT_EQUAL(1, twi_write((NO_SLAVE<<1) | TWI_WRITE));
+    TEST_ASSERT_LESS_THAN(1000, tick_us() - start);
+    TEST_ASSERT_EQUAL_UINT16(recoveries, twi_get_recoveries());
+    TEST_ASSERT_EQUAL(TWI_OK, twi_get_error());
+}
+
+static void test_write_timeout(void)
+{
+    uint16_t recoveries = twi_get_recoveries();
+
+    TEST_ASSERT_EQUAL(TWI_OK, twi_start());
+    twi_slow();
+
+    uint32_t start = tick_us();
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, twi_write((OLED_I2C_ADR<<1) | TWI_WRITE));
+    uint32_t us = tick_us() - start;
+
+    // deadline is TWI_TIMEOUT_MS + 1 ticks of 1 ms after a tick inside the first one
+    TEST_ASSERT_GREATER_THAN(TWI_TIMEOUT_MS * 1000UL, us);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32((TWI_TIMEOUT_MS + 1) * 1000UL + RECOVER_US, us);
+    TEST_ASSERT_EQUAL_UINT16(recoveries + 1, twi_get_recoveries());
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, twi_get_error());
+}
+
+// recovery initializes the unit again, so the bus works at once
+static void test_bus_works_after_timeout(void)
+{
+    TEST_ASSERT_EQUAL(TWI_OK, twi_start());
+    twi_slow();
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, twi_write((OLED_I2C_ADR<<1) | TWI_WRITE));
+
+    TEST_ASSERT_EQUAL(TWI_OK, twi_start());
+    TEST_ASSERT_EQUAL(0, twi_write((OLED_I2C_ADR<<1) | TWI_WRITE));
+    twi_stop();
+    TEST_ASSERT_EQUAL(0, twi_test_address(OLED_I2C_ADR));
+}
+
+// display NOP commands, harmless payload for the engine
+#define NOP_LEN 32
+static const uint8_t nops[NOP_LEN] = {
+    0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3,
+    0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3, 0xE3,
+};
+
+static void xfer_init(twi_xfer_t *x, uint8_t addr, twi_done_fn_t done)
+{
+    x->addr = addr;
+    x->ctrl = 0x00; // command stream
+    x->buf = nops;
+    x->len = NOP_LEN;
+    x->done = done;
+}
+
+// NACK ends one transaction, the next one in the queue runs normally
+static void test_async_nack(void)
+{
+    twi_xfer_t bad, good;
+    twi_stats_t st0, st;
+    uint16_t recoveries = twi_get_recoveries();
+
+    xfer_init(&bad, NO_SLAVE, 0);
+    xfer_init(&good, OLED_I2C_ADR, 0);
+    twi_get_stats(&st0);
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&bad));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&good));
+
+    TEST_ASSERT_EQUAL(TWI_ERR_NACK, twi_sync(&bad));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_sync(&good));
+    twi_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT16(st0.nacks + 1, st.nacks);
+    TEST_ASSERT_EQUAL_UINT16(st0.xfers + 2, st.xfers);
+    TEST_ASSERT_EQUAL_UINT32(st0.bytes + 1 + NOP_LEN + 2, st.bytes); // SLA+W of bad one, all of good one
+    TEST_ASSERT_EQUAL_UINT16(recoveries, twi_get_recoveries());
+    TEST_ASSERT_EQUAL(TWI_ERR_NACK, twi_get_error());
+}
+
+// callback sends the transaction again to the right address, from the interrupt
+static void resend(twi_xfer_t *x)
+{
+    if (x->status == TWI_ERR_NACK)
+    {
+        x->addr = OLED_I2C_ADR;
+        twi_submit(x);
+    }
+}
+
+static void test_async_resend_from_callback(void)
+{
+    twi_xfer_t x;
+
+    xfer_init(&x, NO_SLAVE, resend);
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&x));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_sync(&x));
+    TEST_ASSERT_EQUAL(OLED_I2C_ADR, x.addr);
+    TEST_ASSERT_TRUE(twi_idle());
+}
+
+static void test_async_queue_full(void)
+{
+    twi_xfer_t x[TWI_QUEUE_LEN + 1];
+
+    for (uint8_t i = 0; i < TWI_QUEUE_LEN; i++)
+    {
+        xfer_init(&x[i], OLED_I2C_ADR, 0);
+        TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&x[i]));
+    }
+    xfer_init(&x[TWI_QUEUE_LEN], OLED_I2C_ADR, 0);
+    TEST_ASSERT_EQUAL(TWI_ERR_FULL, twi_submit(&x[TWI_QUEUE_LEN]));
+    for (uint8_t i = 0; i < TWI_QUEUE_LEN; i++)
+        TEST_ASSERT_EQUAL(TWI_OK, twi_sync(&x[i]));
+}
+
+// no interrupt for TWI_TIMEOUT_MS aborts everything queued and recovers the bus
+static void test_async_timeout_abort(void)
+{
+    twi_xfer_t a, b;
+    uint16_t recoveries = twi_get_recoveries();
+
+    xfer_init(&a, OLED_I2C_ADR, 0);
+    xfer_init(&b, OLED_I2C_ADR, 0);
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&a));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&b));
+    twi_slow();
+
+    uint32_t start = tick_us();
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, twi_sync(&a));
+    uint32_t us = tick_us() - start;
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, b.status);
+    TEST_ASSERT_TRUE(twi_idle());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32((TWI_TIMEOUT_MS + 1) * 1000UL + RECOVER_US, us);
+    TEST_ASSERT_EQUAL_UINT16(recoveries + 1, twi_get_recoveries());
+    TEST_ASSERT_EQUAL(TWI_ERR_TIMEOUT, twi_get_error());
+
+    // recovery restored the bit rate, the engine works again
+    TEST_ASSERT_EQUAL(TWI_OK, twi_submit(&a));
+    TEST_ASSERT_EQUAL(TWI_OK, twi_sync(&a));
+}
+
+int main(void)
+{
+    _delay_ms(2000); // board resets when the test runner opens the port
+
+    tick_init();
+    sei(); // deadlines need the tick
+
+    UNITY_BEGIN();
+    RUN_TEST(test_panel_acks);
+    RUN_TEST(test_no_slave_nacks);
+    RUN_TEST(test_write_timeout);
+    RUN_TEST(test_bus_works_after_timeout);
+    RUN_TEST(test_async_nack);
+    RUN_TEST(test_async_resend_from_callback);
+    RUN_TEST(test_async_queue_full);
+    RUN_TEST(test_async_timeout_abort);
+    UNITY_END();
+
+    while (1);
+}
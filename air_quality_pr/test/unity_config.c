@@ -0,0 +1,35 @@
+#include "unity_config.h"
+#include <avr/io.h>
+
+#ifndef F_CPU
+# define F_CPU 16000000UL
+#endif
+
+#define TEST_BAUD 115200 // monitor_speed in platformio.ini
+
+void unityOutputStart(void)
+{
+    uint16_t ubrr = (F_CPU / (8UL * TEST_BAUD)) - 1; // double speed mode, 2.1 % error at 16 MHz
+
+    UCSR0A = (1 << U2X0);
+    UBRR0H = (uint8_t)(ubrr >> 8);
+    UBRR0L = (uint8_t)(ubrr & 0xFF);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); // 8bit data, 1 stop, no parity
+    UCSR0B = (1 << TXEN0); // polled, no interrupts
+}
+
+void unityOutputChar(char c)
+{
+    while (!(UCSR0A & (1 << UDRE0)));
+    UCSR0A = (1 << U2X0) | (1 << TXC0); // clear transmit complete flag
+    UDR0 = c;
+}
+
+void unityOutputFlush(void)
+{
+}
+
+void unityOutputComplete(void)
+{
+    while (!(UCSR0A & (1 << TXC0))); // last byte left the shift register
+}
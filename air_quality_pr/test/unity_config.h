@@ -0,0 +1,17 @@
+#ifndef UNITY_CONFIG_H
+#define UNITY_CONFIG_H
+
+// Unity output of the test runner goes to USART0 at monitor_speed,
+// the board has no framework which would provide it.
+
+void unityOutputStart(void);
+void unityOutputChar(char c);
+void unityOutputFlush(void);
+void unityOutputComplete(void);
+
+#define UNITY_OUTPUT_START()    unityOutputStart()
+#define UNITY_OUTPUT_CHAR(c)    unityOutputChar(c)
+#define UNITY_OUTPUT_FLUSH()    unityOutputFlush()
+#define UNITY_OUTPUT_COMPLETE() unityOutputComplete()
+
+#endif